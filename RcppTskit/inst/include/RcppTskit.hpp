@@ -2,7 +2,9 @@
 #define RCPPTSKIT_H
 
 #include <Rcpp.h>
+#include <R_ext/Rdynload.h>
 #include <tskit.h>
+#include <vector>
 
 // Finaliser that frees tsk_treeseq_t when it is garbage collected
 // See \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_free}
@@ -14,12 +16,60 @@ static void rtsk_treeseq_free(tsk_treeseq_t *ptr) {
   }
 }
 
-// Finaliser that frees tsk_table_collection_t when it is garbage collected
+// Tables (and edge indexes) of a table collection as bits of the mask of
+// tables that it borrows from a tree sequence; see rtsk_treeseq_copy_tables()
+// with lazy = true
+enum rtsk_table_bit : unsigned {
+  RTSK_INDIVIDUALS = 1u << 0,
+  RTSK_NODES = 1u << 1,
+  RTSK_EDGES = 1u << 2,
+  RTSK_MIGRATIONS = 1u << 3,
+  RTSK_SITES = 1u << 4,
+  RTSK_MUTATIONS = 1u << 5,
+  RTSK_POPULATIONS = 1u << 6,
+  RTSK_PROVENANCES = 1u << 7,
+  RTSK_INDEXES = 1u << 8,
+  RTSK_ALL_TABLES = (1u << 9) - 1
+};
+
+// A table collection from rtsk_treeseq_copy_tables(ts, lazy = true) borrows
+// the tables of the tree sequence until they are modified. The registry of
+// borrowed tables lives in RcppTskit.cpp, and the functions below call it
+// through the C callables that RcppTskit registers, so that all code using
+// this header shares it. Code that modifies the tables of such a table
+// collection with tskit C functions must call rtsk_table_collection_own()
+// first, or it would write into the tree sequence.
+
+// Copy the borrowed tables in the mask so that the table collection owns
+// (and can modify) them; returns 0 or a tskit error code, in which case the
+// table that failed stays borrowed
+inline int rtsk_table_collection_own(tsk_table_collection_t *tc,
+                                     unsigned tables = RTSK_ALL_TABLES) {
+  using own_t = int (*)(tsk_table_collection_t *, unsigned);
+  static const own_t own = reinterpret_cast<own_t>(
+      R_GetCCallable("RcppTskit", "rtsk_table_collection_own"));
+  return own(tc, tables);
+}
+
+// Forget the borrowed tables in the mask without copying or freeing them,
+// leaving them zeroed; so only release the edge indexes (which is the same
+// as dropping them) or a table collection that is about to be freed
+inline void rtsk_table_collection_release(tsk_table_collection_t *tc,
+                                          unsigned tables = RTSK_ALL_TABLES) {
+  using release_t = void (*)(tsk_table_collection_t *, unsigned);
+  static const release_t release = reinterpret_cast<release_t>(
+      R_GetCCallable("RcppTskit", "rtsk_table_collection_release"));
+  release(tc, tables);
+}
+
+// Finaliser that frees tsk_table_collection_t when it is garbage collected,
+// except for any tables that it borrows from a tree sequence
 // See
 // \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_free}
 // for more details.
 static void rtsk_table_collection_free(tsk_table_collection_t *ptr) {
   if (ptr != NULL) {
+    rtsk_table_collection_release(ptr);
     tsk_table_collection_free(ptr);
     delete ptr;
   }
@@ -35,6 +85,63 @@ using rtsk_table_collection_t =
     Rcpp::XPtr<tsk_table_collection_t, Rcpp::PreserveStorage,
                rtsk_table_collection_free, true>;
 
+// Iterator over the sites of a tree sequence, decoding genotypes with
+// tsk_variant_t; see rtsk_variant_iterator_init()
+struct rtsk_variant_iterator {
+  tsk_variant_t variant;
+  tsk_id_t next_site;
+};
+
+// Finaliser that frees rtsk_variant_iterator when it is garbage collected
+// See \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_free}
+// for more details.
+static void rtsk_variant_iterator_free(rtsk_variant_iterator *ptr) {
+  if (ptr != NULL) {
+    tsk_variant_free(&ptr->variant);
+    delete ptr;
+  }
+}
+
+// Define the external pointer type for rtsk_variant_iterator with its
+// finaliser
+using rtsk_variant_iterator_t =
+    Rcpp::XPtr<rtsk_variant_iterator, Rcpp::PreserveStorage,
+               rtsk_variant_iterator_free, true>;
+
+// Edge of a recorder that is buffered until it is added to the edge table;
+// see rtsk_recorder_init()
+struct rtsk_recorder_edge {
+  double left;
+  double right;
+  tsk_id_t parent;
+  tsk_id_t child;
+};
+
+// Recorder of a forward simulation into a table collection, buffering new
+// edges and simplifying every simplify_interval generations; see
+// rtsk_recorder_init()
+struct rtsk_recorder {
+  tsk_table_collection_t tables;
+  std::vector<rtsk_recorder_edge> edges;
+  int simplify_interval;
+  int generation;
+};
+
+// Finaliser that frees rtsk_recorder when it is garbage collected
+// See
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_free}
+// for more details.
+static void rtsk_recorder_free(rtsk_recorder *ptr) {
+  if (ptr != NULL) {
+    tsk_table_collection_free(&ptr->tables);
+    delete ptr;
+  }
+}
+
+// Define the external pointer type for rtsk_recorder with its finaliser
+using rtsk_recorder_t =
+    Rcpp::XPtr<rtsk_recorder, Rcpp::PreserveStorage, rtsk_recorder_free, true>;
+
 // Package implementation files define RCPPTSKIT_IMPL to avoid pulling
 // PUBLIC declarations with default args into the same translation unit
 #ifndef RCPPTSKIT_IMPL
@@ -16,8 +16,10 @@ SEXP rtsk_table_collection_load(const std::string &filename, int options = 0);
 void rtsk_treeseq_dump(SEXP ts, const std::string &filename, int options = 0);
 void rtsk_table_collection_dump(SEXP tc, const std::string &filename,
                                 int options = 0);
-SEXP rtsk_treeseq_copy_tables(SEXP ts, int options = 0);
-SEXP rtsk_treeseq_init(SEXP tc, int options = 0);
+SEXP rtsk_treeseq_copy_tables(SEXP ts, int options = 0, bool lazy = false);
+SEXP rtsk_treeseq_init(SEXP tc, int options = 0, bool topology_only = false,
+                       bool consume = false);
+bool rtsk_treeseq_is_topology_only(SEXP ts);
 
 SEXP rtsk_treeseq_get_num_provenances(SEXP ts);
 SEXP rtsk_treeseq_get_num_populations(SEXP ts);
@@ -39,6 +41,97 @@ double rtsk_treeseq_get_max_time(SEXP ts);
 Rcpp::String rtsk_treeseq_get_file_uuid(SEXP ts);
 Rcpp::List rtsk_treeseq_summary(SEXP ts);
 Rcpp::List rtsk_treeseq_metadata_length(SEXP ts);
+void rtsk_treeseq_write_newick(SEXP ts, const std::string &filename,
+                               int precision = 14, bool interval = true,
+                               bool compress = false, int options = 0);
+SEXP rtsk_treeseq_genotype_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> sites = R_NilValue,
+    Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    const std::string &format = "int8", int threads = 1,
+    const std::string &filename = "", int options = 0);
+SEXP rtsk_variant_iterator_init(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    int options = 0);
+SEXP rtsk_variant_iterator_next_block(SEXP it, int block_size = 1000);
+void rtsk_variant_iterator_reset(SEXP it);
+void rtsk_treeseq_write_plink(
+    SEXP ts, const std::string &prefix,
+    Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    int ploidy = 2, const std::string &contig = "1", int threads = 1,
+    int options = 0);
+SEXP rtsk_treeseq_dosage_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    Rcpp::Nullable<Rcpp::IntegerVector> sites = R_NilValue,
+    const std::string &type = "double", bool centre = false,
+    bool scale = false, int threads = 1, int options = 0);
+void rtsk_treeseq_write_vcf(
+    SEXP ts, const std::string &filename,
+    Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    const std::string &contig = "1",
+    const std::string &position_transform = "round",
+    bool allow_position_zero = false, bool compress = true, int threads = 1,
+    int options = 0);
+SEXP rtsk_treeseq_alignments(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    double left = 0, double right = NA_REAL,
+    const std::string &missing_char = "N", const std::string &filename = "",
+    int wrap_width = 60, int threads = 1, int options = 0);
+Rcpp::List
+rtsk_treeseq_ls_forward(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                        const Rcpp::NumericVector &recombination_rate,
+                        const Rcpp::NumericVector &mutation_rate,
+                        int threads = 1, int options = 0);
+Rcpp::List
+rtsk_treeseq_ls_viterbi(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                        const Rcpp::NumericVector &recombination_rate,
+                        const Rcpp::NumericVector &mutation_rate,
+                        int threads = 1, int options = 0);
+Rcpp::List rtsk_treeseq_ls_forward_backward(
+    SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+    const Rcpp::NumericVector &recombination_rate,
+    const Rcpp::NumericVector &mutation_rate, int threads = 1,
+    int options = 0);
+Rcpp::List rtsk_treeseq_ls_posterior(
+    SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+    const Rcpp::NumericVector &recombination_rate,
+    const Rcpp::NumericVector &mutation_rate, int threads = 1,
+    int options = 0);
+Rcpp::NumericMatrix
+rtsk_treeseq_ls_decode(SEXP ts, const Rcpp::IntegerVector &num_transitions,
+                       const Rcpp::IntegerVector &node,
+                       const Rcpp::NumericVector &value);
+Rcpp::List rtsk_treeseq_impute(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                               const Rcpp::IntegerVector &sites,
+                               const Rcpp::NumericVector &map_position,
+                               const Rcpp::NumericVector &map_cm, double ne,
+                               const Rcpp::NumericVector &mutation_rate,
+                               const std::string &filename = "",
+                               const std::string &contig = "1",
+                               bool compress = false, int threads = 1,
+                               int options = 0);
+Rcpp::List rtsk_treeseq_ibd_segments(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> within = R_NilValue,
+    Rcpp::Nullable<Rcpp::List> between = R_NilValue, double min_span = 0,
+    double max_time = NA_REAL, bool pairs = false,
+    const std::string &filename = "",
+    Rcpp::Nullable<Rcpp::Function> callback = R_NilValue,
+    int block_size = 10000);
+SEXP rtsk_treeseq_ibd_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    double min_span = 0, double max_time = NA_REAL, bool sparse = false,
+    int threads = 1);
+Rcpp::NumericMatrix rtsk_treeseq_genealogical_nearest_neighbours(
+    SEXP ts, const Rcpp::IntegerVector &focal,
+    const Rcpp::List &reference_sets, int threads = 1);
+Rcpp::NumericMatrix rtsk_treeseq_mean_descendants(
+    SEXP ts, const Rcpp::List &reference_sets);
+double rtsk_treeseq_kc_distance(SEXP ts, SEXP other, double lambda = 0,
+                                int threads = 1);
+SEXP rtsk_treeseq_split_edges(
+    SEXP ts, double time, int flags = 0, int population = -1,
+    Rcpp::Nullable<Rcpp::RawVector> metadata = R_NilValue, int options = 0);
+SEXP rtsk_treeseq_extend_haplotypes(SEXP ts, int max_iter = 10,
+                                    int options = 0);
 
 SEXP rtsk_table_collection_get_num_provenances(SEXP tc);
 SEXP rtsk_table_collection_get_num_populations(SEXP tc);
@@ -53,8 +146,23 @@ bool rtsk_table_collection_has_reference_sequence(SEXP tc);
 Rcpp::String rtsk_table_collection_get_time_units(SEXP tc);
 Rcpp::String rtsk_table_collection_get_file_uuid(SEXP tc);
 bool rtsk_table_collection_has_index(SEXP tc, int options = 0);
-void rtsk_table_collection_build_index(SEXP tc, int options = 0);
+void rtsk_table_collection_build_index(SEXP tc, int options = 0,
+                                       int threads = 1,
+                                       bool incremental = false);
+int rtsk_table_collection_check_integrity(SEXP tc, int options = 0,
+                                          int threads = 1);
 void rtsk_table_collection_drop_index(SEXP tc, int options = 0);
+void rtsk_table_collection_canonicalise(SEXP tc, int options = 0,
+                                        int threads = 1);
+void rtsk_table_collection_deduplicate_sites(SEXP tc, int options = 0);
+void rtsk_table_collection_compute_mutation_parents(SEXP tc, int options = 0);
+void rtsk_table_collection_compute_mutation_times(SEXP tc, int options = 0);
+void rtsk_table_collection_subset(SEXP tc, const Rcpp::IntegerVector &nodes,
+                                  int options = 0);
+void rtsk_table_collection_union(SEXP tc, SEXP other,
+                                 const Rcpp::IntegerVector &other_node_mapping,
+                                 int options = 0);
+void rtsk_table_collection_delete_older(SEXP tc, double time, int options = 0);
 Rcpp::List rtsk_table_collection_summary(SEXP tc);
 Rcpp::List rtsk_table_collection_metadata_length(SEXP tc);
 int rtsk_individual_table_add_row(
@@ -76,4 +184,22 @@ int rtsk_mutation_table_add_row(
     const std::string &derived_state,
     Rcpp::Nullable<Rcpp::RawVector> metadata = R_NilValue);
 
+SEXP rtsk_recorder_init(SEXP tc = R_NilValue, double sequence_length = 0,
+                        int simplify_interval = 0);
+Rcpp::IntegerVector
+rtsk_recorder_add_nodes(SEXP rec, const Rcpp::NumericVector &time,
+                        const Rcpp::IntegerVector &flags,
+                        const Rcpp::IntegerVector &population,
+                        const Rcpp::IntegerVector &individual);
+void rtsk_recorder_add_edges(SEXP rec, const Rcpp::NumericVector &left,
+                             const Rcpp::NumericVector &right,
+                             const Rcpp::IntegerVector &parent,
+                             const Rcpp::IntegerVector &child);
+Rcpp::IntegerVector
+rtsk_recorder_end_generation(SEXP rec, const Rcpp::IntegerVector &alive);
+Rcpp::IntegerVector rtsk_recorder_simplify(SEXP rec,
+                                           const Rcpp::IntegerVector &samples);
+SEXP rtsk_recorder_dump_tables(SEXP rec);
+Rcpp::List rtsk_recorder_summary(SEXP rec);
+
 #endif
@@ -22,6 +22,20 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// test_integrity_check
+int test_integrity_check(SEXP tc, int options, int threads, int chunk_size);
+RcppExport SEXP _RcppTskit_test_integrity_check(SEXP tcSEXP, SEXP optionsSEXP, SEXP threadsSEXP, SEXP chunk_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type chunk_size(chunk_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_integrity_check(tc, options, threads, chunk_size));
+    return rcpp_result_gen;
+END_RCPP
+}
 // test_rtsk_wrap_tsk_size_t_as_integer64
 SEXP test_rtsk_wrap_tsk_size_t_as_integer64(const std::string& value, bool force_range_error);
 RcppExport SEXP _RcppTskit_test_rtsk_wrap_tsk_size_t_as_integer64(SEXP valueSEXP, SEXP force_range_errorSEXP) {
@@ -103,26 +117,40 @@ BEGIN_RCPP
 END_RCPP
 }
 // rtsk_treeseq_copy_tables
-SEXP rtsk_treeseq_copy_tables(SEXP ts, int options);
-RcppExport SEXP _RcppTskit_rtsk_treeseq_copy_tables(SEXP tsSEXP, SEXP optionsSEXP) {
+SEXP rtsk_treeseq_copy_tables(SEXP ts, int options, bool lazy);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_copy_tables(SEXP tsSEXP, SEXP optionsSEXP, SEXP lazySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
     Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
-    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_copy_tables(ts, options));
+    Rcpp::traits::input_parameter< bool >::type lazy(lazySEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_copy_tables(ts, options, lazy));
     return rcpp_result_gen;
 END_RCPP
 }
 // rtsk_treeseq_init
-SEXP rtsk_treeseq_init(SEXP tc, int options);
-RcppExport SEXP _RcppTskit_rtsk_treeseq_init(SEXP tcSEXP, SEXP optionsSEXP) {
+SEXP rtsk_treeseq_init(SEXP tc, int options, bool topology_only, bool consume);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_init(SEXP tcSEXP, SEXP optionsSEXP, SEXP topology_onlySEXP, SEXP consumeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
     Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
-    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_init(tc, options));
+    Rcpp::traits::input_parameter< bool >::type topology_only(topology_onlySEXP);
+    Rcpp::traits::input_parameter< bool >::type consume(consumeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_init(tc, options, topology_only, consume));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_is_topology_only
+bool rtsk_treeseq_is_topology_only(SEXP ts);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_is_topology_only(SEXP tsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_is_topology_only(ts));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -346,6 +374,348 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// rtsk_treeseq_write_newick
+void rtsk_treeseq_write_newick(SEXP ts, const std::string& filename, int precision, bool interval, bool compress, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_write_newick(SEXP tsSEXP, SEXP filenameSEXP, SEXP precisionSEXP, SEXP intervalSEXP, SEXP compressSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< bool >::type interval(intervalSEXP);
+    Rcpp::traits::input_parameter< bool >::type compress(compressSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_treeseq_write_newick(ts, filename, precision, interval, compress, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_treeseq_genotype_matrix
+SEXP rtsk_treeseq_genotype_matrix(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> sites, Rcpp::Nullable<Rcpp::IntegerVector> samples, const std::string& format, int threads, const std::string& filename, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_genotype_matrix(SEXP tsSEXP, SEXP sitesSEXP, SEXP samplesSEXP, SEXP formatSEXP, SEXP threadsSEXP, SEXP filenameSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type sites(sitesSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type format(formatSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_genotype_matrix(ts, sites, samples, format, threads, filename, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_variant_iterator_init
+SEXP rtsk_variant_iterator_init(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples, int options);
+RcppExport SEXP _RcppTskit_rtsk_variant_iterator_init(SEXP tsSEXP, SEXP samplesSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_variant_iterator_init(ts, samples, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_variant_iterator_next_block
+SEXP rtsk_variant_iterator_next_block(SEXP it, int block_size);
+RcppExport SEXP _RcppTskit_rtsk_variant_iterator_next_block(SEXP itSEXP, SEXP block_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type it(itSEXP);
+    Rcpp::traits::input_parameter< int >::type block_size(block_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_variant_iterator_next_block(it, block_size));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_variant_iterator_reset
+void rtsk_variant_iterator_reset(SEXP it);
+RcppExport SEXP _RcppTskit_rtsk_variant_iterator_reset(SEXP itSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type it(itSEXP);
+    rtsk_variant_iterator_reset(it);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_treeseq_write_plink
+void rtsk_treeseq_write_plink(SEXP ts, const std::string& prefix, Rcpp::Nullable<Rcpp::IntegerVector> individuals, int ploidy, const std::string& contig, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_write_plink(SEXP tsSEXP, SEXP prefixSEXP, SEXP individualsSEXP, SEXP ploidySEXP, SEXP contigSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type prefix(prefixSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type individuals(individualsSEXP);
+    Rcpp::traits::input_parameter< int >::type ploidy(ploidySEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type contig(contigSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_treeseq_write_plink(ts, prefix, individuals, ploidy, contig, threads, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_treeseq_dosage_matrix
+SEXP rtsk_treeseq_dosage_matrix(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> individuals, Rcpp::Nullable<Rcpp::IntegerVector> sites, const std::string& type, bool centre, bool scale, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_dosage_matrix(SEXP tsSEXP, SEXP individualsSEXP, SEXP sitesSEXP, SEXP typeSEXP, SEXP centreSEXP, SEXP scaleSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type individuals(individualsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type sites(sitesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type type(typeSEXP);
+    Rcpp::traits::input_parameter< bool >::type centre(centreSEXP);
+    Rcpp::traits::input_parameter< bool >::type scale(scaleSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_dosage_matrix(ts, individuals, sites, type, centre, scale, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_write_vcf
+void rtsk_treeseq_write_vcf(SEXP ts, const std::string& filename, Rcpp::Nullable<Rcpp::IntegerVector> individuals, const std::string& contig, const std::string& position_transform, bool allow_position_zero, bool compress, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_write_vcf(SEXP tsSEXP, SEXP filenameSEXP, SEXP individualsSEXP, SEXP contigSEXP, SEXP position_transformSEXP, SEXP allow_position_zeroSEXP, SEXP compressSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type individuals(individualsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type contig(contigSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type position_transform(position_transformSEXP);
+    Rcpp::traits::input_parameter< bool >::type allow_position_zero(allow_position_zeroSEXP);
+    Rcpp::traits::input_parameter< bool >::type compress(compressSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_treeseq_write_vcf(ts, filename, individuals, contig, position_transform, allow_position_zero, compress, threads, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_treeseq_alignments
+SEXP rtsk_treeseq_alignments(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples, double left, double right, const std::string& missing_char, const std::string& filename, int wrap_width, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_alignments(SEXP tsSEXP, SEXP samplesSEXP, SEXP leftSEXP, SEXP rightSEXP, SEXP missing_charSEXP, SEXP filenameSEXP, SEXP wrap_widthSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< double >::type left(leftSEXP);
+    Rcpp::traits::input_parameter< double >::type right(rightSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type missing_char(missing_charSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< int >::type wrap_width(wrap_widthSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_alignments(ts, samples, left, right, missing_char, filename, wrap_width, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ls_forward
+Rcpp::List rtsk_treeseq_ls_forward(SEXP ts, const Rcpp::IntegerMatrix& haplotypes, const Rcpp::NumericVector& recombination_rate, const Rcpp::NumericVector& mutation_rate, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ls_forward(SEXP tsSEXP, SEXP haplotypesSEXP, SEXP recombination_rateSEXP, SEXP mutation_rateSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type haplotypes(haplotypesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type recombination_rate(recombination_rateSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ls_forward(ts, haplotypes, recombination_rate, mutation_rate, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ls_viterbi
+Rcpp::List rtsk_treeseq_ls_viterbi(SEXP ts, const Rcpp::IntegerMatrix& haplotypes, const Rcpp::NumericVector& recombination_rate, const Rcpp::NumericVector& mutation_rate, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ls_viterbi(SEXP tsSEXP, SEXP haplotypesSEXP, SEXP recombination_rateSEXP, SEXP mutation_rateSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type haplotypes(haplotypesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type recombination_rate(recombination_rateSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ls_viterbi(ts, haplotypes, recombination_rate, mutation_rate, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ls_forward_backward
+Rcpp::List rtsk_treeseq_ls_forward_backward(SEXP ts, const Rcpp::IntegerMatrix& haplotypes, const Rcpp::NumericVector& recombination_rate, const Rcpp::NumericVector& mutation_rate, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ls_forward_backward(SEXP tsSEXP, SEXP haplotypesSEXP, SEXP recombination_rateSEXP, SEXP mutation_rateSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type haplotypes(haplotypesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type recombination_rate(recombination_rateSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ls_forward_backward(ts, haplotypes, recombination_rate, mutation_rate, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ls_posterior
+Rcpp::List rtsk_treeseq_ls_posterior(SEXP ts, const Rcpp::IntegerMatrix& haplotypes, const Rcpp::NumericVector& recombination_rate, const Rcpp::NumericVector& mutation_rate, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ls_posterior(SEXP tsSEXP, SEXP haplotypesSEXP, SEXP recombination_rateSEXP, SEXP mutation_rateSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type haplotypes(haplotypesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type recombination_rate(recombination_rateSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ls_posterior(ts, haplotypes, recombination_rate, mutation_rate, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ls_decode
+Rcpp::NumericMatrix rtsk_treeseq_ls_decode(SEXP ts, const Rcpp::IntegerVector& num_transitions, const Rcpp::IntegerVector& node, const Rcpp::NumericVector& value);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ls_decode(SEXP tsSEXP, SEXP num_transitionsSEXP, SEXP nodeSEXP, SEXP valueSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type num_transitions(num_transitionsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type value(valueSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ls_decode(ts, num_transitions, node, value));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_impute
+Rcpp::List rtsk_treeseq_impute(SEXP ts, const Rcpp::IntegerMatrix& haplotypes, const Rcpp::IntegerVector& sites, const Rcpp::NumericVector& map_position, const Rcpp::NumericVector& map_cm, double ne, const Rcpp::NumericVector& mutation_rate, const std::string& filename, const std::string& contig, bool compress, int threads, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_impute(SEXP tsSEXP, SEXP haplotypesSEXP, SEXP sitesSEXP, SEXP map_positionSEXP, SEXP map_cmSEXP, SEXP neSEXP, SEXP mutation_rateSEXP, SEXP filenameSEXP, SEXP contigSEXP, SEXP compressSEXP, SEXP threadsSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerMatrix& >::type haplotypes(haplotypesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type sites(sitesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type map_position(map_positionSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type map_cm(map_cmSEXP);
+    Rcpp::traits::input_parameter< double >::type ne(neSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type contig(contigSEXP);
+    Rcpp::traits::input_parameter< bool >::type compress(compressSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_impute(ts, haplotypes, sites, map_position, map_cm, ne, mutation_rate, filename, contig, compress, threads, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ibd_segments
+Rcpp::List rtsk_treeseq_ibd_segments(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> within, Rcpp::Nullable<Rcpp::List> between, double min_span, double max_time, bool pairs, const std::string& filename, Rcpp::Nullable<Rcpp::Function> callback, int block_size);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ibd_segments(SEXP tsSEXP, SEXP withinSEXP, SEXP betweenSEXP, SEXP min_spanSEXP, SEXP max_timeSEXP, SEXP pairsSEXP, SEXP filenameSEXP, SEXP callbackSEXP, SEXP block_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type within(withinSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::List> >::type between(betweenSEXP);
+    Rcpp::traits::input_parameter< double >::type min_span(min_spanSEXP);
+    Rcpp::traits::input_parameter< double >::type max_time(max_timeSEXP);
+    Rcpp::traits::input_parameter< bool >::type pairs(pairsSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::Function> >::type callback(callbackSEXP);
+    Rcpp::traits::input_parameter< int >::type block_size(block_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ibd_segments(ts, within, between, min_span, max_time, pairs, filename, callback, block_size));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_ibd_matrix
+SEXP rtsk_treeseq_ibd_matrix(SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples, double min_span, double max_time, bool sparse, int threads);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_ibd_matrix(SEXP tsSEXP, SEXP samplesSEXP, SEXP min_spanSEXP, SEXP max_timeSEXP, SEXP sparseSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::IntegerVector> >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< double >::type min_span(min_spanSEXP);
+    Rcpp::traits::input_parameter< double >::type max_time(max_timeSEXP);
+    Rcpp::traits::input_parameter< bool >::type sparse(sparseSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_ibd_matrix(ts, samples, min_span, max_time, sparse, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_genealogical_nearest_neighbours
+Rcpp::NumericMatrix rtsk_treeseq_genealogical_nearest_neighbours(SEXP ts, const Rcpp::IntegerVector& focal, const Rcpp::List& reference_sets, int threads);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_genealogical_nearest_neighbours(SEXP tsSEXP, SEXP focalSEXP, SEXP reference_setsSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type focal(focalSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type reference_sets(reference_setsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_genealogical_nearest_neighbours(ts, focal, reference_sets, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_mean_descendants
+Rcpp::NumericMatrix rtsk_treeseq_mean_descendants(SEXP ts, const Rcpp::List& reference_sets);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_mean_descendants(SEXP tsSEXP, SEXP reference_setsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type reference_sets(reference_setsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_mean_descendants(ts, reference_sets));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_kc_distance
+double rtsk_treeseq_kc_distance(SEXP ts, SEXP other, double lambda, int threads);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_kc_distance(SEXP tsSEXP, SEXP otherSEXP, SEXP lambdaSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type other(otherSEXP);
+    Rcpp::traits::input_parameter< double >::type lambda(lambdaSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_kc_distance(ts, other, lambda, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_split_edges
+SEXP rtsk_treeseq_split_edges(SEXP ts, double time, int flags, int population, Rcpp::Nullable<Rcpp::RawVector> metadata, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_split_edges(SEXP tsSEXP, SEXP timeSEXP, SEXP flagsSEXP, SEXP populationSEXP, SEXP metadataSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< double >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< int >::type flags(flagsSEXP);
+    Rcpp::traits::input_parameter< int >::type population(populationSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::RawVector> >::type metadata(metadataSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_split_edges(ts, time, flags, population, metadata, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_treeseq_extend_haplotypes
+SEXP rtsk_treeseq_extend_haplotypes(SEXP ts, int max_iter, int options);
+RcppExport SEXP _RcppTskit_rtsk_treeseq_extend_haplotypes(SEXP tsSEXP, SEXP max_iterSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iter(max_iterSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_treeseq_extend_haplotypes(ts, max_iter, options));
+    return rcpp_result_gen;
+END_RCPP
+}
 // rtsk_table_collection_get_num_provenances
 SEXP rtsk_table_collection_get_num_provenances(SEXP tc);
 RcppExport SEXP _RcppTskit_rtsk_table_collection_get_num_provenances(SEXP tcSEXP) {
@@ -491,16 +861,31 @@ BEGIN_RCPP
 END_RCPP
 }
 // rtsk_table_collection_build_index
-void rtsk_table_collection_build_index(SEXP tc, int options);
-RcppExport SEXP _RcppTskit_rtsk_table_collection_build_index(SEXP tcSEXP, SEXP optionsSEXP) {
+void rtsk_table_collection_build_index(SEXP tc, int options, int threads, bool incremental);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_build_index(SEXP tcSEXP, SEXP optionsSEXP, SEXP threadsSEXP, SEXP incrementalSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
     Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
-    rtsk_table_collection_build_index(tc, options);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    rtsk_table_collection_build_index(tc, options, threads, incremental);
     return R_NilValue;
 END_RCPP
 }
+// rtsk_table_collection_check_integrity
+int rtsk_table_collection_check_integrity(SEXP tc, int options, int threads);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_check_integrity(SEXP tcSEXP, SEXP optionsSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_table_collection_check_integrity(tc, options, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // rtsk_table_collection_drop_index
 void rtsk_table_collection_drop_index(SEXP tc, int options);
 RcppExport SEXP _RcppTskit_rtsk_table_collection_drop_index(SEXP tcSEXP, SEXP optionsSEXP) {
@@ -512,6 +897,88 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// rtsk_table_collection_canonicalise
+void rtsk_table_collection_canonicalise(SEXP tc, int options, int threads);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_canonicalise(SEXP tcSEXP, SEXP optionsSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rtsk_table_collection_canonicalise(tc, options, threads);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_deduplicate_sites
+void rtsk_table_collection_deduplicate_sites(SEXP tc, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_deduplicate_sites(SEXP tcSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_deduplicate_sites(tc, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_compute_mutation_parents
+void rtsk_table_collection_compute_mutation_parents(SEXP tc, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_compute_mutation_parents(SEXP tcSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_compute_mutation_parents(tc, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_compute_mutation_times
+void rtsk_table_collection_compute_mutation_times(SEXP tc, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_compute_mutation_times(SEXP tcSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_compute_mutation_times(tc, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_subset
+void rtsk_table_collection_subset(SEXP tc, const Rcpp::IntegerVector& nodes, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_subset(SEXP tcSEXP, SEXP nodesSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type nodes(nodesSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_subset(tc, nodes, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_union
+void rtsk_table_collection_union(SEXP tc, SEXP other, const Rcpp::IntegerVector& other_node_mapping, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_union(SEXP tcSEXP, SEXP otherSEXP, SEXP other_node_mappingSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type other(otherSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type other_node_mapping(other_node_mappingSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_union(tc, other, other_node_mapping, options);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_table_collection_delete_older
+void rtsk_table_collection_delete_older(SEXP tc, double time, int options);
+RcppExport SEXP _RcppTskit_rtsk_table_collection_delete_older(SEXP tcSEXP, SEXP timeSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< double >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rtsk_table_collection_delete_older(tc, time, options);
+    return R_NilValue;
+END_RCPP
+}
 // rtsk_table_collection_summary
 Rcpp::List rtsk_table_collection_summary(SEXP tc);
 RcppExport SEXP _RcppTskit_rtsk_table_collection_summary(SEXP tcSEXP) {
@@ -612,6 +1079,94 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// rtsk_recorder_init
+SEXP rtsk_recorder_init(SEXP tc, double sequence_length, int simplify_interval);
+RcppExport SEXP _RcppTskit_rtsk_recorder_init(SEXP tcSEXP, SEXP sequence_lengthSEXP, SEXP simplify_intervalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< double >::type sequence_length(sequence_lengthSEXP);
+    Rcpp::traits::input_parameter< int >::type simplify_interval(simplify_intervalSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_init(tc, sequence_length, simplify_interval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_recorder_add_nodes
+Rcpp::IntegerVector rtsk_recorder_add_nodes(SEXP rec, const Rcpp::NumericVector& time, const Rcpp::IntegerVector& flags, const Rcpp::IntegerVector& population, const Rcpp::IntegerVector& individual);
+RcppExport SEXP _RcppTskit_rtsk_recorder_add_nodes(SEXP recSEXP, SEXP timeSEXP, SEXP flagsSEXP, SEXP populationSEXP, SEXP individualSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type flags(flagsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type population(populationSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type individual(individualSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_add_nodes(rec, time, flags, population, individual));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_recorder_add_edges
+void rtsk_recorder_add_edges(SEXP rec, const Rcpp::NumericVector& left, const Rcpp::NumericVector& right, const Rcpp::IntegerVector& parent, const Rcpp::IntegerVector& child);
+RcppExport SEXP _RcppTskit_rtsk_recorder_add_edges(SEXP recSEXP, SEXP leftSEXP, SEXP rightSEXP, SEXP parentSEXP, SEXP childSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type left(leftSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type right(rightSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type parent(parentSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type child(childSEXP);
+    rtsk_recorder_add_edges(rec, left, right, parent, child);
+    return R_NilValue;
+END_RCPP
+}
+// rtsk_recorder_end_generation
+Rcpp::IntegerVector rtsk_recorder_end_generation(SEXP rec, const Rcpp::IntegerVector& alive);
+RcppExport SEXP _RcppTskit_rtsk_recorder_end_generation(SEXP recSEXP, SEXP aliveSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type alive(aliveSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_end_generation(rec, alive));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_recorder_simplify
+Rcpp::IntegerVector rtsk_recorder_simplify(SEXP rec, const Rcpp::IntegerVector& samples);
+RcppExport SEXP _RcppTskit_rtsk_recorder_simplify(SEXP recSEXP, SEXP samplesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type samples(samplesSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_simplify(rec, samples));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_recorder_dump_tables
+SEXP rtsk_recorder_dump_tables(SEXP rec);
+RcppExport SEXP _RcppTskit_rtsk_recorder_dump_tables(SEXP recSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_dump_tables(rec));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rtsk_recorder_summary
+Rcpp::List rtsk_recorder_summary(SEXP rec);
+RcppExport SEXP _RcppTskit_rtsk_recorder_summary(SEXP recSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    rcpp_result_gen = Rcpp::wrap(rtsk_recorder_summary(rec));
+    return rcpp_result_gen;
+END_RCPP
+}
 // test_tsk_bug_assert_c
 void test_tsk_bug_assert_c();
 RcppExport SEXP _RcppTskit_test_tsk_bug_assert_c() {
@@ -659,13 +1214,14 @@ BEGIN_RCPP
 END_RCPP
 }
 // test_rtsk_treeseq_copy_tables_forced_error
-SEXP test_rtsk_treeseq_copy_tables_forced_error(SEXP ts);
-RcppExport SEXP _RcppTskit_test_rtsk_treeseq_copy_tables_forced_error(SEXP tsSEXP) {
+SEXP test_rtsk_treeseq_copy_tables_forced_error(SEXP ts, bool lazy);
+RcppExport SEXP _RcppTskit_test_rtsk_treeseq_copy_tables_forced_error(SEXP tsSEXP, SEXP lazySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
-    rcpp_result_gen = Rcpp::wrap(test_rtsk_treeseq_copy_tables_forced_error(ts));
+    Rcpp::traits::input_parameter< bool >::type lazy(lazySEXP);
+    rcpp_result_gen = Rcpp::wrap(test_rtsk_treeseq_copy_tables_forced_error(ts, lazy));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -740,9 +1296,130 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// test_tsk_table_collection_equals
+bool test_tsk_table_collection_equals(SEXP tc, SEXP other, int options);
+RcppExport SEXP _RcppTskit_test_tsk_table_collection_equals(SEXP tcSEXP, SEXP otherSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type other(otherSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_tsk_table_collection_equals(tc, other, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// test_tsk_table_collection_canonicalise
+void test_tsk_table_collection_canonicalise(SEXP tc, int options);
+RcppExport SEXP _RcppTskit_test_tsk_table_collection_canonicalise(SEXP tcSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    test_tsk_table_collection_canonicalise(tc, options);
+    return R_NilValue;
+END_RCPP
+}
+// test_tsk_table_collection_union
+void test_tsk_table_collection_union(SEXP tc, SEXP other, const Rcpp::IntegerVector& other_node_mapping, int options);
+RcppExport SEXP _RcppTskit_test_tsk_table_collection_union(SEXP tcSEXP, SEXP otherSEXP, SEXP other_node_mappingSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type other(otherSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type other_node_mapping(other_node_mappingSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    test_tsk_table_collection_union(tc, other, other_node_mapping, options);
+    return R_NilValue;
+END_RCPP
+}
+// test_migration_table_add_row
+void test_migration_table_add_row(SEXP tc, double left, double right, int node, int source, int dest, double time);
+RcppExport SEXP _RcppTskit_test_migration_table_add_row(SEXP tcSEXP, SEXP leftSEXP, SEXP rightSEXP, SEXP nodeSEXP, SEXP sourceSEXP, SEXP destSEXP, SEXP timeSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< double >::type left(leftSEXP);
+    Rcpp::traits::input_parameter< double >::type right(rightSEXP);
+    Rcpp::traits::input_parameter< int >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< int >::type source(sourceSEXP);
+    Rcpp::traits::input_parameter< int >::type dest(destSEXP);
+    Rcpp::traits::input_parameter< double >::type time(timeSEXP);
+    test_migration_table_add_row(tc, left, right, node, source, dest, time);
+    return R_NilValue;
+END_RCPP
+}
+// test_tsk_table_collection_ibd
+Rcpp::List test_tsk_table_collection_ibd(SEXP ts, const Rcpp::IntegerVector& samples, const Rcpp::IntegerVector& sample_set_sizes, double min_span, double max_time);
+RcppExport SEXP _RcppTskit_test_tsk_table_collection_ibd(SEXP tsSEXP, SEXP samplesSEXP, SEXP sample_set_sizesSEXP, SEXP min_spanSEXP, SEXP max_timeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type sample_set_sizes(sample_set_sizesSEXP);
+    Rcpp::traits::input_parameter< double >::type min_span(min_spanSEXP);
+    Rcpp::traits::input_parameter< double >::type max_time(max_timeSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_tsk_table_collection_ibd(ts, samples, sample_set_sizes, min_span, max_time));
+    return rcpp_result_gen;
+END_RCPP
+}
+// test_tsk_treeseq_kc_distance
+double test_tsk_treeseq_kc_distance(SEXP ts, SEXP other, double lambda);
+RcppExport SEXP _RcppTskit_test_tsk_treeseq_kc_distance(SEXP tsSEXP, SEXP otherSEXP, SEXP lambdaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type other(otherSEXP);
+    Rcpp::traits::input_parameter< double >::type lambda(lambdaSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_tsk_treeseq_kc_distance(ts, other, lambda));
+    return rcpp_result_gen;
+END_RCPP
+}
+// test_tsk_table_collection_check_integrity
+int test_tsk_table_collection_check_integrity(SEXP tc, int options);
+RcppExport SEXP _RcppTskit_test_tsk_table_collection_check_integrity(SEXP tcSEXP, SEXP optionsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type options(optionsSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_tsk_table_collection_check_integrity(tc, options));
+    return rcpp_result_gen;
+END_RCPP
+}
+// test_tsk_treeseq_extend_haplotypes
+SEXP test_tsk_treeseq_extend_haplotypes(SEXP ts, int max_iter);
+RcppExport SEXP _RcppTskit_test_tsk_treeseq_extend_haplotypes(SEXP tsSEXP, SEXP max_iterSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type ts(tsSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iter(max_iterSEXP);
+    rcpp_result_gen = Rcpp::wrap(test_tsk_treeseq_extend_haplotypes(ts, max_iter));
+    return rcpp_result_gen;
+END_RCPP
+}
+// test_edge_table_update_row
+void test_edge_table_update_row(SEXP tc, int row, double left, double right, int parent, int child);
+RcppExport SEXP _RcppTskit_test_edge_table_update_row(SEXP tcSEXP, SEXP rowSEXP, SEXP leftSEXP, SEXP rightSEXP, SEXP parentSEXP, SEXP childSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tc(tcSEXP);
+    Rcpp::traits::input_parameter< int >::type row(rowSEXP);
+    Rcpp::traits::input_parameter< double >::type left(leftSEXP);
+    Rcpp::traits::input_parameter< double >::type right(rightSEXP);
+    Rcpp::traits::input_parameter< int >::type parent(parentSEXP);
+    Rcpp::traits::input_parameter< int >::type child(childSEXP);
+    test_edge_table_update_row(tc, row, left, right, parent, child);
+    return R_NilValue;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_test_validate_options", (DL_FUNC) &_RcppTskit_test_validate_options, 2},
+    {"_RcppTskit_test_integrity_check", (DL_FUNC) &_RcppTskit_test_integrity_check, 4},
     {"_RcppTskit_test_rtsk_wrap_tsk_size_t_as_integer64", (DL_FUNC) &_RcppTskit_test_rtsk_wrap_tsk_size_t_as_integer64, 2},
     {"_RcppTskit_kastore_version", (DL_FUNC) &_RcppTskit_kastore_version, 0},
     {"_RcppTskit_tskit_version", (DL_FUNC) &_RcppTskit_tskit_version, 0},
@@ -750,8 +1427,9 @@ static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_rtsk_table_collection_load", (DL_FUNC) &_RcppTskit_rtsk_table_collection_load, 2},
     {"_RcppTskit_rtsk_treeseq_dump", (DL_FUNC) &_RcppTskit_rtsk_treeseq_dump, 3},
     {"_RcppTskit_rtsk_table_collection_dump", (DL_FUNC) &_RcppTskit_rtsk_table_collection_dump, 3},
-    {"_RcppTskit_rtsk_treeseq_copy_tables", (DL_FUNC) &_RcppTskit_rtsk_treeseq_copy_tables, 2},
-    {"_RcppTskit_rtsk_treeseq_init", (DL_FUNC) &_RcppTskit_rtsk_treeseq_init, 2},
+    {"_RcppTskit_rtsk_treeseq_copy_tables", (DL_FUNC) &_RcppTskit_rtsk_treeseq_copy_tables, 3},
+    {"_RcppTskit_rtsk_treeseq_init", (DL_FUNC) &_RcppTskit_rtsk_treeseq_init, 4},
+    {"_RcppTskit_rtsk_treeseq_is_topology_only", (DL_FUNC) &_RcppTskit_rtsk_treeseq_is_topology_only, 1},
     {"_RcppTskit_rtsk_treeseq_get_num_provenances", (DL_FUNC) &_RcppTskit_rtsk_treeseq_get_num_provenances, 1},
     {"_RcppTskit_rtsk_treeseq_get_num_populations", (DL_FUNC) &_RcppTskit_rtsk_treeseq_get_num_populations, 1},
     {"_RcppTskit_rtsk_treeseq_get_num_migrations", (DL_FUNC) &_RcppTskit_rtsk_treeseq_get_num_migrations, 1},
@@ -772,6 +1450,28 @@ static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_rtsk_treeseq_get_file_uuid", (DL_FUNC) &_RcppTskit_rtsk_treeseq_get_file_uuid, 1},
     {"_RcppTskit_rtsk_treeseq_summary", (DL_FUNC) &_RcppTskit_rtsk_treeseq_summary, 1},
     {"_RcppTskit_rtsk_treeseq_metadata_length", (DL_FUNC) &_RcppTskit_rtsk_treeseq_metadata_length, 1},
+    {"_RcppTskit_rtsk_treeseq_write_newick", (DL_FUNC) &_RcppTskit_rtsk_treeseq_write_newick, 6},
+    {"_RcppTskit_rtsk_treeseq_genotype_matrix", (DL_FUNC) &_RcppTskit_rtsk_treeseq_genotype_matrix, 7},
+    {"_RcppTskit_rtsk_variant_iterator_init", (DL_FUNC) &_RcppTskit_rtsk_variant_iterator_init, 3},
+    {"_RcppTskit_rtsk_variant_iterator_next_block", (DL_FUNC) &_RcppTskit_rtsk_variant_iterator_next_block, 2},
+    {"_RcppTskit_rtsk_variant_iterator_reset", (DL_FUNC) &_RcppTskit_rtsk_variant_iterator_reset, 1},
+    {"_RcppTskit_rtsk_treeseq_write_plink", (DL_FUNC) &_RcppTskit_rtsk_treeseq_write_plink, 7},
+    {"_RcppTskit_rtsk_treeseq_dosage_matrix", (DL_FUNC) &_RcppTskit_rtsk_treeseq_dosage_matrix, 8},
+    {"_RcppTskit_rtsk_treeseq_write_vcf", (DL_FUNC) &_RcppTskit_rtsk_treeseq_write_vcf, 9},
+    {"_RcppTskit_rtsk_treeseq_alignments", (DL_FUNC) &_RcppTskit_rtsk_treeseq_alignments, 9},
+    {"_RcppTskit_rtsk_treeseq_ls_forward", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ls_forward, 6},
+    {"_RcppTskit_rtsk_treeseq_ls_viterbi", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ls_viterbi, 6},
+    {"_RcppTskit_rtsk_treeseq_ls_forward_backward", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ls_forward_backward, 6},
+    {"_RcppTskit_rtsk_treeseq_ls_posterior", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ls_posterior, 6},
+    {"_RcppTskit_rtsk_treeseq_ls_decode", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ls_decode, 4},
+    {"_RcppTskit_rtsk_treeseq_impute", (DL_FUNC) &_RcppTskit_rtsk_treeseq_impute, 12},
+    {"_RcppTskit_rtsk_treeseq_ibd_segments", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ibd_segments, 9},
+    {"_RcppTskit_rtsk_treeseq_ibd_matrix", (DL_FUNC) &_RcppTskit_rtsk_treeseq_ibd_matrix, 6},
+    {"_RcppTskit_rtsk_treeseq_genealogical_nearest_neighbours", (DL_FUNC) &_RcppTskit_rtsk_treeseq_genealogical_nearest_neighbours, 4},
+    {"_RcppTskit_rtsk_treeseq_mean_descendants", (DL_FUNC) &_RcppTskit_rtsk_treeseq_mean_descendants, 2},
+    {"_RcppTskit_rtsk_treeseq_kc_distance", (DL_FUNC) &_RcppTskit_rtsk_treeseq_kc_distance, 4},
+    {"_RcppTskit_rtsk_treeseq_split_edges", (DL_FUNC) &_RcppTskit_rtsk_treeseq_split_edges, 6},
+    {"_RcppTskit_rtsk_treeseq_extend_haplotypes", (DL_FUNC) &_RcppTskit_rtsk_treeseq_extend_haplotypes, 3},
     {"_RcppTskit_rtsk_table_collection_get_num_provenances", (DL_FUNC) &_RcppTskit_rtsk_table_collection_get_num_provenances, 1},
     {"_RcppTskit_rtsk_table_collection_get_num_populations", (DL_FUNC) &_RcppTskit_rtsk_table_collection_get_num_populations, 1},
     {"_RcppTskit_rtsk_table_collection_get_num_migrations", (DL_FUNC) &_RcppTskit_rtsk_table_collection_get_num_migrations, 1},
@@ -785,8 +1485,16 @@ static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_rtsk_table_collection_get_time_units", (DL_FUNC) &_RcppTskit_rtsk_table_collection_get_time_units, 1},
     {"_RcppTskit_rtsk_table_collection_get_file_uuid", (DL_FUNC) &_RcppTskit_rtsk_table_collection_get_file_uuid, 1},
     {"_RcppTskit_rtsk_table_collection_has_index", (DL_FUNC) &_RcppTskit_rtsk_table_collection_has_index, 2},
-    {"_RcppTskit_rtsk_table_collection_build_index", (DL_FUNC) &_RcppTskit_rtsk_table_collection_build_index, 2},
+    {"_RcppTskit_rtsk_table_collection_build_index", (DL_FUNC) &_RcppTskit_rtsk_table_collection_build_index, 4},
+    {"_RcppTskit_rtsk_table_collection_check_integrity", (DL_FUNC) &_RcppTskit_rtsk_table_collection_check_integrity, 3},
     {"_RcppTskit_rtsk_table_collection_drop_index", (DL_FUNC) &_RcppTskit_rtsk_table_collection_drop_index, 2},
+    {"_RcppTskit_rtsk_table_collection_canonicalise", (DL_FUNC) &_RcppTskit_rtsk_table_collection_canonicalise, 3},
+    {"_RcppTskit_rtsk_table_collection_deduplicate_sites", (DL_FUNC) &_RcppTskit_rtsk_table_collection_deduplicate_sites, 2},
+    {"_RcppTskit_rtsk_table_collection_compute_mutation_parents", (DL_FUNC) &_RcppTskit_rtsk_table_collection_compute_mutation_parents, 2},
+    {"_RcppTskit_rtsk_table_collection_compute_mutation_times", (DL_FUNC) &_RcppTskit_rtsk_table_collection_compute_mutation_times, 2},
+    {"_RcppTskit_rtsk_table_collection_subset", (DL_FUNC) &_RcppTskit_rtsk_table_collection_subset, 3},
+    {"_RcppTskit_rtsk_table_collection_union", (DL_FUNC) &_RcppTskit_rtsk_table_collection_union, 4},
+    {"_RcppTskit_rtsk_table_collection_delete_older", (DL_FUNC) &_RcppTskit_rtsk_table_collection_delete_older, 3},
     {"_RcppTskit_rtsk_table_collection_summary", (DL_FUNC) &_RcppTskit_rtsk_table_collection_summary, 1},
     {"_RcppTskit_rtsk_table_collection_metadata_length", (DL_FUNC) &_RcppTskit_rtsk_table_collection_metadata_length, 1},
     {"_RcppTskit_rtsk_individual_table_add_row", (DL_FUNC) &_RcppTskit_rtsk_individual_table_add_row, 5},
@@ -794,12 +1502,19 @@ static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_rtsk_edge_table_add_row", (DL_FUNC) &_RcppTskit_rtsk_edge_table_add_row, 6},
     {"_RcppTskit_rtsk_site_table_add_row", (DL_FUNC) &_RcppTskit_rtsk_site_table_add_row, 4},
     {"_RcppTskit_rtsk_mutation_table_add_row", (DL_FUNC) &_RcppTskit_rtsk_mutation_table_add_row, 7},
+    {"_RcppTskit_rtsk_recorder_init", (DL_FUNC) &_RcppTskit_rtsk_recorder_init, 3},
+    {"_RcppTskit_rtsk_recorder_add_nodes", (DL_FUNC) &_RcppTskit_rtsk_recorder_add_nodes, 5},
+    {"_RcppTskit_rtsk_recorder_add_edges", (DL_FUNC) &_RcppTskit_rtsk_recorder_add_edges, 5},
+    {"_RcppTskit_rtsk_recorder_end_generation", (DL_FUNC) &_RcppTskit_rtsk_recorder_end_generation, 2},
+    {"_RcppTskit_rtsk_recorder_simplify", (DL_FUNC) &_RcppTskit_rtsk_recorder_simplify, 2},
+    {"_RcppTskit_rtsk_recorder_dump_tables", (DL_FUNC) &_RcppTskit_rtsk_recorder_dump_tables, 1},
+    {"_RcppTskit_rtsk_recorder_summary", (DL_FUNC) &_RcppTskit_rtsk_recorder_summary, 1},
     {"_RcppTskit_test_tsk_bug_assert_c", (DL_FUNC) &_RcppTskit_test_tsk_bug_assert_c, 0},
     {"_RcppTskit_test_tsk_bug_assert_cpp", (DL_FUNC) &_RcppTskit_test_tsk_bug_assert_cpp, 0},
     {"_RcppTskit_test_tsk_trace_error_c", (DL_FUNC) &_RcppTskit_test_tsk_trace_error_c, 0},
     {"_RcppTskit_test_tsk_trace_error_cpp", (DL_FUNC) &_RcppTskit_test_tsk_trace_error_cpp, 0},
     {"_RcppTskit_tsk_trace_errors_defined", (DL_FUNC) &_RcppTskit_tsk_trace_errors_defined, 0},
-    {"_RcppTskit_test_rtsk_treeseq_copy_tables_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_treeseq_copy_tables_forced_error, 1},
+    {"_RcppTskit_test_rtsk_treeseq_copy_tables_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_treeseq_copy_tables_forced_error, 2},
     {"_RcppTskit_test_rtsk_treeseq_init_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_treeseq_init_forced_error, 1},
     {"_RcppTskit_test_rtsk_table_collection_build_index_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_table_collection_build_index_forced_error, 1},
     {"_RcppTskit_test_rtsk_individual_table_add_row_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_individual_table_add_row_forced_error, 1},
@@ -807,10 +1522,21 @@ static const R_CallMethodDef CallEntries[] = {
     {"_RcppTskit_test_rtsk_edge_table_add_row_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_edge_table_add_row_forced_error, 1},
     {"_RcppTskit_test_rtsk_site_table_add_row_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_site_table_add_row_forced_error, 1},
     {"_RcppTskit_test_rtsk_mutation_table_add_row_forced_error", (DL_FUNC) &_RcppTskit_test_rtsk_mutation_table_add_row_forced_error, 1},
+    {"_RcppTskit_test_tsk_table_collection_equals", (DL_FUNC) &_RcppTskit_test_tsk_table_collection_equals, 3},
+    {"_RcppTskit_test_tsk_table_collection_canonicalise", (DL_FUNC) &_RcppTskit_test_tsk_table_collection_canonicalise, 2},
+    {"_RcppTskit_test_tsk_table_collection_union", (DL_FUNC) &_RcppTskit_test_tsk_table_collection_union, 4},
+    {"_RcppTskit_test_migration_table_add_row", (DL_FUNC) &_RcppTskit_test_migration_table_add_row, 7},
+    {"_RcppTskit_test_tsk_table_collection_ibd", (DL_FUNC) &_RcppTskit_test_tsk_table_collection_ibd, 5},
+    {"_RcppTskit_test_tsk_treeseq_kc_distance", (DL_FUNC) &_RcppTskit_test_tsk_treeseq_kc_distance, 3},
+    {"_RcppTskit_test_tsk_table_collection_check_integrity", (DL_FUNC) &_RcppTskit_test_tsk_table_collection_check_integrity, 2},
+    {"_RcppTskit_test_tsk_treeseq_extend_haplotypes", (DL_FUNC) &_RcppTskit_test_tsk_treeseq_extend_haplotypes, 2},
+    {"_RcppTskit_test_edge_table_update_row", (DL_FUNC) &_RcppTskit_test_edge_table_update_row, 6},
     {NULL, NULL, 0}
 };
 
+void rtsk_register_ccallables(DllInfo* dll);
 RcppExport void R_init_RcppTskit(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    rtsk_register_ccallables(dll);
 }
@@ -4,12 +4,25 @@
 // they are synced!
 #define RCPPTSKIT_IMPL
 #include <RcppTskit.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <exception>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+#include <zlib.h>
 
 namespace {
 // namespace to keep the contents local to this file
@@ -22,6 +35,13 @@ constexpr tsk_flags_t kCopyTablesSupportedFlags = TSK_COPY_FILE_UUID;
 constexpr tsk_flags_t kTreeseqInitSupportedFlags =
     TSK_TS_INIT_BUILD_INDEXES | TSK_TS_INIT_COMPUTE_MUTATION_PARENTS;
 
+constexpr tsk_flags_t kCheckIntegritySupportedFlags =
+    TSK_CHECK_EDGE_ORDERING | TSK_CHECK_SITE_ORDERING |
+    TSK_CHECK_SITE_DUPLICATES | TSK_CHECK_MUTATION_ORDERING |
+    TSK_CHECK_INDIVIDUAL_ORDERING | TSK_CHECK_MIGRATION_ORDERING |
+    TSK_CHECK_INDEXES | TSK_CHECK_TREES | TSK_CHECK_MUTATION_PARENTS |
+    TSK_NO_CHECK_POPULATION_REFS;
+
 // INTERNAL
 // @title Validate load options
 // @param options passed to load functions
@@ -83,13 +103,15 @@ tsk_flags_t validate_copy_tables_options(int options, const char *caller) {
 // @param caller function name
 // @details See
 //   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_init}.
-//   \code{TSK_TAKE_OWNERSHIP} is unsupported because the input
+//   \code{TSK_TAKE_OWNERSHIP} is unsupported as an option because the input
 //   table collection remains reachable via R external pointer (risk of
 //   dangling alias / double-free), and because the ownership path of
 //   \code{tsk_treeseq_free()} is based on C
 //   \code{malloc()/free()}, while this wrapper manages that outer struct with
 //   C++ \code{new()/delete()}.
 //   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.TSK_TAKE_OWNERSHIP}.
+//   The \code{consume} argument of \code{rtsk_treeseq_init()} takes
+//   ownership safely.
 // @return Validated flags as bitwise options.
 tsk_flags_t validate_treeseq_init_options(int options, const char *caller) {
   if (options < 0) {
@@ -97,7 +119,8 @@ tsk_flags_t validate_treeseq_init_options(int options, const char *caller) {
   }
   const tsk_flags_t flags = static_cast<tsk_flags_t>(options);
   if (flags & TSK_TAKE_OWNERSHIP) {
-    Rcpp::stop("%s does not support TSK_TAKE_OWNERSHIP", caller);
+    Rcpp::stop("%s does not support TSK_TAKE_OWNERSHIP; use consume = TRUE",
+               caller);
   }
   const tsk_flags_t unsupported = flags & ~kTreeseqInitSupportedFlags;
   if (unsupported != 0) {
@@ -113,12 +136,14 @@ tsk_flags_t validate_treeseq_init_options(int options, const char *caller) {
 // INTERNAL
 // @title Validate tskit flags
 // @param options passed to tskit functions
+// @param supported bitmask of the options the caller supports
 // @param caller function name
 // @details See for example
 //   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_dump}
 //   and
 //   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_dump},
-//   which currently expects \code{0}.
+//   which currently expects \code{0}, so their callers pass
+//   \code{supported = 0}. Bits in \code{supported} are passed through.
 // @return Validated flags as bitwise options.
 tsk_flags_t validate_options(int options, tsk_flags_t supported,
                              const char *caller) {
@@ -132,9 +157,6 @@ tsk_flags_t validate_options(int options, tsk_flags_t supported,
                static_cast<unsigned int>(supported),
                static_cast<unsigned int>(unsupported));
   }
-  if (flags != 0) {
-    Rcpp::stop("%s does not support non-zero options", caller);
-  }
   return flags;
 }
 
@@ -197,678 +219,7633 @@ SEXP rtsk_wrap_tsk_size_t_as_integer64(const tsk_size_t value,
   return as_integer64(value_str);
 }
 
-} // namespace
+constexpr tsk_flags_t kNewickSupportedFlags = TSK_NEWICK_LEGACY_MS_LABELS;
 
-// TEST-ONLY
-// @title Test helper for validating tskit flags
-// @param options that will be validated
-// @param supported integer bitmask for supported options
-// @return Validated flags as integer.
-// [[Rcpp::export]]
-int test_validate_options(int options, int supported) {
-  const tsk_flags_t out = validate_options(
-      options, static_cast<tsk_flags_t>(supported), "test_validate_options");
-  return static_cast<int>(out);
+constexpr tsk_flags_t kVariantSupportedFlags = TSK_ISOLATED_NOT_MISSING;
+
+// Number of consecutive sites a worker thread decodes at a time
+constexpr std::size_t kSiteBlockSize = 64;
+
+// Target size of the in-memory chunk when streaming decoded sites to a file
+constexpr std::size_t kOutputChunkBytes = 64 << 20;
+
+// INTERNAL
+// @title Buffered output stream to a plain or gzip-compressed file
+// @details Exporters write many small records (one Newick string per tree,
+//   one line per site, ...), so we collect them in one fixed-size buffer and
+//   hand it to \code{fwrite()} or \code{gzwrite()} only when it fills up.
+//   Writes never throw, so callers can write while holding \code{tskit}
+//   objects that need freeing; a failed write is remembered and reported by
+//   \code{close()}. Unless \code{close()} succeeds, the destructor closes
+//   and removes the file, so \code{Rcpp::stop()} or a user interrupt in the
+//   middle of an export neither leaks the handle nor leaves a truncated file
+//   behind. Only a new or regular file is removed, never a device or a pipe
+//   such as \code{/dev/stdout}.
+class output_stream {
+public:
+  output_stream(const std::string &filename, bool compress)
+      : filename_(filename), compress_(compress) {
+    buffer_.reserve(kBufferSize);
+    struct stat info;
+    removable_ = stat(filename_.c_str(), &info) != 0 || S_ISREG(info.st_mode);
+    if (compress_) {
+      gz_ = gzopen(filename_.c_str(), "wb");
+      if (gz_ != NULL) {
+        gzbuffer(gz_, kBufferSize);
+      }
+    } else {
+      file_ = std::fopen(filename_.c_str(), "wb");
+    }
+    if (file_ == NULL && gz_ == NULL) {
+      Rcpp::stop("Failed to open file '%s' for writing", filename_.c_str());
+    }
+  }
+
+  ~output_stream() {
+    if (!closed_) {
+      discard();
+    }
+  }
+
+  output_stream(const output_stream &) = delete;
+  output_stream &operator=(const output_stream &) = delete;
+
+  void write(const char *data, std::size_t length) {
+    if (buffer_.size() + length > kBufferSize) {
+      flush();
+    }
+    if (length > kBufferSize) {
+      write_through(data, length);
+    } else {
+      buffer_.insert(buffer_.end(), data, data + length);
+    }
+  }
+
+  void write(const std::string &value) { write(value.data(), value.size()); }
+
+  void put(char c) {
+    if (buffer_.size() == kBufferSize) {
+      flush();
+    }
+    buffer_.push_back(c);
+  }
+
+  void close() {
+    flush();
+    if (file_ != NULL) {
+      failed_ = std::fclose(file_) != 0 || failed_;
+      file_ = NULL;
+    }
+    if (gz_ != NULL) {
+      failed_ = gzclose(gz_) != Z_OK || failed_;
+      gz_ = NULL;
+    }
+    if (failed_) {
+      Rcpp::stop("Failed to write file '%s'", filename_.c_str());
+    }
+    closed_ = true;
+  }
+
+  // Close the file without reporting errors and remove it
+  void discard() {
+    if (file_ != NULL) {
+      std::fclose(file_);
+      file_ = NULL;
+    }
+    if (gz_ != NULL) {
+      gzclose(gz_);
+      gz_ = NULL;
+    }
+    if (removable_) {
+      std::remove(filename_.c_str());
+      removable_ = false;
+    }
+  }
+
+private:
+  static constexpr std::size_t kBufferSize = 1 << 20;
+
+  void flush() {
+    if (!buffer_.empty()) {
+      write_through(buffer_.data(), buffer_.size());
+      buffer_.clear();
+    }
+  }
+
+  void write_through(const char *data, std::size_t length) {
+    if (failed_) {
+      return;
+    }
+    if (compress_) {
+      // gzwrite() takes an unsigned length, so feed large blocks in chunks
+      while (!failed_ && length > 0) {
+        const unsigned chunk =
+            static_cast<unsigned>(length < kBufferSize ? length : kBufferSize);
+        failed_ = gzwrite(gz_, data, chunk) != static_cast<int>(chunk);
+        data += chunk;
+        length -= chunk;
+      }
+    } else {
+      failed_ = std::fwrite(data, 1, length, file_) != length;
+    }
+  }
+
+  std::string filename_;
+  bool compress_;
+  std::FILE *file_ = NULL;
+  gzFile gz_ = NULL;
+  bool failed_ = false;
+  bool closed_ = false;
+  bool removable_ = false;
+  std::vector<char> buffer_;
+};
+
+// INTERNAL
+// @title Buffered output streams to a set of files written together
+// @details Exporters that write several files (such as the PLINK
+//   \code{.bed}, \code{.bim}, and \code{.fam} files) open them all before
+//   writing any, so a file that can not be opened fails the export before
+//   anything is written. Unless \code{close()} succeeds for all of them, the
+//   destructor removes every file that was opened (also those already
+//   closed), so an error (\code{Rcpp::stop()} or a user interrupt) in the
+//   middle of an export does not leave a partial set of files behind.
+class output_file_set {
+public:
+  // A failed open destroys the streams opened so far, which removes them
+  explicit output_file_set(const std::vector<std::string> &filenames) {
+    for (const std::string &filename : filenames) {
+      streams_.emplace_back(new output_stream(filename, false));
+    }
+  }
+
+  ~output_file_set() {
+    if (!closed_) {
+      for (std::unique_ptr<output_stream> &stream : streams_) {
+        stream->discard();
+      }
+    }
+  }
+
+  output_file_set(const output_file_set &) = delete;
+  output_file_set &operator=(const output_file_set &) = delete;
+
+  output_stream &operator[](std::size_t i) { return *streams_[i]; }
+
+  void close() {
+    for (std::unique_ptr<output_stream> &stream : streams_) {
+      stream->close();
+    }
+    closed_ = true;
+  }
+
+private:
+  std::vector<std::unique_ptr<output_stream>> streams_;
+  bool closed_ = false;
+};
+
+// INTERNAL
+// @title Validate the number of worker threads
+// @param threads requested number of threads
+// @param caller function name
+// @return Validated number of threads.
+int validate_threads(int threads, const char *caller) {
+  // NA_integer_ is INT_MIN, so it is caught here too
+  if (threads < 1) {
+    Rcpp::stop("%s requires threads to be a positive integer", caller);
+  }
+  return threads;
 }
 
-// TEST-ONLY
-// @title Test helper for integer64 wrapping of \code{tsk_size_t}
-// @param value character representation of unsigned integer
-// @param force_range_error logical flag for testing range-check branch
-// @return \code{R bit64::integer64} object.
-// [[Rcpp::export]]
-SEXP test_rtsk_wrap_tsk_size_t_as_integer64(const std::string &value,
-                                            bool force_range_error = false) {
-  unsigned long long parsed = 0;
-  std::size_t parsed_chars = 0;
-  try {
-    parsed = std::stoull(value, &parsed_chars, 10);
-  } catch (const std::exception &) {
-    Rcpp::stop("value must be a valid base-10 unsigned integer string");
+// INTERNAL
+// @title Shared state of worker threads
+// @details Worker threads must not call the \code{R} API (including
+//   \code{Rcpp::stop()}), so they record the first failure here and stop
+//   early, while the calling thread raises the error after all workers have
+//   joined.
+class worker_status {
+public:
+  bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+  void fail(const std::string &message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!failed()) {
+      message_ = message;
+      failed_.store(true, std::memory_order_relaxed);
+    }
   }
-  if (parsed_chars != value.size()) {
-    Rcpp::stop("value must be a valid base-10 unsigned integer string");
+
+  void fail_tsk(int ret) { fail(tsk_strerror(ret)); }
+
+  void stop_if_failed() const {
+    if (failed()) {
+      Rcpp::stop(message_);
+    }
   }
-  const tsk_size_t tsk_value = static_cast<tsk_size_t>(parsed);
-  if (force_range_error ||
-      static_cast<unsigned long long>(tsk_value) != parsed) {
-    Rcpp::stop("value is out of range for tsk_size_t");
+
+private:
+  std::atomic<bool> failed_{false};
+  std::mutex mutex_;
+  std::string message_;
+};
+
+// INTERNAL
+// @title Hand out contiguous blocks of items to worker threads
+// @details Blocks are claimed with an atomic counter, so faster threads
+//   simply take more blocks and items within a block stay in order (good for
+//   \code{tsk_tree_seek()}, which is cheapest when moving forward).
+class block_queue {
+public:
+  block_queue(std::size_t num_items, std::size_t block_size)
+      : num_items_(num_items), block_size_(std::max<std::size_t>(block_size, 1)) {
+  }
+
+  bool next(std::size_t &start, std::size_t &stop) {
+    start = next_.fetch_add(block_size_, std::memory_order_relaxed);
+    if (start >= num_items_) {
+      return false;
+    }
+    stop = std::min(start + block_size_, num_items_);
+    return true;
+  }
+
+  std::size_t num_blocks() const {
+    return (num_items_ + block_size_ - 1) / block_size_;
+  }
+
+private:
+  std::size_t num_items_;
+  std::size_t block_size_;
+  std::atomic<std::size_t> next_{0};
+};
+
+// INTERNAL
+// @title Run a function on worker threads
+// @param num_threads number of threads (the calling thread is one of them)
+// @param status shared worker status
+// @param body function called as \code{body(thread_index)} on each thread
+// @details \code{body} must not call the \code{R} API. Exceptions thrown by
+//   \code{body} (e.g., \code{std::bad_alloc}) are caught and recorded in
+//   \code{status}.
+template <typename BodyT>
+void run_threads(int num_threads, worker_status &status, BodyT body) {
+  auto guarded = [&status, &body](int thread_index) {
+    try {
+      body(thread_index);
+    } catch (const std::exception &e) {
+      status.fail(e.what());
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(static_cast<std::size_t>(num_threads - 1));
+  for (int t = 1; t < num_threads; t++) {
+    workers.emplace_back(guarded, t);
+  }
+  guarded(0);
+  for (std::thread &worker : workers) {
+    worker.join();
   }
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_value, "test_rtsk_wrap_tsk_size_t_as_integer64");
 }
 
-// PUBLIC
-//' @title Report the version of installed kastore C API
-//' @details The version is stored in the installed header \code{kastore.h}.
-//' @return A named vector with three elements \code{major}, \code{minor}, and
-//'   \code{patch}.
-//' @examples
-//' kastore_version()
-//' @export
-// [[Rcpp::export]]
-Rcpp::IntegerVector kastore_version() {
-  // Rcpp::_["major"] is shorthand for Rcpp::Named("major")
-  return Rcpp::IntegerVector::create(Rcpp::_["major"] = KAS_VERSION_MAJOR,
-                                     Rcpp::_["minor"] = KAS_VERSION_MINOR,
-                                     Rcpp::_["patch"] = KAS_VERSION_PATCH);
+// Decode a subset of samples via all samples when the subset holds at least
+// 1 / kGatherSubsetDivisor of the samples (see variant_set)
+constexpr std::size_t kGatherSubsetDivisor = 16;
+
+// INTERNAL
+// @title A set of genotype decoders, one per worker thread
+// @details Each thread needs its own \code{tsk_variant_t}, because the
+//   variant holds the tree that is moved along the genome while decoding.
+//   The variants only read from the tree sequence, so they can decode
+//   concurrently. They are allocated and freed on the calling thread.
+//
+//   For a user-specified list of nodes, \code{tsk_variant_decode()} finds
+//   genotypes by traversing the subtree below every mutation, while for all
+//   samples it uses the sample lists that the tree maintains incrementally.
+//   When the list holds only sample nodes and is a large part of all samples
+//   (at least 1 / \code{kGatherSubsetDivisor}), traversal is slower than
+//   decoding all samples, so we decode all samples and gather the subset via
+//   \code{sample_index_map} into a per-thread copy of the variant. Small
+//   subsets and lists with non-sample nodes keep the traversal.
+class variant_set {
+public:
+  variant_set(const tsk_treeseq_t *ts, const std::vector<tsk_id_t> &samples,
+              tsk_flags_t options, int num_variants)
+      : variants_(static_cast<std::size_t>(num_variants)) {
+    gather_ = gather_subset(ts, samples);
+    const tsk_id_t *samples_ptr =
+        samples.empty() || gather_ ? NULL : samples.data();
+    const tsk_size_t num_samples =
+        gather_ ? 0 : static_cast<tsk_size_t>(samples.size());
+    if (gather_) {
+      sample_index_.reserve(samples.size());
+      for (const tsk_id_t u : samples) {
+        sample_index_.push_back(ts->sample_index_map[u]);
+      }
+      views_.resize(variants_.size());
+      genotypes_.resize(variants_.size(),
+                        std::vector<int32_t>(samples.size()));
+    }
+    int ret = 0;
+    for (tsk_variant_t &variant : variants_) {
+      // tsk_variant_init() has to be paired with tsk_variant_free() even
+      // when it fails
+      num_initialised_++;
+      ret = tsk_variant_init(&variant, ts, samples_ptr, num_samples, NULL,
+                             options);
+      if (ret != 0) {
+        free();
+        Rcpp::stop(tsk_strerror(ret));
+      }
+    }
+  }
+
+  ~variant_set() { free(); }
+
+  variant_set(const variant_set &) = delete;
+  variant_set &operator=(const variant_set &) = delete;
+
+  // Decode a site with the variant of a thread; on success, *out points to
+  // the decoded variant over the requested samples (valid until the next
+  // call from the same thread)
+  int decode(int thread_index, tsk_id_t site, const tsk_variant_t **out) {
+    const std::size_t t = static_cast<std::size_t>(thread_index);
+    tsk_variant_t *variant = &variants_[t];
+    int ret = tsk_variant_decode(variant, site, 0);
+    if (ret != 0 || !gather_) {
+      *out = variant;
+      return ret;
+    }
+    tsk_variant_t *view = &views_[t];
+    int32_t *genotypes = genotypes_[t].data();
+    const std::size_t n = sample_index_.size();
+    bool has_missing_data = false;
+    for (std::size_t j = 0; j < n; j++) {
+      genotypes[j] = variant->genotypes[sample_index_[j]];
+      has_missing_data = has_missing_data || genotypes[j] == TSK_MISSING_DATA;
+    }
+    // shallow copy: alleles and site point into the decoding variant
+    *view = *variant;
+    view->genotypes = genotypes;
+    view->num_samples = static_cast<tsk_size_t>(n);
+    view->has_missing_data = has_missing_data;
+    *out = view;
+    return 0;
+  }
+
+private:
+  static bool gather_subset(const tsk_treeseq_t *ts,
+                            const std::vector<tsk_id_t> &samples) {
+    const std::size_t num_samples = static_cast<std::size_t>(ts->num_samples);
+    const std::size_t num_nodes =
+        static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts));
+    if (samples.empty() ||
+        samples.size() * kGatherSubsetDivisor < num_samples) {
+      return false;
+    }
+    // Invalid or duplicated IDs are left to tsk_variant_init() to report
+    std::vector<char> seen(num_samples, 0);
+    for (const tsk_id_t u : samples) {
+      if (u < 0 || static_cast<std::size_t>(u) >= num_nodes) {
+        return false;
+      }
+      const tsk_id_t index = ts->sample_index_map[u];
+      if (index == TSK_NULL || seen[static_cast<std::size_t>(index)]) {
+        return false;
+      }
+      seen[static_cast<std::size_t>(index)] = 1;
+    }
+    return true;
+  }
+
+  void free() {
+    for (std::size_t j = 0; j < num_initialised_; j++) {
+      tsk_variant_free(&variants_[j]);
+    }
+    num_initialised_ = 0;
+  }
+
+  std::vector<tsk_variant_t> variants_;
+  std::size_t num_initialised_ = 0;
+  bool gather_ = false;
+  std::vector<tsk_id_t> sample_index_;
+  std::vector<tsk_variant_t> views_;
+  std::vector<std::vector<int32_t>> genotypes_;
+};
+
+// INTERNAL
+// @title Convert optional site IDs to a validated vector of site IDs
+// @param ts tree sequence
+// @param sites nullable site IDs (0-based); \code{NULL} means all sites
+// @param caller function name
+// @return Site IDs.
+std::vector<tsk_id_t>
+sites_or_all(const tsk_treeseq_t *ts,
+             const Rcpp::Nullable<Rcpp::IntegerVector> &sites,
+             const char *caller) {
+  const tsk_size_t num_sites = tsk_treeseq_get_num_sites(ts);
+  std::vector<tsk_id_t> out;
+  if (sites.isNull()) {
+    out.resize(static_cast<std::size_t>(num_sites));
+    for (std::size_t j = 0; j < out.size(); j++) {
+      out[j] = static_cast<tsk_id_t>(j);
+    }
+    return out;
+  }
+  out = int_vector_to_tsk_id_vector(Rcpp::as<Rcpp::IntegerVector>(sites));
+  for (const tsk_id_t site : out) {
+    if (site < 0 || static_cast<tsk_size_t>(site) >= num_sites) {
+      Rcpp::stop("%s: site IDs must be between 0 and the number of sites - 1",
+                 caller);
+    }
+  }
+  return out;
 }
 
-// PUBLIC
-//' @title Report the version of installed \code{tskit} C API
-//' @details The version is defined in the installed header \code{tskit/core.h}.
-//' @return A named vector with three elements \code{major}, \code{minor}, and
-//'   \code{patch}.
-//' @examples
-//' tskit_version()
-//' @export
-// [[Rcpp::export]]
-Rcpp::IntegerVector tskit_version() {
-  return Rcpp::IntegerVector::create(Rcpp::_["major"] = TSK_VERSION_MAJOR,
-                                     Rcpp::_["minor"] = TSK_VERSION_MINOR,
-                                     Rcpp::_["patch"] = TSK_VERSION_PATCH);
+// Genotype encodings of rtsk_treeseq_genotype_matrix()
+enum class genotype_format { int8, two_bit, bit_packed };
+
+// INTERNAL
+// @title Validate variant (genotype decoding) options
+// @param options passed to \code{tsk_variant_init}
+// @param caller function name
+// @details See
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_init}.
+// @return Validated flags as bitwise options.
+tsk_flags_t validate_variant_options(int options, const char *caller) {
+  if (options < 0) {
+    Rcpp::stop("%s does not support negative options", caller);
+  }
+  const tsk_flags_t flags = static_cast<tsk_flags_t>(options);
+  const tsk_flags_t unsupported = flags & ~kVariantSupportedFlags;
+  if (unsupported != 0) {
+    Rcpp::stop("%s only supports option TSK_ISOLATED_NOT_MISSING (1 << 1); "
+               "unsupported bits: 0x%X",
+               caller, static_cast<unsigned int>(unsupported));
+  }
+  return flags;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_load
-// @title Load a tree sequence from a file
-// @param filename a string specifying the full path of the tree sequence file.
-// @param options passed to \code{tskit C} (see details and note that only
-//   \code{TSK_LOAD_SKIP_TABLES} and \code{TSK_LOAD_SKIP_REFERENCE_SEQUENCE},
-//   but not \code{TSK_NO_INIT}, are supported by this wrapper).
-// @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_load}.
-// @return An external pointer to tree sequence as a \code{tsk_treeseq_t}
-//   object
-// @seealso \code{\link{ts_load}} and
-//   \code{\link[=TreeSequence]{TreeSequence$new}} on how this function is used
-//   and presented to users.
-// @examples
-// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
-// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// is(ts_xptr)
-// ts_xptr
-// RcppTskit:::rtsk_treeseq_get_num_nodes(ts_xptr)
-// ts <- TreeSequence$new(xptr = ts_xptr)
-// is(ts)
-// [[Rcpp::export]]
-SEXP rtsk_treeseq_load(const std::string &filename, int options = 0) {
-  const tsk_flags_t flags = validate_load_options(options, "rtsk_treeseq_load");
-  // tsk_treeseq_t ts; // on stack, destroyed end of func, must free resources
-  tsk_treeseq_t *ts_ptr = new tsk_treeseq_t(); // on heap, persists function
-  // See also https://tskit.dev/tskit/docs/stable/c-api.html#api-structure
-  int ret = tsk_treeseq_load(ts_ptr, filename.c_str(), flags);
-  if (ret != 0) {
-    tsk_treeseq_free(ts_ptr);
-    delete ts_ptr;
-    Rcpp::stop(tsk_strerror(ret));
+// INTERNAL
+// @title Parse genotype format
+// @param format one of \code{"int8"}, \code{"2bit"}, or \code{"bitpacked"}
+// @param caller function name
+// @return Genotype format.
+genotype_format parse_genotype_format(const std::string &format,
+                                      const char *caller) {
+  if (format == "int8") {
+    return genotype_format::int8;
   }
-  // Wrap standard/raw ts_ptr for R as an external pointer handle (xptr)
-  // "true" below means that R will call finaliser on garbage collection
-  rtsk_treeseq_t ts_xptr(ts_ptr, true);
-  return ts_xptr;
+  if (format == "2bit") {
+    return genotype_format::two_bit;
+  }
+  if (format == "bitpacked") {
+    return genotype_format::bit_packed;
+  }
+  Rcpp::stop("%s supports format int8, 2bit, or bitpacked", caller);
 }
 
-// PUBLIC, wrapper for tsk_table_collection_load
-// @title Load a table collection from a file
-// @param filename a string specifying the full path of the tree sequence file.
-// @param options passed to \code{tskit C} (see details and note that only
-//   \code{TSK_LOAD_SKIP_TABLES} and \code{TSK_LOAD_SKIP_REFERENCE_SEQUENCE},
-//   but not \code{TSK_NO_INIT}, are supported by this wrapper).
-// @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_load}.
-// @return An external pointer to table collection as a
-//   \code{tsk_table_collection_t} object
-// @seealso \code{\link{tc_load}} and
-//   \code{\link[=TableCollection]{TableCollection$new}} on how this function is
-//   used and presented to users.
-// @examples
-// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
-// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
-// is(tc_xptr)
-// tc_xptr
-// RcppTskit:::rtsk_table_collection_print(tc_xptr)
-// tc <- TableCollection$new(xptr = tc_xptr)
-// is(tc)
-// [[Rcpp::export]]
-SEXP rtsk_table_collection_load(const std::string &filename, int options = 0) {
-  const tsk_flags_t flags =
-      validate_load_options(options, "rtsk_table_collection_load");
-  tsk_table_collection_t *tc_ptr = new tsk_table_collection_t();
-  int ret = tsk_table_collection_load(tc_ptr, filename.c_str(), flags);
-  if (ret != 0) {
-    tsk_table_collection_free(tc_ptr);
-    delete tc_ptr;
-    Rcpp::stop(tsk_strerror(ret));
+// INTERNAL
+// @title Number of bytes that hold the genotypes of one site
+// @param format genotype encoding
+// @param num_samples number of samples
+// @return Number of bytes.
+std::size_t genotype_bytes_per_site(genotype_format format,
+                                    std::size_t num_samples) {
+  switch (format) {
+  case genotype_format::two_bit:
+    return (num_samples + 3) / 4;
+  case genotype_format::bit_packed:
+    return (num_samples + 7) / 8;
+  default:
+    return num_samples;
   }
-  // Wrap standard/raw tc_ptr for R as an external pointer handle (xptr)
-  // "true" below means that R will call finaliser on garbage collection
-  rtsk_table_collection_t tc_xptr(tc_ptr, true);
-  return tc_xptr;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_dump
-// @title Write a tree sequence to a file
-// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
-//   object.
-// @param filename a string specifying the full path of the tree sequence file.
-// @param options passed to \code{tskit C} (see details and note that
-//   these options are currently unused in \code{tskit} and should be \code{0}).
-// @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_dump}.
-// @return No return value; called for side effects.
-// @examples
-// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
-// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// dump_file <- tempfile()
-// RcppTskit:::rtsk_treeseq_dump(ts_xptr, dump_file)
-// file.remove(dump_file)
-// [[Rcpp::export]]
-void rtsk_treeseq_dump(SEXP ts, const std::string &filename, int options = 0) {
-  const tsk_flags_t flags = validate_options(options, 0, "rtsk_treeseq_dump");
-  rtsk_treeseq_t ts_xptr(ts);
-  int ret = tsk_treeseq_dump(ts_xptr, filename.c_str(), flags);
-  if (ret != 0) {
-    Rcpp::stop(tsk_strerror(ret));
+// INTERNAL
+// @title Pack decoded genotypes of one site
+// @param variant decoded variant
+// @param format genotype encoding
+// @param out output bytes of the site (see \code{genotype_bytes_per_site})
+// @details \code{int8} stores the allele index in one byte per sample,
+//   with \code{0xFF} for missing data (up to 255 alleles). \code{2bit}
+//   stores four samples per byte, sample \code{j} in bits
+//   \code{2 * (j mod 4)}, with allele index \code{0-2} and \code{3} for
+//   missing data. \code{bitpacked} stores eight samples per byte, sample
+//   \code{j} in bit \code{j mod 8}, set for the non-ancestral allele; it
+//   requires biallelic sites without missing data.
+// @return \code{NULL} on success or an error message.
+const char *pack_genotypes(const tsk_variant_t *variant,
+                           genotype_format format, unsigned char *out) {
+  const int32_t *genotypes = variant->genotypes;
+  const std::size_t n = static_cast<std::size_t>(variant->num_samples);
+  switch (format) {
+  case genotype_format::int8:
+    if (variant->num_alleles > 255) {
+      return "format int8 supports sites with at most 255 alleles";
+    }
+    for (std::size_t j = 0; j < n; j++) {
+      out[j] = static_cast<unsigned char>(genotypes[j]);
+    }
+    break;
+  case genotype_format::two_bit:
+    if (variant->num_alleles > 3) {
+      return "format 2bit supports sites with at most 3 alleles";
+    }
+    std::fill(out, out + genotype_bytes_per_site(format, n), 0);
+    for (std::size_t j = 0; j < n; j++) {
+      const unsigned code = static_cast<unsigned>(genotypes[j]) & 3u;
+      out[j >> 2] |= static_cast<unsigned char>(code << (2 * (j & 3)));
+    }
+    break;
+  case genotype_format::bit_packed:
+    if (variant->num_alleles > 2) {
+      return "format bitpacked supports sites with at most 2 alleles";
+    }
+    if (variant->has_missing_data) {
+      return "format bitpacked does not support missing data";
+    }
+    std::fill(out, out + genotype_bytes_per_site(format, n), 0);
+    for (std::size_t j = 0; j < n; j++) {
+      out[j >> 3] |= static_cast<unsigned char>((genotypes[j] != 0)
+                                                 << (j & 7));
+    }
+    break;
   }
+  return NULL;
 }
 
-// PUBLIC, wrapper for tsk_table_collection_dump
-// @title Write a table collection to a file
-// @param tc an external pointer to table collection as a
-//   \code{tsk_table_collection_t} object.
-// @param filename a string specifying the full path of the tree sequence file.
-// @param options passed to \code{tskit C} (see details and note that
+// INTERNAL
+// @title Limit the number of threads to the number of blocks of sites
+// @param num_threads requested number of threads
+// @param num_sites number of sites to decode
+// @return Number of threads, at least 1.
+int threads_for_sites(int num_threads, std::size_t num_sites) {
+  const std::size_t num_blocks =
+      (num_sites + kSiteBlockSize - 1) / kSiteBlockSize;
+  return static_cast<int>(std::max<std::size_t>(
+      1, std::min<std::size_t>(static_cast<std::size_t>(num_threads),
+                               num_blocks)));
+}
+
+// INTERNAL
+// @title Number of sites per chunk when streaming decoded sites to a file
+// @param bytes_per_site number of output bytes of one site
+// @param num_threads number of threads
+// @return Number of sites, so that a chunk is about \code{kOutputChunkBytes}
+//   and gives every thread at least one block of sites.
+std::size_t sites_per_chunk(std::size_t bytes_per_site, int num_threads) {
+  return std::max<std::size_t>(
+      kSiteBlockSize * static_cast<std::size_t>(num_threads),
+      kOutputChunkBytes / std::max<std::size_t>(bytes_per_site, 1));
+}
+
+// INTERNAL
+// @title Decode sites on worker threads
+// @param variants variants, one per thread
+// @param num_threads number of threads
+// @param site_ids site IDs to decode
+// @param num_sites number of sites in \code{site_ids}
+// @param caller function name
+// @param visit function called as \code{visit(variant, j)} after decoding
+//   \code{site_ids[j]}; returns \code{NULL} on success or an error message
+// @details Sites are handed out in blocks of \code{kSiteBlockSize}
+//   consecutive sites, so each variant moves its tree forward along the
+//   genome. \code{visit} runs on worker threads and must not call the
+//   \code{R} API; it should write its output to slot \code{j} only.
+template <typename VisitT>
+void decode_sites(variant_set &variants, int num_threads,
+                  const tsk_id_t *site_ids, std::size_t num_sites,
+                  const char *caller, VisitT visit) {
+  worker_status status;
+  block_queue queue(num_sites, kSiteBlockSize);
+  run_threads(num_threads, status, [&](int thread_index) {
+    const tsk_variant_t *variant;
+    std::size_t start, stop;
+    while (!status.failed() && queue.next(start, stop)) {
+      for (std::size_t j = start; j < stop; j++) {
+        int ret = variants.decode(thread_index, site_ids[j], &variant);
+        if (ret != 0) {
+          status.fail_tsk(ret);
+          return;
+        }
+        const char *error = visit(variant, j);
+        if (error != NULL) {
+          status.fail(std::string(caller) + ": " + error);
+          return;
+        }
+      }
+    }
+  });
+  status.stop_if_failed();
+}
+
+// INTERNAL
+// @title Nodes of a set of individuals
+// @details Nodes of individual \code{ids[k]} are
+//   \code{nodes[offsets[k]:offsets[k + 1]]}, in the order of
+//   \code{tsk_treeseq_t.individual_nodes}.
+struct individual_node_set {
+  std::vector<tsk_id_t> ids;
+  std::vector<tsk_id_t> nodes;
+  std::vector<std::size_t> offsets;
+};
+
+// INTERNAL
+// @title Collect the nodes of optional individual IDs
+// @param ts tree sequence
+// @param individuals nullable individual IDs (0-based); \code{NULL} means all
+//   individuals
+// @param caller function name
+// @return Individuals and their nodes.
+individual_node_set
+individuals_or_all(const tsk_treeseq_t *ts,
+                   const Rcpp::Nullable<Rcpp::IntegerVector> &individuals,
+                   const char *caller) {
+  const tsk_size_t num_individuals = tsk_treeseq_get_num_individuals(ts);
+  individual_node_set out;
+  if (individuals.isNull()) {
+    out.ids.resize(static_cast<std::size_t>(num_individuals));
+    for (std::size_t k = 0; k < out.ids.size(); k++) {
+      out.ids[k] = static_cast<tsk_id_t>(k);
+    }
+  } else {
+    out.ids = int_vector_to_tsk_id_vector(
+        Rcpp::as<Rcpp::IntegerVector>(individuals));
+  }
+  if (out.ids.empty()) {
+    Rcpp::stop("%s requires at least one individual", caller);
+  }
+  out.offsets.reserve(out.ids.size() + 1);
+  out.offsets.push_back(0);
+  for (const tsk_id_t id : out.ids) {
+    if (id < 0 || static_cast<tsk_size_t>(id) >= num_individuals) {
+      Rcpp::stop("%s: individual IDs must be between 0 and the number of "
+                 "individuals - 1",
+                 caller);
+    }
+    const tsk_id_t *nodes = ts->individual_nodes[id];
+    out.nodes.insert(out.nodes.end(), nodes,
+                     nodes + ts->individual_nodes_length[id]);
+    out.offsets.push_back(out.nodes.size());
+  }
+  if (out.nodes.empty()) {
+    Rcpp::stop("%s requires individuals with nodes", caller);
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Check that every individual has at least one node
+// @param inds individuals and their nodes
+// @param caller function name
+void check_individuals_have_nodes(const individual_node_set &inds,
+                                  const char *caller) {
+  for (std::size_t k = 0; k < inds.ids.size(); k++) {
+    if (inds.offsets[k + 1] == inds.offsets[k]) {
+      Rcpp::stop("%s: individual %d has no nodes", caller,
+                 static_cast<int>(inds.ids[k]));
+    }
+  }
+}
+
+// INTERNAL
+// @title Pack genotypes of one biallelic site into a PLINK .bed record
+// @param variant decoded variant over \code{ploidy} nodes per individual
+// @param ploidy number of nodes per individual (1 or 2)
+// @param out output bytes, \code{(num_individuals + 3) / 4}
+// @details Individual \code{i} goes to bits \code{2 * (i mod 4)} of byte
+//   \code{i / 4}, with the PLINK codes \code{00} (homozygous for A1, the
+//   derived allele), \code{10} (heterozygous), \code{11} (homozygous for A2,
+//   the ancestral allele), and \code{01} (missing). An individual is missing
+//   when any of its nodes is missing. Haploid individuals are coded as
+//   homozygous.
+//   See \url{https://www.cog-genomics.org/plink/1.9/formats#bed}.
+void pack_plink_genotypes(const tsk_variant_t *variant, int ploidy,
+                          unsigned char *out) {
+  static const unsigned char codes[3] = {3u, 2u, 0u};
+  const int32_t *genotypes = variant->genotypes;
+  const std::size_t num_individuals =
+      static_cast<std::size_t>(variant->num_samples) /
+      static_cast<std::size_t>(ploidy);
+  std::fill(out, out + (num_individuals + 3) / 4, 0);
+  for (std::size_t i = 0; i < num_individuals; i++) {
+    unsigned code;
+    if (ploidy == 1) {
+      const int32_t g = genotypes[i];
+      code = g == TSK_MISSING_DATA ? 1u : codes[2 * g];
+    } else {
+      const int32_t g1 = genotypes[2 * i];
+      const int32_t g2 = genotypes[2 * i + 1];
+      code = (g1 == TSK_MISSING_DATA || g2 == TSK_MISSING_DATA)
+                 ? 1u
+                 : codes[g1 + g2];
+    }
+    out[i >> 2] |= static_cast<unsigned char>(code << (2 * (i & 3)));
+  }
+}
+
+// Maximum number of input bytes per BGZF block (as in bgzip)
+constexpr std::size_t kBgzfBlockData = 0xff00;
+
+// INTERNAL
+// @title Compress data into independent BGZF blocks
+// @details BGZF is a series of gzip members of at most 64 KiB, each with a
+//   \code{BC} extra field holding the size of the block, so that readers
+//   (e.g., \code{tabix}, \code{bcftools}) can seek between blocks. Because
+//   blocks are independent, threads can compress parts of a file
+//   concurrently and the compressed parts can be concatenated in order.
+//   One compressor per thread; it does not call the \code{R} API.
+//   See \url{https://samtools.github.io/hts-specs/SAMv1.pdf} (section 4.1).
+class bgzf_compressor {
+public:
+  bgzf_compressor() {
+    std::memset(&stream_, 0, sizeof(stream_));
+    // Raw deflate (negative window bits), we write the gzip wrapper ourselves
+    if (deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("Failed to initialise zlib");
+    }
+  }
+
+  ~bgzf_compressor() { deflateEnd(&stream_); }
+
+  bgzf_compressor(const bgzf_compressor &) = delete;
+  bgzf_compressor &operator=(const bgzf_compressor &) = delete;
+
+  // Append BGZF blocks of data to out; returns false on a zlib error
+  bool compress(const char *data, std::size_t length, std::string &out) {
+    while (length > 0) {
+      const std::size_t n = std::min(length, kBgzfBlockData);
+      const std::size_t offset = out.size();
+      const uLong bound = deflateBound(&stream_, static_cast<uLong>(n));
+      out.resize(offset + kHeaderSize + bound + kFooterSize);
+      unsigned char *block = reinterpret_cast<unsigned char *>(&out[offset]);
+      if (deflateReset(&stream_) != Z_OK) {
+        return false;
+      }
+      stream_.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(data));
+      stream_.avail_in = static_cast<uInt>(n);
+      stream_.next_out = block + kHeaderSize;
+      stream_.avail_out = static_cast<uInt>(bound);
+      if (deflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+        return false;
+      }
+      const std::size_t size =
+          kHeaderSize + stream_.total_out + kFooterSize;
+      std::memcpy(block, kHeader, kHeaderSize);
+      put_uint16(block + 16, static_cast<unsigned>(size - 1));
+      const uLong crc =
+          crc32(crc32(0L, Z_NULL, 0),
+                reinterpret_cast<const Bytef *>(data), static_cast<uInt>(n));
+      put_uint32(block + kHeaderSize + stream_.total_out, crc);
+      put_uint32(block + kHeaderSize + stream_.total_out + 4, n);
+      out.resize(offset + size);
+      data += n;
+      length -= n;
+    }
+    return true;
+  }
+
+  // The empty block that marks the end of a BGZF file
+  static std::string eof() {
+    static const unsigned char block[28] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+        0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    return std::string(reinterpret_cast<const char *>(block), sizeof(block));
+  }
+
+private:
+  static constexpr std::size_t kHeaderSize = 18;
+  static constexpr std::size_t kFooterSize = 8;
+  // gzip header with FEXTRA, XLEN = 6, subfield BC of length 2 (BSIZE - 1
+  // goes to the last two bytes)
+  static constexpr unsigned char kHeader[kHeaderSize] = {
+      0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x00, 0x00};
+
+  static void put_uint16(unsigned char *p, unsigned value) {
+    p[0] = static_cast<unsigned char>(value & 0xff);
+    p[1] = static_cast<unsigned char>((value >> 8) & 0xff);
+  }
+
+  static void put_uint32(unsigned char *p, unsigned long value) {
+    for (int k = 0; k < 4; k++) {
+      p[k] = static_cast<unsigned char>((value >> (8 * k)) & 0xff);
+    }
+  }
+
+  z_stream stream_;
+};
+
+// INTERNAL
+// @title Append a decimal integer to a string
+// @param out string
+// @param value integer
+void append_int(std::string &out, long long value) {
+  char buffer[24];
+  const int n = std::snprintf(buffer, sizeof(buffer), "%lld", value);
+  out.append(buffer, static_cast<std::size_t>(n));
+}
+
+// INTERNAL
+// @title Integer VCF positions of all sites
+// @param ts tree sequence
+// @param transform \code{"round"} or \code{"legacy"}
+// @param allow_position_zero whether position 0 is allowed
+// @param caller function name
+// @details \code{"round"} rounds positions to the nearest integer.
+//   \code{"legacy"} rounds positions and then increments them where needed,
+//   so that they are strictly increasing and start at 1 (as in
+//   \code{tskit Python} versions before 0.2.0).
+// @return Positions, one per site.
+std::vector<long long> vcf_positions(const tsk_treeseq_t *ts,
+                                     const std::string &transform,
+                                     bool allow_position_zero,
+                                     const char *caller) {
+  const std::size_t num_sites =
+      static_cast<std::size_t>(tsk_treeseq_get_num_sites(ts));
+  const double *position = ts->tables->sites.position;
+  std::vector<long long> out(num_sites);
+  if (transform == "round") {
+    for (std::size_t j = 0; j < num_sites; j++) {
+      out[j] = std::llround(position[j]);
+    }
+  } else if (transform == "legacy") {
+    long long last = 0;
+    for (std::size_t j = 0; j < num_sites; j++) {
+      const long long pos = std::llround(position[j]);
+      last = pos <= last ? last + 1 : pos;
+      out[j] = last;
+    }
+  } else {
+    Rcpp::stop("%s supports position_transform round or legacy", caller);
+  }
+  if (!allow_position_zero) {
+    for (std::size_t j = 0; j < num_sites; j++) {
+      if (out[j] == 0) {
+        Rcpp::stop("%s: site %d has position 0, which is not valid in VCF; "
+                   "use position_transform legacy or allow position 0",
+                   caller, static_cast<int>(j));
+      }
+    }
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Allele dosage of an individual at a decoded site
+// @param genotypes decoded genotypes over the nodes of all individuals
+// @param inds individuals and their nodes
+// @param k index of the individual in \code{inds}
+// @return Number of the individual's nodes that carry a non-ancestral allele,
+//   or -1 when any of its nodes is missing.
+int individual_dosage(const int32_t *genotypes, const individual_node_set &inds,
+                      std::size_t k) {
+  int dosage = 0;
+  for (std::size_t m = inds.offsets[k]; m < inds.offsets[k + 1]; m++) {
+    if (genotypes[m] == TSK_MISSING_DATA) {
+      return -1;
+    }
+    dosage += genotypes[m] != 0;
+  }
+  return dosage;
+}
+
+// INTERNAL
+// @title Centre and/or scale one column of dosages in place
+// @param column dosages, with \code{NaN} (\code{NA}) for missing data
+// @param n number of values in \code{column}
+// @param sum sum of non-missing values
+// @param count number of non-missing values
+// @param centre whether to subtract the mean
+// @param scale whether to divide by the standard deviation (if centred) or
+//   the root mean square (otherwise)
+// @details Matches \code{base::scale()} applied to the column, ignoring
+//   missing values.
+void standardise_column(double *column, std::size_t n, double sum,
+                        std::size_t count, bool centre, bool scale) {
+  if (centre) {
+    const double mean = sum / static_cast<double>(count);
+    for (std::size_t k = 0; k < n; k++) {
+      column[k] -= mean;
+    }
+  }
+  if (scale) {
+    double sum_squares = 0;
+    for (std::size_t k = 0; k < n; k++) {
+      if (!std::isnan(column[k])) {
+        sum_squares += column[k] * column[k];
+      }
+    }
+    const double sd =
+        std::sqrt(sum_squares / (static_cast<double>(count) - 1.0));
+    for (std::size_t k = 0; k < n; k++) {
+      column[k] /= sd;
+    }
+  }
+}
+
+// Flags supported by the Li and Stephens wrappers: TSK_ALLELES_ACGT switches
+// the alleles from 0/1 to A/C/G/T
+constexpr tsk_flags_t kLsSupportedFlags = TSK_ALLELES_ACGT;
+
+// INTERNAL
+// @title Validate Li and Stephens model options
+// @param options passed to \code{tsk_ls_hmm_init}
+// @param caller function name
+// @return Validated flags as bitwise options.
+tsk_flags_t validate_ls_options(int options, const char *caller) {
+  if (options < 0) {
+    Rcpp::stop("%s does not support negative options", caller);
+  }
+  const tsk_flags_t flags = static_cast<tsk_flags_t>(options);
+  const tsk_flags_t unsupported = flags & ~kLsSupportedFlags;
+  if (unsupported != 0) {
+    Rcpp::stop("%s only supports option TSK_ALLELES_ACGT (1 << 16); "
+               "unsupported bits: 0x%X",
+               caller, static_cast<unsigned int>(unsupported));
+  }
+  return flags;
+}
+
+// INTERNAL
+// @title Per-site probabilities of the Li and Stephens model
+// @param rate probabilities, either one for all sites or one per site
+// @param num_sites number of sites
+// @param name argument name
+// @param caller function name
+// @return Vector with one probability per site.
+std::vector<double> ls_site_rates(const Rcpp::NumericVector &rate,
+                                  std::size_t num_sites, const char *name,
+                                  const char *caller) {
+  const std::size_t n = static_cast<std::size_t>(rate.size());
+  if (n != 1 && n != num_sites) {
+    Rcpp::stop("%s requires %s of length 1 or the number of sites", caller,
+               name);
+  }
+  std::vector<double> out(num_sites);
+  for (std::size_t l = 0; l < num_sites; l++) {
+    const double x = rate[static_cast<R_xlen_t>(n == 1 ? 0 : l)];
+    if (!(x >= 0 && x <= 1)) {
+      Rcpp::stop("%s requires %s between 0 and 1", caller, name);
+    }
+    out[l] = x;
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Recombination probabilities of the Li and Stephens model from a
+//   genetic map
+// @param ts tree sequence
+// @param map_position increasing positions of the genetic map
+// @param map_cm cumulative genetic distances (cM) at \code{map_position}
+// @param ne effective population size
+// @param caller function name
+// @details Genetic distances of sites are interpolated linearly between map
+//   positions (and held constant beyond them). The probability of
+//   recombination between a site and the previous one is
+//   \code{1 - exp(-4 * ne * d / n)} for distance \code{d} in Morgans and
+//   \code{n} samples, as in \code{IMPUTE} and \code{Beagle}; it is 0 at the
+//   first site.
+// @return Vector with one probability per site.
+std::vector<double>
+ls_genetic_map_rates(const tsk_treeseq_t *ts,
+                     const Rcpp::NumericVector &map_position,
+                     const Rcpp::NumericVector &map_cm, double ne,
+                     const char *caller) {
+  const std::size_t n = static_cast<std::size_t>(map_position.size());
+  if (n == 0 || static_cast<std::size_t>(map_cm.size()) != n) {
+    Rcpp::stop("%s requires map_position and map_cm of the same non-zero "
+               "length",
+               caller);
+  }
+  for (std::size_t k = 0; k < n; k++) {
+    const R_xlen_t j = static_cast<R_xlen_t>(k);
+    if (std::isnan(map_position[j]) || std::isnan(map_cm[j]) ||
+        (k > 0 && (map_position[j] <= map_position[j - 1] ||
+                   map_cm[j] < map_cm[j - 1]))) {
+      Rcpp::stop("%s requires increasing map_position and map_cm", caller);
+    }
+  }
+  if (!(ne > 0)) {
+    Rcpp::stop("%s requires a positive ne", caller);
+  }
+  const std::size_t num_sites =
+      static_cast<std::size_t>(tsk_treeseq_get_num_sites(ts));
+  const double num_samples =
+      static_cast<double>(tsk_treeseq_get_num_samples(ts));
+  const double *position = ts->tables->sites.position;
+  std::vector<double> out(num_sites, 0);
+  // Sites are sorted by position, so the map interval only moves forward
+  std::size_t k = 0;
+  double last_cm = 0;
+  for (std::size_t l = 0; l < num_sites; l++) {
+    const double x = position[l];
+    while (k + 1 < n && map_position[static_cast<R_xlen_t>(k + 1)] <= x) {
+      k++;
+    }
+    const R_xlen_t j = static_cast<R_xlen_t>(k);
+    double cm = map_cm[j];
+    if (k + 1 < n && x > map_position[j]) {
+      cm += (map_cm[j + 1] - map_cm[j]) * (x - map_position[j]) /
+            (map_position[j + 1] - map_position[j]);
+    }
+    if (l > 0) {
+      out[l] = 1 - std::exp(-4 * ne * (cm - last_cm) / 100 / num_samples);
+    }
+    last_cm = cm;
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Query haplotypes of the Li and Stephens model
+// @param haplotypes integer matrix with one row per site and one column per
+//   haplotype holding allele indexes, \code{NA} for missing data
+// @param num_sites number of sites
+// @param flags validated Li and Stephens options
+// @param caller function name
+// @return Haplotypes one after another (\code{num_sites} values each), with
+//   missing data as \code{TSK_MISSING_DATA}.
+std::vector<int32_t> ls_query_haplotypes(const Rcpp::IntegerMatrix &haplotypes,
+                                         std::size_t num_sites,
+                                         tsk_flags_t flags,
+                                         const char *caller) {
+  if (static_cast<std::size_t>(haplotypes.nrow()) != num_sites) {
+    Rcpp::stop("%s requires one row of haplotypes per site", caller);
+  }
+  if (haplotypes.ncol() == 0) {
+    Rcpp::stop("%s requires at least one haplotype", caller);
+  }
+  const int num_alleles = (flags & TSK_ALLELES_ACGT) ? 4 : 2;
+  const int *values = INTEGER(haplotypes);
+  const std::size_t n = num_sites * static_cast<std::size_t>(haplotypes.ncol());
+  std::vector<int32_t> out(n);
+  for (std::size_t j = 0; j < n; j++) {
+    if (values[j] == NA_INTEGER) {
+      out[j] = TSK_MISSING_DATA;
+    } else if (values[j] < 0 || values[j] >= num_alleles) {
+      Rcpp::stop("%s requires haplotypes to hold allele indexes between 0 "
+                 "and %d or NA",
+                 caller, num_alleles - 1);
+    } else {
+      out[j] = static_cast<int32_t>(values[j]);
+    }
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Validated inputs of the Li and Stephens wrappers
+struct ls_inputs {
+  std::size_t num_sites;
+  std::size_t num_queries;
+  std::vector<int32_t> haplotypes;
+  std::vector<double> recombination_rate;
+  std::vector<double> mutation_rate;
+};
+
+// INTERNAL
+// @title Validate the inputs of the Li and Stephens wrappers
+// @param ts tree sequence
+// @param haplotypes see \code{ls_query_haplotypes()}
+// @param recombination_rate see \code{ls_site_rates()}
+// @param mutation_rate see \code{ls_site_rates()}
+// @param flags validated Li and Stephens options
+// @param caller function name
+// @return Validated inputs.
+ls_inputs ls_validate_inputs(const tsk_treeseq_t *ts,
+                             const Rcpp::IntegerMatrix &haplotypes,
+                             const Rcpp::NumericVector &recombination_rate,
+                             const Rcpp::NumericVector &mutation_rate,
+                             tsk_flags_t flags, const char *caller) {
+  if (tsk_treeseq_get_num_samples(ts) == 0) {
+    Rcpp::stop("%s requires at least one sample", caller);
+  }
+  ls_inputs out;
+  out.num_sites = static_cast<std::size_t>(tsk_treeseq_get_num_sites(ts));
+  out.haplotypes =
+      ls_query_haplotypes(haplotypes, out.num_sites, flags, caller);
+  out.num_queries = static_cast<std::size_t>(haplotypes.ncol());
+  out.recombination_rate = ls_site_rates(recombination_rate, out.num_sites,
+                                         "recombination_rate", caller);
+  out.mutation_rate =
+      ls_site_rates(mutation_rate, out.num_sites, "mutation_rate", caller);
+  return out;
+}
+
+// INTERNAL
+// @title Posterior copying probabilities of a site
+// @details The forward and backward matrices of the Li and Stephens HMM
+//   store each site as value transitions on the tree at the site: a sample
+//   takes the value of its nearest ancestor (or itself) in the transitions.
+//   The posterior of a sample is the product of its forward and backward
+//   values, so on the union of both sets of transition nodes it is the
+//   product of the values that each node inherits. \code{compute()} builds
+//   these transitions (ordered by decreasing node time, so ancestors come
+//   before descendants), counts the samples that inherit each value, drops
+//   nodes that no sample inherits from, and normalises the values to sum to
+//   one over the samples. Memory is proportional to the number of nodes,
+//   not to the number of samples times sites.
+class ls_posterior {
+public:
+  void init(const tsk_treeseq_t *ts) {
+    const std::size_t num_nodes =
+        static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts));
+    time_ = ts->tables->nodes.time;
+    first_.assign(num_nodes, NAN);
+    second_.assign(num_nodes, NAN);
+    count_.assign(num_nodes, 0);
+    in_union_.assign(num_nodes, 0);
+  }
+
+  // Posterior of site from the forward and backward matrices, with tree at
+  // the site
+  void compute(const tsk_tree_t *tree, const tsk_compressed_matrix_t *forward,
+               const tsk_compressed_matrix_t *backward, tsk_id_t site) {
+    union_.clear();
+    add(forward, site, first_);
+    add(backward, site, second_);
+    count_union(tree);
+    nodes_.clear();
+    values_.clear();
+    counts_.clear();
+    double total = 0;
+    for (const tsk_id_t u : union_) {
+      if (count_[u] > 0) {
+        const double p =
+            inherited(tree, first_, u) * inherited(tree, second_, u);
+        nodes_.push_back(u);
+        values_.push_back(p);
+        counts_.push_back(count_[u]);
+        total += count_[u] * p;
+      }
+    }
+    if (total > 0) {
+      for (double &p : values_) {
+        p /= total;
+      }
+    }
+    clear_union();
+  }
+
+  // Posterior probability that the haplotype carries an allele other than
+  // the ancestral state of site, after compute() for the site. As in
+  // tskit, a sample carries the state of its nearest mutation at the site
+  // (later mutations above the same node take precedence).
+  double derived_dosage(const tsk_tree_t *tree, const tsk_site_t *site) {
+    union_.clear();
+    for (std::size_t j = 0; j < nodes_.size(); j++) {
+      first_[nodes_[j]] = values_[j];
+      insert(nodes_[j]);
+    }
+    for (tsk_size_t j = 0; j < site->mutations_length; j++) {
+      const tsk_mutation_t &mut = site->mutations[j];
+      const bool derived =
+          mut.derived_state_length != site->ancestral_state_length ||
+          std::memcmp(mut.derived_state, site->ancestral_state,
+                      site->ancestral_state_length) != 0;
+      second_[mut.node] = derived ? 1 : 0;
+      insert(mut.node);
+    }
+    count_union(tree);
+    double out = 0;
+    for (const tsk_id_t u : union_) {
+      if (count_[u] > 0) {
+        out += count_[u] * inherited(tree, first_, u) *
+               inherited(tree, second_, u);
+      }
+    }
+    clear_union();
+    return std::min(out, 1.0);
+  }
+
+  // Transition nodes, values, and numbers of samples inheriting the values
+  const std::vector<tsk_id_t> &nodes() const { return nodes_; }
+  const std::vector<double> &values() const { return values_; }
+  const std::vector<double> &counts() const { return counts_; }
+
+private:
+  void insert(tsk_id_t u) {
+    if (!in_union_[u]) {
+      in_union_[u] = 1;
+      union_.push_back(u);
+    }
+  }
+
+  void add(const tsk_compressed_matrix_t *matrix, tsk_id_t site,
+           std::vector<double> &values) {
+    for (tsk_size_t j = 0; j < matrix->num_transitions[site]; j++) {
+      const tsk_id_t u = matrix->nodes[site][j];
+      values[u] = matrix->values[site][j];
+      insert(u);
+    }
+  }
+
+  // Sort the union so that ancestors come before descendants and count the
+  // samples inheriting from each node: those below u, but not below another
+  // node of the union below u
+  void count_union(const tsk_tree_t *tree) {
+    std::sort(union_.begin(), union_.end(), [this](tsk_id_t u, tsk_id_t v) {
+      return time_[u] > time_[v] || (time_[u] == time_[v] && u < v);
+    });
+    for (const tsk_id_t u : union_) {
+      count_[u] = static_cast<double>(tree->num_samples[u]);
+    }
+    for (const tsk_id_t u : union_) {
+      tsk_id_t v = tree->parent[u];
+      while (v != TSK_NULL && !in_union_[v]) {
+        v = tree->parent[v];
+      }
+      if (v != TSK_NULL) {
+        count_[v] -= static_cast<double>(tree->num_samples[u]);
+      }
+    }
+  }
+
+  void clear_union() {
+    for (const tsk_id_t u : union_) {
+      first_[u] = NAN;
+      second_[u] = NAN;
+      in_union_[u] = 0;
+    }
+  }
+
+  static double inherited(const tsk_tree_t *tree,
+                          const std::vector<double> &values, tsk_id_t u) {
+    while (u != TSK_NULL && std::isnan(values[u])) {
+      u = tree->parent[u];
+    }
+    return u == TSK_NULL ? 0 : values[u];
+  }
+
+  const double *time_ = NULL;
+  // Node values of the two sets of transitions that are combined
+  std::vector<double> first_;
+  std::vector<double> second_;
+  std::vector<double> count_;
+  std::vector<char> in_union_;
+  std::vector<tsk_id_t> union_;
+  std::vector<tsk_id_t> nodes_;
+  std::vector<double> values_;
+  std::vector<double> counts_;
+};
+
+// Outputs that an ls_hmm_set allocates for each thread: the forward matrix,
+// the forward and backward matrices (with a tree and ls_posterior for
+// posterior decoding), or the Viterbi matrix
+enum class ls_algorithm { forward, forward_backward, viterbi };
+
+// INTERNAL
+// @title A set of Li and Stephens HMMs, one per worker thread
+// @details Each thread needs its own \code{tsk_ls_hmm_t} and output matrix,
+//   because they hold the tree that is moved along the genome and the
+//   per-site state of the current haplotype. The HMMs only read from the
+//   tree sequence, so they can run concurrently. Outputs are reused across
+//   haplotypes (\code{TSK_NO_INIT}), so their memory is allocated once per
+//   thread. Everything is allocated and freed on the calling thread.
+class ls_hmm_set {
+public:
+  struct workspace {
+    tsk_ls_hmm_t hmm;
+    tsk_compressed_matrix_t forward;
+    tsk_compressed_matrix_t backward;
+    tsk_viterbi_matrix_t viterbi;
+    tsk_tree_t tree;
+    ls_posterior posterior;
+  };
+
+  ls_hmm_set(tsk_treeseq_t *ts, std::vector<double> &recombination_rate,
+             std::vector<double> &mutation_rate, tsk_flags_t options,
+             ls_algorithm algorithm, int num_hmms)
+      // value-initialised, so tskit structs that are not used (or not yet
+      // initialised when an init fails) are zeroed and safe to free
+      : workspaces_(static_cast<std::size_t>(num_hmms)),
+        algorithm_(algorithm) {
+    int ret = 0;
+    for (workspace &w : workspaces_) {
+      // tsk_*_init() has to be paired with tsk_*_free() even when it fails
+      num_initialised_++;
+      ret = tsk_ls_hmm_init(&w.hmm, ts, recombination_rate.data(),
+                            mutation_rate.data(), options);
+      if (ret == 0 && algorithm_ == ls_algorithm::viterbi) {
+        ret = tsk_viterbi_matrix_init(&w.viterbi, ts, 0, 0);
+      } else if (ret == 0) {
+        ret = tsk_compressed_matrix_init(&w.forward, ts, 0, 0);
+      }
+      if (ret == 0 && algorithm_ == ls_algorithm::forward_backward) {
+        ret = tsk_compressed_matrix_init(&w.backward, ts, 0, 0);
+        if (ret == 0) {
+          ret = tsk_tree_init(&w.tree, ts, 0);
+        }
+        w.posterior.init(ts);
+      }
+      if (ret != 0) {
+        free();
+        Rcpp::stop(tsk_strerror(ret));
+      }
+    }
+  }
+
+  ~ls_hmm_set() { free(); }
+
+  ls_hmm_set(const ls_hmm_set &) = delete;
+  ls_hmm_set &operator=(const ls_hmm_set &) = delete;
+
+  workspace &get(int thread_index) {
+    return workspaces_[static_cast<std::size_t>(thread_index)];
+  }
+
+private:
+  void free() {
+    for (std::size_t j = 0; j < num_initialised_; j++) {
+      workspace &w = workspaces_[j];
+      tsk_ls_hmm_free(&w.hmm);
+      tsk_compressed_matrix_free(&w.forward);
+      tsk_compressed_matrix_free(&w.backward);
+      tsk_viterbi_matrix_free(&w.viterbi);
+      tsk_tree_free(&w.tree);
+    }
+    num_initialised_ = 0;
+  }
+
+  std::vector<workspace> workspaces_;
+  ls_algorithm algorithm_;
+  std::size_t num_initialised_ = 0;
+};
+
+// INTERNAL
+// @title Run query haplotypes on worker threads
+// @param hmms HMMs, one per thread
+// @param num_threads number of threads
+// @param num_queries number of query haplotypes
+// @param caller function name
+// @param run function called as \code{run(workspace, q)} for query
+//   haplotype \code{q}; returns \code{0} or a \code{tskit} error code
+// @details Haplotypes are handed out one at a time, since each one runs
+//   over all trees and sites. \code{run} runs on worker threads and must not
+//   call the \code{R} API; it should write its output to slot \code{q} only.
+template <typename RunT>
+void run_ls_queries(ls_hmm_set &hmms, int num_threads, std::size_t num_queries,
+                    const char *caller, RunT run) {
+  worker_status status;
+  block_queue queue(num_queries, 1);
+  run_threads(num_threads, status, [&](int thread_index) {
+    ls_hmm_set::workspace &w = hmms.get(thread_index);
+    std::size_t q, stop;
+    while (!status.failed() && queue.next(q, stop)) {
+      int ret = run(w, q);
+      if (ret != 0) {
+        status.fail(std::string(caller) + ": haplotype " +
+                    std::to_string(q + 1) + ": " + tsk_strerror(ret));
+        return;
+      }
+    }
+  });
+  status.stop_if_failed();
+}
+
+// INTERNAL
+// @title Log-likelihood from the per-site normalisation factors
+// @param matrix forward or Viterbi matrix of a haplotype
+// @return Sum of the natural logarithms of the normalisation factors.
+double ls_log_likelihood(const tsk_compressed_matrix_t *matrix) {
+  double out = 0;
+  for (tsk_size_t l = 0; l < matrix->num_sites; l++) {
+    out += std::log(matrix->normalisation_factor[l]);
+  }
+  return out;
+}
+
+// INTERNAL
+// @title A copy of a compressed matrix (or of a posterior) of one haplotype
+// @details Transitions of site \code{l} are \code{node} and \code{value}
+//   entries \code{sum(num_transitions[0:l])} onwards. Worker threads fill
+//   these copies, which the calling thread then wraps for \code{R}.
+struct ls_transitions {
+  std::vector<double> normalisation_factor;
+  std::vector<int> num_transitions;
+  std::vector<int> node;
+  std::vector<double> value;
+
+  void assign(const tsk_compressed_matrix_t *matrix) {
+    const tsk_size_t num_sites = matrix->num_sites;
+    normalisation_factor.assign(matrix->normalisation_factor,
+                                matrix->normalisation_factor + num_sites);
+    num_transitions.resize(num_sites);
+    node.clear();
+    value.clear();
+    for (tsk_size_t l = 0; l < num_sites; l++) {
+      const tsk_size_t n = matrix->num_transitions[l];
+      num_transitions[l] = static_cast<int>(n);
+      node.insert(node.end(), matrix->nodes[l], matrix->nodes[l] + n);
+      value.insert(value.end(), matrix->values[l], matrix->values[l] + n);
+    }
+  }
+
+  void add_site(const ls_posterior &posterior) {
+    num_transitions.push_back(static_cast<int>(posterior.nodes().size()));
+    node.insert(node.end(), posterior.nodes().begin(),
+                posterior.nodes().end());
+    value.insert(value.end(), posterior.values().begin(),
+                 posterior.values().end());
+  }
+
+  // Posteriors have no normalisation factors
+  Rcpp::List wrap() const {
+    Rcpp::IntegerVector n(num_transitions.begin(), num_transitions.end());
+    Rcpp::IntegerVector u(node.begin(), node.end());
+    Rcpp::NumericVector x(value.begin(), value.end());
+    if (normalisation_factor.empty()) {
+      return Rcpp::List::create(Rcpp::_["num_transitions"] = n,
+                                Rcpp::_["node"] = u, Rcpp::_["value"] = x);
+    }
+    return Rcpp::List::create(
+        Rcpp::_["normalisation_factor"] = Rcpp::NumericVector(
+            normalisation_factor.begin(), normalisation_factor.end()),
+        Rcpp::_["num_transitions"] = n, Rcpp::_["node"] = u,
+        Rcpp::_["value"] = x);
+  }
+};
+
+// INTERNAL
+// @title Run the forward and then the backward algorithm on a haplotype
+// @param w workspace of an \code{ls_algorithm::forward_backward} set
+// @param haplotype allele indexes of the haplotype
+// @return \code{0} or a \code{tskit} error code.
+int ls_forward_backward(ls_hmm_set::workspace &w, int32_t *haplotype) {
+  int ret = tsk_ls_hmm_forward(&w.hmm, haplotype, &w.forward, TSK_NO_INIT);
+  if (ret == 0) {
+    ret = tsk_ls_hmm_backward(&w.hmm, haplotype,
+                              w.forward.normalisation_factor, &w.backward,
+                              TSK_NO_INIT);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Visit the posterior of every site after \code{ls_forward_backward()}
+// @param w workspace of an \code{ls_algorithm::forward_backward} set
+// @param visit function called as \code{visit(tree, site)} after
+//   \code{w.posterior} holds the posterior of \code{site}
+// @details Sites are visited in order, moving the tree of the workspace
+//   along the genome.
+// @return \code{0} or a \code{tskit} error code.
+template <typename VisitT>
+int ls_visit_posterior(ls_hmm_set::workspace &w, VisitT visit) {
+  const tsk_site_t *sites;
+  tsk_size_t num_sites;
+  int ret;
+  for (ret = tsk_tree_first(&w.tree); ret == TSK_TREE_OK;
+       ret = tsk_tree_next(&w.tree)) {
+    int site_ret = tsk_tree_get_sites(&w.tree, &sites, &num_sites);
+    if (site_ret != 0) {
+      return site_ret;
+    }
+    for (tsk_size_t j = 0; j < num_sites; j++) {
+      w.posterior.compute(&w.tree, &w.forward, &w.backward, sites[j].id);
+      visit(&w.tree, &sites[j]);
+    }
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Validate the filters of the IBD finder
+// @param min_span segments must be longer than this
+// @param max_time ancestors must be at most this old, \code{NA} for no limit
+// @param caller function name
+// @return \code{max_time}, with \code{NA} as infinity.
+double validate_ibd_filters(double min_span, double max_time,
+                            const char *caller) {
+  if (!(min_span >= 0)) {
+    Rcpp::stop("%s requires a non-negative min_span", caller);
+  }
+  if (std::isnan(max_time)) {
+    return std::numeric_limits<double>::infinity();
+  }
+  if (max_time < 0) {
+    Rcpp::stop("%s requires a non-negative max_time", caller);
+  }
+  return max_time;
+}
+
+// INTERNAL
+// @title Sample sets of the IBD finder
+// @param ts tree sequence
+// @param within integer vector of sample node IDs; \code{NULL} means all
+//   samples (when \code{between} is also \code{NULL})
+// @param between list of integer vectors of sample node IDs
+// @param caller function name
+// @details As in \code{tsk_ibd_finder_init_within()} and
+//   \code{tsk_ibd_finder_init_between()}, samples of \code{within} are in
+//   set 0 and samples of \code{between[[j]]} in set \code{j - 1}.
+// @return The sample set of each node, \code{TSK_NULL} for other nodes.
+std::vector<tsk_id_t>
+ibd_sample_sets(const tsk_treeseq_t *ts,
+                const Rcpp::Nullable<Rcpp::IntegerVector> &within,
+                const Rcpp::Nullable<Rcpp::List> &between,
+                const char *caller) {
+  const tsk_size_t num_nodes = tsk_treeseq_get_num_nodes(ts);
+  std::vector<tsk_id_t> out(static_cast<std::size_t>(num_nodes), TSK_NULL);
+  auto add = [&](const Rcpp::IntegerVector &samples, tsk_id_t set) {
+    for (const int u : samples) {
+      if (u < 0 || static_cast<tsk_size_t>(u) >= num_nodes) {
+        Rcpp::stop("%s: sample IDs must be between 0 and the number of "
+                   "nodes - 1",
+                   caller);
+      }
+      if (out[static_cast<std::size_t>(u)] != TSK_NULL) {
+        Rcpp::stop("%s: sample %d is listed more than once", caller, u);
+      }
+      out[static_cast<std::size_t>(u)] = set;
+    }
+  };
+  if (within.isNotNull() && between.isNotNull()) {
+    Rcpp::stop("%s supports either within or between, not both", caller);
+  }
+  if (between.isNotNull()) {
+    const Rcpp::List sets(between.get());
+    for (R_xlen_t j = 0; j < sets.size(); j++) {
+      add(Rcpp::as<Rcpp::IntegerVector>(sets[j]), static_cast<tsk_id_t>(j));
+    }
+  } else if (within.isNotNull()) {
+    add(within.get(), 0);
+  } else {
+    const tsk_flags_t *flags = ts->tables->nodes.flags;
+    for (std::size_t u = 0; u < out.size(); u++) {
+      if (flags[u] & TSK_NODE_IS_SAMPLE) {
+        out[u] = 0;
+      }
+    }
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Find IBD segments and hand each one to a sink
+// @details This is the algorithm of \code{tsk_ibd_finder_run()} in
+//   \code{tskit C} (\code{tables.c}): edges are processed in order of parent
+//   time, each node keeps the segments of sample ancestry that it carries,
+//   and when a child's ancestry meets the ancestry already at the parent,
+//   the overlaps are IBD segments of the pairs of samples. \code{tskit}
+//   stores every segment (or pair) in an AVL tree keyed by pair, which is
+//   what exhausts memory for many samples; here each segment goes straight
+//   to a sink as it is found, so the caller decides what to keep. The
+//   filters are those of \code{tskit}: segments must be longer than
+//   \code{min_span}, parents must be at most \code{max_time} old, and with
+//   several sample sets the two samples must be in different sets.
+class ibd_finder {
+public:
+  ibd_finder(const tsk_treeseq_t *ts, std::vector<tsk_id_t> sample_set,
+             bool between, double min_span, double max_time)
+      : tables_(ts->tables), sample_set_(std::move(sample_set)),
+        between_(between), min_span_(min_span), max_time_(max_time),
+        ancestry_(sample_set_.size()) {
+    const double L = tables_->sequence_length;
+    for (std::size_t u = 0; u < sample_set_.size(); u++) {
+      if (sample_set_[u] != TSK_NULL) {
+        ancestry_[u].push_back({0, L, static_cast<tsk_id_t>(u)});
+      }
+    }
+  }
+
+  // Calls sink(a, b, left, right, node) for each segment of samples a < b
+  // with most recent common ancestor node; worker threads must not be
+  // interruptible, since checking for an interrupt calls the R API
+  template <typename SinkT> void run(SinkT sink, bool interruptible = true) {
+    const tsk_edge_table_t &edges = tables_->edges;
+    const double *time = tables_->nodes.time;
+    for (tsk_size_t j = 0; j < edges.num_rows; j++) {
+      const tsk_id_t parent = edges.parent[j];
+      if (time[parent] > max_time_) {
+        break;
+      }
+      for (const segment &s : ancestry_[edges.child[j]]) {
+        const double left = std::max(edges.left[j], s.left);
+        const double right = std::min(edges.right[j], s.right);
+        if (right - left > min_span_) {
+          queue_.push_back({left, right, s.node});
+        }
+      }
+      std::vector<segment> &at_parent = ancestry_[parent];
+      for (const segment &x : at_parent) {
+        for (const segment &y : queue_) {
+          const double left = std::max(x.left, y.left);
+          const double right = std::min(x.right, y.right);
+          if (passes(x.node, y.node, left, right)) {
+            sink(std::min(x.node, y.node), std::max(x.node, y.node), left,
+                 right, parent);
+          }
+        }
+      }
+      at_parent.insert(at_parent.end(), queue_.begin(), queue_.end());
+      queue_.clear();
+      if (interruptible && (j + 1) % kInterruptEdges == 0) {
+        Rcpp::checkUserInterrupt();
+      }
+    }
+  }
+
+private:
+  struct segment {
+    double left;
+    double right;
+    tsk_id_t node;
+  };
+
+  static constexpr tsk_size_t kInterruptEdges = 1 << 16;
+
+  bool passes(tsk_id_t a, tsk_id_t b, double left, double right) const {
+    if (a == b || right - left <= min_span_) {
+      return false;
+    }
+    return !between_ || sample_set_[static_cast<std::size_t>(a)] !=
+                            sample_set_[static_cast<std::size_t>(b)];
+  }
+
+  const tsk_table_collection_t *tables_;
+  std::vector<tsk_id_t> sample_set_;
+  bool between_;
+  double min_span_;
+  double max_time_;
+  // Segments of sample ancestry carried by each node
+  std::vector<std::vector<segment>> ancestry_;
+  std::vector<segment> queue_;
+};
+
+// INTERNAL
+// @title Columns of IBD segments
+// @details Collects segments for \code{R}, either all of them or blocks of
+//   them for a callback.
+struct ibd_segment_columns {
+  std::vector<int> a;
+  std::vector<int> b;
+  std::vector<double> left;
+  std::vector<double> right;
+  std::vector<int> node;
+
+  void add(tsk_id_t a_, tsk_id_t b_, double left_, double right_,
+           tsk_id_t node_) {
+    a.push_back(a_);
+    b.push_back(b_);
+    left.push_back(left_);
+    right.push_back(right_);
+    node.push_back(node_);
+  }
+
+  std::size_t size() const { return a.size(); }
+
+  void clear() {
+    a.clear();
+    b.clear();
+    left.clear();
+    right.clear();
+    node.clear();
+  }
+
+  Rcpp::List wrap() const {
+    return Rcpp::List::create(
+        Rcpp::_["a"] = Rcpp::IntegerVector(a.begin(), a.end()),
+        Rcpp::_["b"] = Rcpp::IntegerVector(b.begin(), b.end()),
+        Rcpp::_["left"] = Rcpp::NumericVector(left.begin(), left.end()),
+        Rcpp::_["right"] = Rcpp::NumericVector(right.begin(), right.end()),
+        Rcpp::_["node"] = Rcpp::IntegerVector(node.begin(), node.end()));
+  }
+};
+
+// INTERNAL
+// @title Node sets in the form of the \code{tskit C} statistics
+// @details \code{tskit} takes sets of nodes as an array of pointers to the
+//   sets and an array of set sizes, so we keep the sets alive next to them.
+struct node_sets {
+  std::vector<std::vector<tsk_id_t>> sets;
+  std::vector<const tsk_id_t *> pointers;
+  std::vector<tsk_size_t> sizes;
+};
+
+// INTERNAL
+// @title Convert a list of node ID vectors to node sets
+// @param ts tree sequence
+// @param sets list of integer vectors of node IDs (0-based)
+// @param caller function name
+// @return Node sets, checked to be non-empty, in range, and disjoint.
+node_sets list_to_node_sets(const tsk_treeseq_t *ts, const Rcpp::List &sets,
+                            const char *caller) {
+  if (sets.size() == 0) {
+    Rcpp::stop("%s requires at least one reference set", caller);
+  }
+  const tsk_size_t num_nodes = tsk_treeseq_get_num_nodes(ts);
+  std::vector<char> seen(static_cast<std::size_t>(num_nodes), 0);
+  node_sets out;
+  for (R_xlen_t k = 0; k < sets.size(); k++) {
+    out.sets.push_back(
+        int_vector_to_tsk_id_vector(Rcpp::as<Rcpp::IntegerVector>(sets[k])));
+    for (const tsk_id_t u : out.sets.back()) {
+      if (u < 0 || static_cast<tsk_size_t>(u) >= num_nodes) {
+        Rcpp::stop("%s: node IDs must be between 0 and the number of "
+                   "nodes - 1",
+                   caller);
+      }
+      if (seen[static_cast<std::size_t>(u)]) {
+        Rcpp::stop("%s: node %d is in more than one reference set", caller,
+                   static_cast<int>(u));
+      }
+      seen[static_cast<std::size_t>(u)] = 1;
+    }
+  }
+  for (const std::vector<tsk_id_t> &set : out.sets) {
+    out.pointers.push_back(set.data());
+    out.sizes.push_back(static_cast<tsk_size_t>(set.size()));
+  }
+  return out;
+}
+
+// INTERNAL
+// @title Kendall-Colijn (KC) vectors along the trees of a tree sequence
+// @details This ports the incremental updates of
+//   \code{tsk_treeseq_kc_distance()} in \code{tskit C} (\code{trees.c},
+//   where they are static), but the sweep can start at any tree:
+//   \code{seek()} fills the vectors and node depths of the tree at a position
+//   from scratch, while \code{next()} updates them from the edges that left
+//   and entered the tree, as \code{tskit} does. For each pair of samples,
+//   \code{m} holds the depth (in edges below the root) and \code{M} the time
+//   below the root of their most recent common ancestor; one entry per
+//   sample for its pendant branch follows the pairs.
+class kc_sweep {
+public:
+  explicit kc_sweep(const tsk_treeseq_t *ts)
+      : ts_(ts),
+        n_(static_cast<std::int64_t>(tsk_treeseq_get_num_samples(ts))),
+        num_pairs_(n_ * (n_ - 1) / 2),
+        m_(static_cast<std::size_t>(num_pairs_ + n_)),
+        M_(static_cast<std::size_t>(num_pairs_ + n_)),
+        depths_(static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts))),
+        stack_(depths_.size() + 1) {
+    int ret = tsk_tree_init(&tree_, ts, TSK_SAMPLE_LISTS);
+    if (ret != 0) {
+      tsk_tree_free(&tree_);
+      Rcpp::stop(tsk_strerror(ret));
+    }
+  }
+  ~kc_sweep() { tsk_tree_free(&tree_); }
+  kc_sweep(const kc_sweep &) = delete;
+  kc_sweep &operator=(const kc_sweep &) = delete;
+
+  double right() const { return tree_.interval.right; }
+
+  // Move to the tree at position and fill the vectors from scratch
+  int seek(double position) {
+    int ret = tsk_tree_seek(&tree_, position, 0);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = check();
+    if (ret != 0) {
+      return ret;
+    }
+    fill();
+    return 0;
+  }
+
+  // Move to the next tree and update the vectors from the changed edges
+  int next() {
+    int ret = tsk_tree_next(&tree_);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = check();
+    if (ret != 0) {
+      return ret;
+    }
+    update();
+    return 0;
+  }
+
+  static double distance(const kc_sweep &a, const kc_sweep &b, double lambda) {
+    double sum = 0;
+    for (std::size_t i = 0; i < a.m_.size(); i++) {
+      const double va =
+          static_cast<double>(a.m_[i]) * (1 - lambda) + lambda * a.M_[i];
+      const double vb =
+          static_cast<double>(b.m_[i]) * (1 - lambda) + lambda * b.M_[i];
+      sum += (va - vb) * (va - vb);
+    }
+    return std::sqrt(sum);
+  }
+
+private:
+  // The checks of tsk_tree_kc_distance(): one root and no unary nodes
+  int check() const {
+    if (tsk_tree_get_num_roots(&tree_) != 1) {
+      return TSK_ERR_MULTIPLE_ROOTS;
+    }
+    for (std::size_t u = 0; u < depths_.size(); u++) {
+      const tsk_id_t c = tree_.left_child[u];
+      if (c != TSK_NULL && c == tree_.right_child[u]) {
+        return TSK_ERR_UNARY_NODES;
+      }
+    }
+    return 0;
+  }
+
+  double branch_length(tsk_id_t u) const {
+    const tsk_id_t p = tree_.parent[u];
+    const double *times = ts_->tables->nodes.time;
+    return p == TSK_NULL ? 0 : times[p] - times[u];
+  }
+
+  tsk_id_t top(tsk_id_t u) const {
+    while (tree_.parent[u] != TSK_NULL) {
+      u = tree_.parent[u];
+    }
+    return u;
+  }
+
+  void set_sample(tsk_id_t u, double time) {
+    const std::int64_t i = ts_->sample_index_map[u];
+    m_[static_cast<std::size_t>(num_pairs_ + i)] = 1;
+    M_[static_cast<std::size_t>(num_pairs_ + i)] = time;
+  }
+
+  // Set the MRCA of all pairs of samples below u and v
+  void set_pairs(tsk_id_t u, tsk_id_t v, tsk_size_t depth, double time) {
+    const tsk_id_t *left_sample = tree_.left_sample;
+    const tsk_id_t *right_sample = tree_.right_sample;
+    const tsk_id_t *next_sample = tree_.next_sample;
+    for (tsk_id_t i = left_sample[u]; i != TSK_NULL; i = next_sample[i]) {
+      for (tsk_id_t j = left_sample[v]; j != TSK_NULL; j = next_sample[j]) {
+        const std::int64_t n1 = std::min(i, j);
+        const std::int64_t n2 = std::max(i, j);
+        const std::size_t pair =
+            static_cast<std::size_t>(n2 - n1 - 1 + n1 * (2 * n_ - n1 - 1) / 2);
+        m_[pair] = depth;
+        M_[pair] = time;
+        if (j == right_sample[v]) {
+          break;
+        }
+      }
+      if (i == right_sample[u]) {
+        break;
+      }
+    }
+  }
+
+  void fill() {
+    const double *times = ts_->tables->nodes.time;
+    std::fill(m_.begin(), m_.end(), 0);
+    std::fill(M_.begin(), M_.end(), 0);
+    // Depths are counted from the top of every subtree, including those
+    // without samples, as the incremental updates in next() expect
+    std::fill(depths_.begin(), depths_.end(), 0);
+    for (std::size_t v = 0; v < depths_.size(); v++) {
+      if (tree_.parent[v] != TSK_NULL) {
+        continue;
+      }
+      int stack_top = 0;
+      stack_[0] = static_cast<tsk_id_t>(v);
+      while (stack_top >= 0) {
+        const tsk_id_t u = stack_[static_cast<std::size_t>(stack_top--)];
+        for (tsk_id_t c = tree_.left_child[u]; c != TSK_NULL;
+             c = tree_.right_sib[c]) {
+          depths_[static_cast<std::size_t>(c)] =
+              depths_[static_cast<std::size_t>(u)] + 1;
+          stack_[static_cast<std::size_t>(++stack_top)] = c;
+        }
+      }
+    }
+    // fill_kc_vectors() of tskit
+    const tsk_id_t root = tsk_tree_get_left_root(&tree_);
+    int stack_top = 0;
+    stack_[0] = root;
+    while (stack_top >= 0) {
+      const tsk_id_t u = stack_[static_cast<std::size_t>(stack_top--)];
+      if (tsk_tree_is_sample(&tree_, u)) {
+        set_sample(u, branch_length(u));
+      }
+      if (tree_.left_sample[u] == TSK_NULL) {
+        continue;
+      }
+      const tsk_size_t depth = depths_[static_cast<std::size_t>(u)];
+      const double time = times[root] - times[u];
+      for (tsk_id_t c1 = tree_.left_child[u]; c1 != TSK_NULL;
+           c1 = tree_.right_sib[c1]) {
+        stack_[static_cast<std::size_t>(++stack_top)] = c1;
+        for (tsk_id_t c2 = tree_.right_sib[c1]; c2 != TSK_NULL;
+             c2 = tree_.right_sib[c2]) {
+          set_pairs(c1, c2, depth, time);
+        }
+      }
+    }
+  }
+
+  // update_kc_pair_with_sample() of tskit
+  void update_sample_pairs(tsk_id_t sample, double root_time) {
+    const double *times = ts_->tables->nodes.time;
+    tsk_id_t c = sample;
+    for (tsk_id_t p = tree_.parent[sample]; p != TSK_NULL;
+         p = tree_.parent[p]) {
+      const double time = root_time - times[p];
+      const tsk_size_t depth = depths_[static_cast<std::size_t>(p)];
+      for (tsk_id_t sib = tree_.left_child[p]; sib != TSK_NULL;
+           sib = tree_.right_sib[sib]) {
+        if (sib != c) {
+          set_pairs(sample, sib, depth, time);
+        }
+      }
+      c = p;
+    }
+  }
+
+  // update_kc_subtree_state() of tskit
+  void update_subtree(tsk_id_t u, double root_time) {
+    int stack_top = 0;
+    stack_[0] = u;
+    while (stack_top >= 0) {
+      const tsk_id_t v = stack_[static_cast<std::size_t>(stack_top--)];
+      if (tsk_tree_is_sample(&tree_, v)) {
+        update_sample_pairs(v, root_time);
+      }
+      for (tsk_id_t c = tree_.left_child[v]; c != TSK_NULL;
+           c = tree_.right_sib[c]) {
+        if (depths_[static_cast<std::size_t>(c)] != 0) {
+          depths_[static_cast<std::size_t>(c)] =
+              depths_[static_cast<std::size_t>(v)] + 1;
+          stack_[static_cast<std::size_t>(++stack_top)] = c;
+        }
+      }
+    }
+  }
+
+  // update_kc_incremental() of tskit
+  void update() {
+    const double *times = ts_->tables->nodes.time;
+    const tsk_id_t *edges_child = ts_->tables->edges.child;
+    const tsk_id_t *edges_parent = ts_->tables->edges.parent;
+    const tsk_tree_position_t &pos = tree_.tree_pos;
+    for (tsk_id_t j = pos.out.stop - 1; j >= pos.out.start; j--) {
+      const tsk_id_t u = edges_child[pos.out.order[j]];
+      depths_[static_cast<std::size_t>(u)] = 0;
+      if (tree_.parent[u] == TSK_NULL) {
+        update_subtree(u, times[top(u)]);
+      }
+    }
+    for (tsk_id_t j = pos.in.stop - 1; j >= pos.in.start; j--) {
+      const tsk_id_t e = pos.in.order[j];
+      const tsk_id_t u = edges_child[e];
+      depths_[static_cast<std::size_t>(u)] =
+          depths_[static_cast<std::size_t>(edges_parent[e])] + 1;
+      update_subtree(u, times[top(u)]);
+      if (tsk_tree_is_sample(&tree_, u)) {
+        set_sample(u, branch_length(u));
+      }
+    }
+  }
+
+  const tsk_treeseq_t *ts_;
+  std::int64_t n_;
+  std::int64_t num_pairs_;
+  std::vector<tsk_size_t> m_;
+  std::vector<double> M_;
+  std::vector<tsk_size_t> depths_;
+  std::vector<tsk_id_t> stack_;
+  tsk_tree_t tree_;
+};
+
+// INTERNAL
+// @title Sort on worker threads
+// @param x values to sort
+// @param num_threads number of threads
+// @param status shared worker status
+// @details Each thread sorts a contiguous chunk of \code{x} and neighbouring
+//   sorted chunks are then merged in rounds, the merges of a round running in
+//   parallel. Both steps are stable, so equal values keep their order. This
+//   is called from worker threads too, so it must not call the \code{R} API.
+template <typename T>
+void parallel_sort(std::vector<T> &x, int num_threads, worker_status &status) {
+  const std::size_t num_chunks = static_cast<std::size_t>(
+      std::max(1, std::min(num_threads, static_cast<int>(x.size() / 1024))));
+  std::vector<std::size_t> bounds(num_chunks + 1);
+  for (std::size_t k = 0; k <= num_chunks; k++) {
+    bounds[k] = k * x.size() / num_chunks;
+  }
+  run_threads(static_cast<int>(num_chunks), status, [&](int thread_index) {
+    const std::size_t k = static_cast<std::size_t>(thread_index);
+    std::stable_sort(x.begin() + static_cast<std::ptrdiff_t>(bounds[k]),
+                     x.begin() + static_cast<std::ptrdiff_t>(bounds[k + 1]));
+  });
+  for (std::size_t width = 1; width < num_chunks && !status.failed();
+       width *= 2) {
+    const std::size_t num_merges = (num_chunks + 2 * width - 1) / (2 * width);
+    block_queue queue(num_merges, 1);
+    run_threads(static_cast<int>(num_merges), status, [&](int) {
+      std::size_t m, stop;
+      while (queue.next(m, stop)) {
+        const std::size_t first = 2 * width * m;
+        const std::size_t middle = std::min(first + width, num_chunks);
+        const std::size_t last = std::min(first + 2 * width, num_chunks);
+        std::inplace_merge(
+            x.begin() + static_cast<std::ptrdiff_t>(bounds[first]),
+            x.begin() + static_cast<std::ptrdiff_t>(bounds[middle]),
+            x.begin() + static_cast<std::ptrdiff_t>(bounds[last]));
+      }
+    });
+  }
+}
+
+// INTERNAL
+// @title Sort key of an edge in the edge insertion or removal order
+// @details Edges are inserted in order of increasing left, parent time,
+//   parent, and child, and removed in order of increasing right and
+//   decreasing parent time, parent, and child (see
+//   \code{tsk_table_collection_build_index()}), so the removal keys hold
+//   negated values. Ties are broken by edge ID.
+struct edge_index_key {
+  double position;
+  double time;
+  tsk_id_t parent;
+  tsk_id_t child;
+  tsk_id_t edge;
+
+  bool operator<(const edge_index_key &other) const {
+    if (position != other.position) {
+      return position < other.position;
+    }
+    if (time != other.time) {
+      return time < other.time;
+    }
+    if (parent != other.parent) {
+      return parent < other.parent;
+    }
+    if (child != other.child) {
+      return child < other.child;
+    }
+    return edge < other.edge;
+  }
+};
+
+// INTERNAL
+// @title Edge order of an edge index
+// @param tc table collection with edges sorted as \code{tskit} requires
+// @param insertion build the insertion order (else the removal order)
+// @param num_indexed number of edges at the start of the edge table that
+//   are already in \code{order}
+// @param order the order of the first \code{num_indexed} edges on input,
+//   the order of all edges on output
+// @param num_threads number of threads
+// @param status shared worker status
+// @details The edges after the indexed ones are sorted on their own and
+//   then merged with the indexed ones. The indexed edges may have changed
+//   since the index was built, so \code{order} is first checked to still be
+//   a sorted permutation of the first \code{num_indexed} edges; if it is
+//   not, all edges are sorted. This is called from worker threads, so it
+//   must not call the \code{R} API.
+void edge_index_order(const tsk_table_collection_t *tc, bool insertion,
+                      std::size_t num_indexed, std::vector<tsk_id_t> &order,
+                      int num_threads, worker_status &status) {
+  const tsk_edge_table_t &edges = tc->edges;
+  const double *time = tc->nodes.time;
+  const double *position = insertion ? edges.left : edges.right;
+  const double sign = insertion ? 1 : -1;
+  auto key = [&](tsk_id_t e) {
+    const tsk_id_t parent = edges.parent[e];
+    const tsk_id_t child = edges.child[e];
+    return edge_index_key{position[e], sign * time[parent],
+                          insertion ? parent : -parent,
+                          insertion ? child : -child, e};
+  };
+  std::vector<bool> seen(num_indexed, false);
+  for (std::size_t i = 0; i < num_indexed; i++) {
+    const std::size_t e = static_cast<std::size_t>(order[i]);
+    if (e >= num_indexed || seen[e] ||
+        (i > 0 && !(key(order[i - 1]) < key(order[i])))) {
+      num_indexed = 0;
+      order.clear();
+      break;
+    }
+    seen[e] = true;
+  }
+  const std::size_t num_edges = static_cast<std::size_t>(edges.num_rows);
+  std::vector<edge_index_key> added;
+  added.reserve(num_edges - num_indexed);
+  for (std::size_t e = num_indexed; e < num_edges; e++) {
+    added.push_back(key(static_cast<tsk_id_t>(e)));
+  }
+  parallel_sort(added, num_threads, status);
+  std::vector<tsk_id_t> merged;
+  merged.reserve(num_edges);
+  std::size_t i = 0;
+  for (const edge_index_key &a : added) {
+    while (i < num_indexed && key(order[i]) < a) {
+      merged.push_back(order[i++]);
+    }
+    merged.push_back(a.edge);
+  }
+  merged.insert(merged.end(), order.begin() + static_cast<std::ptrdiff_t>(i),
+                order.begin() + static_cast<std::ptrdiff_t>(num_indexed));
+  order.swap(merged);
+}
+
+// INTERNAL
+// @title Copy the tables that define the topology of a tree sequence
+// @param self table collection to copy
+// @param dest uninitialised table collection
+// @details This follows \code{tsk_table_collection_copy()}, but skips the
+//   site and mutation tables and the reference sequence, so that
+//   \code{tsk_treeseq_init()} has no sites or mutations to index. The
+//   individual table is kept, because nodes refer to it.
+// @return 0 or a \code{tskit} error code; \code{dest} has to be freed with
+//   \code{tsk_table_collection_free()} either way.
+int copy_topology_tables(const tsk_table_collection_t *self,
+                         tsk_table_collection_t *dest) {
+  int ret = tsk_table_collection_init(dest, 0);
+  if (ret == 0) {
+    ret = tsk_node_table_copy(&self->nodes, &dest->nodes, TSK_NO_INIT);
+  }
+  if (ret == 0) {
+    ret = tsk_edge_table_copy(&self->edges, &dest->edges, TSK_NO_INIT);
+  }
+  if (ret == 0) {
+    ret = tsk_migration_table_copy(&self->migrations, &dest->migrations,
+                                   TSK_NO_INIT);
+  }
+  if (ret == 0) {
+    ret = tsk_individual_table_copy(&self->individuals, &dest->individuals,
+                                    TSK_NO_INIT);
+  }
+  if (ret == 0) {
+    ret = tsk_population_table_copy(&self->populations, &dest->populations,
+                                    TSK_NO_INIT);
+  }
+  if (ret == 0) {
+    ret = tsk_provenance_table_copy(&self->provenances, &dest->provenances,
+                                    TSK_NO_INIT);
+  }
+  if (ret != 0) {
+    return ret;
+  }
+  dest->sequence_length = self->sequence_length;
+  if (tsk_table_collection_has_index(self, 0)) {
+    ret = tsk_table_collection_set_indexes(dest,
+                                           self->indexes.edge_insertion_order,
+                                           self->indexes.edge_removal_order);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_set_time_units(dest, self->time_units,
+                                              self->time_units_length);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_set_metadata(dest, self->metadata,
+                                            self->metadata_length);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_set_metadata_schema(
+        dest, self->metadata_schema, self->metadata_schema_length);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Tag of the external pointer of a topology-only tree sequence
+// @details \code{rtsk_treeseq_init(topology_only = true)} sets this tag, so
+//   that functions that need sites, mutations, or the reference sequence
+//   can tell a tree sequence without them apart from one that has none.
+SEXP topology_only_tag() { return Rf_install("RcppTskit_topology_only"); }
+
+// INTERNAL
+// @title Raise an error for a topology-only tree sequence
+// @param ts an external pointer to tree sequence (already checked to be one)
+// @param caller function name for the error message
+void require_sites(SEXP ts, const char *caller) {
+  if (R_ExternalPtrTag(ts) == topology_only_tag()) {
+    Rcpp::stop("%s does not support a tree sequence initialised with "
+               "topology_only, which has no sites, mutations, or reference "
+               "sequence",
+               caller);
+  }
+}
+
+// INTERNAL
+// @title Extend the haplotypes of a tree sequence
+// @details This ports \code{tsk_treeseq_extend_haplotypes()} in
+//   \code{tskit C} (\code{trees.c}, where the haplotype extender is static).
+//   \code{tskit} sets up a new extender with a new block allocator for its
+//   lists of edges in each pass and copies all tables for each new tree
+//   sequence. Here one extender keeps its per-node arrays, an arena of list
+//   entries, the working edge table, and the buffer of rows to keep over all
+//   passes, and the tree sequence of each pass takes ownership of a single
+//   copy of the tables, of which the edge table is swapped with the working
+//   edge table, sorted, and indexed after the pass. The passes, and so the
+//   output, are the same as in \code{tskit}.
+class haplotype_extender {
+public:
+  explicit haplotype_extender(const tsk_treeseq_t *ts)
+      : input_(ts), tables_(nullptr), direction_(TSK_DIR_FORWARD),
+        num_nodes_(static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts))),
+        last_degree_(num_nodes_), next_degree_(num_nodes_),
+        last_nodes_edge_(num_nodes_), next_nodes_edge_(num_nodes_),
+        parent_out_(num_nodes_), parent_in_(num_nodes_),
+        not_sample_(num_nodes_) {
+    std::memset(&ts_, 0, sizeof(ts_));
+    std::memset(&edges_, 0, sizeof(edges_));
+    std::memset(&mutations_, 0, sizeof(mutations_));
+    const tsk_flags_t *flags = ts->tables->nodes.flags;
+    for (std::size_t j = 0; j < num_nodes_; j++) {
+      not_sample_[j] = (flags[j] & TSK_NODE_IS_SAMPLE) == 0;
+    }
+  }
+  ~haplotype_extender() {
+    // Frees the tables when the tree sequence owns them
+    tsk_treeseq_free(&ts_);
+    if (tables_ != nullptr) {
+      tsk_table_collection_free(tables_);
+      tsk_safe_free(tables_);
+    }
+    tsk_edge_table_free(&edges_);
+    tsk_mutation_table_free(&mutations_);
+  }
+  haplotype_extender(const haplotype_extender &) = delete;
+  haplotype_extender &operator=(const haplotype_extender &) = delete;
+
+  // Run up to max_iter forward and backward passes; on success output
+  // takes ownership of the extended tree sequence
+  int run(int max_iter, tsk_treeseq_t *output) {
+    if (max_iter <= 0) {
+      return TSK_ERR_EXTEND_EDGES_BAD_MAXITER;
+    }
+    if (tsk_treeseq_get_num_migrations(input_) != 0) {
+      return TSK_ERR_MIGRATIONS_NOT_SUPPORTED;
+    }
+    tables_ = static_cast<tsk_table_collection_t *>(
+        tsk_malloc(sizeof(tsk_table_collection_t)));
+    if (tables_ == nullptr) {
+      return TSK_ERR_NO_MEMORY;
+    }
+    int ret = tsk_table_collection_copy(input_->tables, tables_, 0);
+    if (ret == 0) {
+      ret = tsk_mutation_table_clear(&tables_->mutations);
+    }
+    if (ret == 0) {
+      ret = tsk_edge_table_init(&edges_, 0);
+    }
+    if (ret == 0) {
+      ret = give_tables(0);
+    }
+    if (ret != 0) {
+      return ret;
+    }
+    const int direction[] = {TSK_DIR_FORWARD, TSK_DIR_REVERSE};
+    tsk_size_t last_num_edges = tsk_treeseq_get_num_edges(&ts_);
+    for (int iter = 0; iter < max_iter; iter++) {
+      for (const int dir : direction) {
+        ret = extend_paths(dir);
+        if (ret != 0) {
+          return ret;
+        }
+        take_tables();
+        std::swap(tables_->edges, edges_);
+        // No need to sort sites and mutations
+        tsk_bookmark_t sort_start;
+        std::memset(&sort_start, 0, sizeof(sort_start));
+        sort_start.sites = tables_->sites.num_rows;
+        sort_start.mutations = tables_->mutations.num_rows;
+        ret = tsk_table_collection_sort(tables_, &sort_start, 0);
+        if (ret == 0) {
+          ret = give_tables(TSK_TS_INIT_BUILD_INDEXES);
+        }
+        if (ret != 0) {
+          return ret;
+        }
+      }
+      if (last_num_edges == tsk_treeseq_get_num_edges(&ts_)) {
+        break;
+      }
+      last_num_edges = tsk_treeseq_get_num_edges(&ts_);
+    }
+    // Remap mutation nodes
+    ret = tsk_mutation_table_copy(&input_->tables->mutations, &mutations_, 0);
+    if (ret == 0) {
+      ret = slide_mutation_nodes_up();
+    }
+    if (ret != 0) {
+      return ret;
+    }
+    take_tables();
+    std::swap(tables_->mutations, mutations_);
+    ret = give_tables(TSK_TS_INIT_BUILD_INDEXES);
+    if (ret != 0) {
+      return ret;
+    }
+    std::memcpy(output, &ts_, sizeof(ts_));
+    std::memset(&ts_, 0, sizeof(ts_));
+    return 0;
+  }
+
+private:
+  // An entry of a list of edges; extended records whether the edge is
+  // extended to the current tree (2 for an edge added in this tree)
+  struct edge_entry {
+    tsk_id_t edge;
+    int extended;
+    int next;
+  };
+  // A list of edges as indices of its first and last entry in the arena
+  struct edge_list {
+    int head = -1;
+    int tail = -1;
+  };
+
+  // Take the tables back from the tree sequence of the last pass
+  void take_tables() {
+    tables_ = ts_.tables;
+    ts_.tables = nullptr;
+    tsk_treeseq_free(&ts_);
+    std::memset(&ts_, 0, sizeof(ts_));
+  }
+
+  // Hand the tables over to a new tree sequence
+  int give_tables(tsk_flags_t flags) {
+    tsk_table_collection_t *tables = tables_;
+    tables_ = nullptr;
+    return tsk_treeseq_init(&ts_, tables, flags | TSK_TAKE_OWNERSHIP);
+  }
+
+  double *near_side() {
+    return direction_ == TSK_DIR_FORWARD ? edges_.left : edges_.right;
+  }
+  double *far_side() {
+    return direction_ == TSK_DIR_FORWARD ? edges_.right : edges_.left;
+  }
+
+  void append(edge_list &list, tsk_id_t edge, int extended) {
+    const int x = static_cast<int>(pool_.size());
+    pool_.push_back({edge, extended, -1});
+    if (list.tail == -1) {
+      list.head = x;
+    } else {
+      pool_[list.tail].next = x;
+    }
+    list.tail = x;
+  }
+
+  // Drop the entries that were not extended and reset the flag of the rest
+  void remove_unextended(edge_list &list) {
+    int px = list.head;
+    while (px != -1 && pool_[px].extended == 0) {
+      px = pool_[px].next;
+    }
+    list.head = px;
+    if (px != -1) {
+      pool_[px].extended = 0;
+      for (int x = pool_[px].next; x != -1; x = pool_[x].next) {
+        if (pool_[x].extended > 0) {
+          pool_[x].extended = 0;
+          pool_[px].next = x;
+          px = x;
+        }
+      }
+      pool_[px].next = -1;
+    }
+    list.tail = px;
+  }
+
+  int set_extended(const edge_list &list, tsk_id_t edge) {
+    for (int x = list.head; x != -1; x = pool_[x].next) {
+      if (pool_[x].edge == edge) {
+        pool_[x].extended = 1;
+        return 0;
+      }
+    }
+    return TSK_ERR_GENERIC;
+  }
+
+  // Update the state with the edges that leave and enter the next tree
+  void next_tree(const tsk_tree_position_t &tree_pos) {
+    const tsk_id_t *child = edges_.child;
+    const tsk_id_t *parent = edges_.parent;
+    for (int x = out_.head; x != -1; x = pool_[x].next) {
+      const tsk_id_t e = pool_[x].edge;
+      parent_out_[child[e]] = TSK_NULL;
+      if (pool_[x].extended > 1) {
+        last_nodes_edge_[child[e]] = e;
+        last_degree_[child[e]]++;
+        last_degree_[parent[e]]++;
+      } else if (pool_[x].extended == 0) {
+        last_nodes_edge_[child[e]] = TSK_NULL;
+        last_degree_[child[e]]--;
+        last_degree_[parent[e]]--;
+      }
+    }
+    remove_unextended(out_);
+    for (int x = in_.head; x != -1; x = pool_[x].next) {
+      const tsk_id_t e = pool_[x].edge;
+      parent_in_[child[e]] = TSK_NULL;
+      if (pool_[x].extended == 0 && near_side()[e] != far_side()[e]) {
+        last_nodes_edge_[child[e]] = e;
+        last_degree_[child[e]]++;
+        last_degree_[parent[e]]++;
+      }
+    }
+    remove_unextended(in_);
+
+    for (tsk_id_t j = tree_pos.out.start; j != tree_pos.out.stop;
+         j += direction_) {
+      const tsk_id_t e = tree_pos.out.order[j];
+      if (near_side()[e] != far_side()[e]) {
+        append(out_, e, 0);
+      }
+    }
+    for (int x = out_.head; x != -1; x = pool_[x].next) {
+      const tsk_id_t e = pool_[x].edge;
+      parent_out_[child[e]] = parent[e];
+      next_nodes_edge_[child[e]] = TSK_NULL;
+      next_degree_[child[e]]--;
+      next_degree_[parent[e]]--;
+    }
+    for (tsk_id_t j = tree_pos.in.start; j != tree_pos.in.stop;
+         j += direction_) {
+      append(in_, tree_pos.in.order[j], 0);
+    }
+    for (int x = in_.head; x != -1; x = pool_[x].next) {
+      const tsk_id_t e = pool_[x].edge;
+      parent_in_[child[e]] = parent[e];
+      next_nodes_edge_[child[e]] = e;
+      next_degree_[child[e]]++;
+      next_degree_[parent[e]]++;
+    }
+  }
+
+  int add_or_extend_edge(tsk_id_t new_parent, tsk_id_t child, double left,
+                         double right) {
+    const double there = direction_ == TSK_DIR_FORWARD ? right : left;
+    const tsk_id_t old_edge = next_nodes_edge_[child];
+    const tsk_id_t old_parent =
+        old_edge != TSK_NULL ? edges_.parent[old_edge] : TSK_NULL;
+    if (new_parent == old_parent) {
+      return 0;
+    }
+    tsk_id_t e_out;
+    if (parent_out_[child] == new_parent) {
+      // The new edge is in the edges out, so extend it
+      e_out = last_nodes_edge_[child];
+      far_side()[e_out] = there;
+      const int ret = set_extended(out_, e_out);
+      if (ret != 0) {
+        return ret;
+      }
+    } else {
+      e_out = tsk_edge_table_add_row(&edges_, left, right, new_parent, child,
+                                     NULL, 0);
+      if (e_out < 0) {
+        return static_cast<int>(e_out);
+      }
+      append(out_, e_out, 2);
+    }
+    next_nodes_edge_[child] = e_out;
+    next_degree_[child]++;
+    next_degree_[new_parent]++;
+    parent_out_[child] = TSK_NULL;
+    if (old_edge != TSK_NULL) {
+      for (int x = in_.head; x != -1; x = pool_[x].next) {
+        const tsk_id_t e_in = pool_[x].edge;
+        if (e_in == old_edge) {
+          near_side()[e_in] = there;
+          if (far_side()[e_in] != there) {
+            pool_[x].extended = 1;
+          }
+          next_degree_[child]--;
+          next_degree_[parent_in_[child]]--;
+          parent_in_[child] = TSK_NULL;
+        }
+      }
+    }
+    return 0;
+  }
+
+  // Number of new edges needed to merge the paths up from c in the last
+  // and the next tree, or infinity if they can not be merged (a float as in
+  // tskit, so that the order of merges is the same)
+  float mergeable(tsk_id_t c) const {
+    const double *time = ts_.tables->nodes.time;
+    tsk_id_t p_out = parent_out_[c];
+    tsk_id_t p_in = parent_in_[c];
+    double t_out = p_out == TSK_NULL ? INFINITY : time[p_out];
+    double t_in = p_in == TSK_NULL ? INFINITY : time[p_in];
+    tsk_id_t child = c;
+    float num_new_edges = 0;
+    int num_extended = 0;
+    while (true) {
+      const bool climb_in = p_in != TSK_NULL && last_degree_[p_in] == 0 &&
+                            not_sample_[p_in] && t_in < t_out;
+      const bool climb_out = p_out != TSK_NULL && next_degree_[p_out] == 0 &&
+                             not_sample_[p_out] && t_out < t_in;
+      if (climb_in) {
+        if (parent_in_[child] != p_in) {
+          num_new_edges += 1;
+        }
+        child = p_in;
+        p_in = parent_in_[p_in];
+        t_in = p_in == TSK_NULL ? INFINITY : time[p_in];
+      } else if (climb_out) {
+        if (parent_out_[child] != p_out) {
+          num_new_edges += 1;
+        }
+        child = p_out;
+        p_out = parent_out_[p_out];
+        t_out = p_out == TSK_NULL ? INFINITY : time[p_out];
+        num_extended++;
+      } else {
+        break;
+      }
+    }
+    if (num_extended == 0 || p_in != p_out || p_in == TSK_NULL) {
+      num_new_edges = INFINITY;
+    }
+    return num_new_edges;
+  }
+
+  int merge_paths(tsk_id_t c, double left, double right) {
+    const double *time = ts_.tables->nodes.time;
+    tsk_id_t p_out = parent_out_[c];
+    tsk_id_t p_in = parent_in_[c];
+    double t_out = time[p_out];
+    double t_in = time[p_in];
+    tsk_id_t child = c;
+    int ret = 0;
+    while (ret == 0) {
+      const bool climb_in = p_in != TSK_NULL && last_degree_[p_in] == 0 &&
+                            not_sample_[p_in] && t_in < t_out;
+      const bool climb_out = p_out != TSK_NULL && next_degree_[p_out] == 0 &&
+                             not_sample_[p_out] && t_out < t_in;
+      if (climb_in) {
+        ret = add_or_extend_edge(p_in, child, left, right);
+        child = p_in;
+        p_in = parent_in_[p_in];
+        t_in = p_in == TSK_NULL ? INFINITY : time[p_in];
+      } else if (climb_out) {
+        ret = add_or_extend_edge(p_out, child, left, right);
+        child = p_out;
+        p_out = parent_out_[p_out];
+        t_out = p_out == TSK_NULL ? INFINITY : time[p_out];
+      } else {
+        break;
+      }
+    }
+    return ret != 0 ? ret : add_or_extend_edge(p_out, child, left, right);
+  }
+
+  // One pass along the genome, which writes the extended edges to the
+  // working edge table
+  int extend_paths(int direction) {
+    direction_ = direction;
+    int ret = tsk_edge_table_copy(&ts_.tables->edges, &edges_, TSK_NO_INIT);
+    if (ret != 0) {
+      return ret;
+    }
+    std::fill(last_degree_.begin(), last_degree_.end(), 0);
+    std::fill(next_degree_.begin(), next_degree_.end(), 0);
+    std::fill(last_nodes_edge_.begin(), last_nodes_edge_.end(), TSK_NULL);
+    std::fill(next_nodes_edge_.begin(), next_nodes_edge_.end(), TSK_NULL);
+    std::fill(parent_out_.begin(), parent_out_.end(), TSK_NULL);
+    std::fill(parent_in_.begin(), parent_in_.end(), TSK_NULL);
+    pool_.clear();
+    out_ = edge_list();
+    in_ = edge_list();
+
+    tsk_tree_position_t tree_pos;
+    ret = tsk_tree_position_init(&tree_pos, &ts_, 0);
+    if (ret != 0) {
+      return ret;
+    }
+    bool valid = direction_ == TSK_DIR_FORWARD
+                     ? tsk_tree_position_next(&tree_pos)
+                     : tsk_tree_position_prev(&tree_pos);
+    while (valid) {
+      const double left = tree_pos.interval.left;
+      const double right = tree_pos.interval.right;
+      next_tree(tree_pos);
+      float max_new_edges = 0;
+      float next_max_new_edges = INFINITY;
+      while (max_new_edges < INFINITY) {
+        for (int x = in_.head; x != -1; x = pool_[x].next) {
+          const tsk_id_t c = edges_.child[pool_[x].edge];
+          if (last_degree_[c] > 0) {
+            const float ne = mergeable(c);
+            if (ne <= max_new_edges) {
+              ret = merge_paths(c, left, right);
+              if (ret != 0) {
+                return ret;
+              }
+            } else {
+              next_max_new_edges = std::min(ne, next_max_new_edges);
+            }
+          }
+        }
+        max_new_edges = next_max_new_edges;
+        next_max_new_edges = INFINITY;
+      }
+      valid = direction_ == TSK_DIR_FORWARD ? tsk_tree_position_next(&tree_pos)
+                                            : tsk_tree_position_prev(&tree_pos);
+    }
+    // Get rid of adjacent, identical edges
+    const tsk_size_t num_edges = edges_.num_rows;
+    for (tsk_size_t e = 0; e + 1 < num_edges; e++) {
+      if (edges_.parent[e] == edges_.parent[e + 1] &&
+          edges_.child[e] == edges_.child[e + 1] &&
+          edges_.right[e] == edges_.left[e + 1]) {
+        edges_.right[e] = edges_.right[e + 1];
+        edges_.left[e + 1] = edges_.right[e + 1];
+      }
+    }
+    keep_.resize(num_edges);
+    for (tsk_size_t e = 0; e < num_edges; e++) {
+      keep_[e] = edges_.left[e] < edges_.right[e];
+    }
+    return tsk_edge_table_keep_rows(&edges_, keep_.data(), 0, NULL);
+  }
+
+  // Move each mutation up to the oldest node below it on its branch; this
+  // ports tsk_treeseq_slide_mutation_nodes_up(), which is static in tskit
+  int slide_mutation_nodes_up() {
+    const double *position = ts_.tables->sites.position;
+    const double *time = ts_.tables->nodes.time;
+    tsk_tree_t tree;
+    int ret = tsk_tree_init(&tree, &ts_, TSK_NO_SAMPLE_COUNTS);
+    tsk_id_t next_mut = 0;
+    const tsk_id_t num_mutations =
+        static_cast<tsk_id_t>(mutations_.num_rows);
+    if (ret == 0) {
+      ret = tsk_tree_first(&tree);
+    }
+    while (ret == TSK_TREE_OK) {
+      while (next_mut < num_mutations &&
+             position[mutations_.site[next_mut]] < tree.interval.right) {
+        const double t = mutations_.time[next_mut];
+        if (tsk_is_unknown_time(t)) {
+          tsk_tree_free(&tree);
+          return TSK_ERR_DISALLOWED_UNKNOWN_MUTATION_TIME;
+        }
+        tsk_id_t c = mutations_.node[next_mut];
+        tsk_id_t p = tree.parent[c];
+        while (p != TSK_NULL && time[p] <= t) {
+          c = p;
+          p = tree.parent[c];
+        }
+        mutations_.node[next_mut] = c;
+        next_mut++;
+      }
+      ret = tsk_tree_next(&tree);
+    }
+    tsk_tree_free(&tree);
+    return ret;
+  }
+
+  const tsk_treeseq_t *input_;
+  // The tables while no tree sequence owns them
+  tsk_table_collection_t *tables_;
+  tsk_treeseq_t ts_;
+  // Working edge table of a pass, swapped into the tables after it
+  tsk_edge_table_t edges_;
+  tsk_mutation_table_t mutations_;
+  int direction_;
+  std::size_t num_nodes_;
+  std::vector<tsk_id_t> last_degree_, next_degree_;
+  std::vector<tsk_id_t> last_nodes_edge_, next_nodes_edge_;
+  std::vector<tsk_id_t> parent_out_, parent_in_;
+  std::vector<char> not_sample_;
+  // Arena of the list entries, cleared but not freed between passes
+  std::vector<edge_entry> pool_;
+  edge_list out_, in_;
+  std::vector<tsk_bool_t> keep_;
+};
+
+// INTERNAL
+// @title Add the buffered edges of a recorder to its edge table
+// @param rec recorder
+// @details The buffered edges are sorted on their own as \code{tskit}
+//   requires (by parent time, parent, child, and left). When they all sort
+//   after the existing edges, as when nodes are recorded backwards in time,
+//   they are appended. Otherwise, as when nodes are recorded forwards in
+//   time, they are merged with the already sorted edge table in one linear
+//   pass, instead of sorting the whole table with
+//   \code{tsk_table_collection_sort()}. The sites and mutations are not
+//   changed, so they stay sorted.
+// @return 0 or a \code{tskit} error code.
+int recorder_flush(rtsk_recorder *rec) {
+  std::vector<rtsk_recorder_edge> &buffer = rec->edges;
+  if (buffer.empty()) {
+    return 0;
+  }
+  tsk_table_collection_t *tables = &rec->tables;
+  tsk_edge_table_t *edges = &tables->edges;
+  const double *time = tables->nodes.time;
+  auto less = [time](const rtsk_recorder_edge &a,
+                     const rtsk_recorder_edge &b) {
+    if (time[a.parent] != time[b.parent]) {
+      return time[a.parent] < time[b.parent];
+    }
+    if (a.parent != b.parent) {
+      return a.parent < b.parent;
+    }
+    if (a.child != b.child) {
+      return a.child < b.child;
+    }
+    return a.left < b.left;
+  };
+  auto row = [edges](tsk_size_t e) {
+    return rtsk_recorder_edge{edges->left[e], edges->right[e],
+                              edges->parent[e], edges->child[e]};
+  };
+  std::sort(buffer.begin(), buffer.end(), less);
+  int ret = tsk_table_collection_drop_index(tables, 0);
+  if (ret != 0) {
+    return ret;
+  }
+  const tsk_size_t num_edges = edges->num_rows;
+  if (num_edges == 0 || !less(buffer.front(), row(num_edges - 1))) {
+    for (const rtsk_recorder_edge &e : buffer) {
+      const tsk_id_t id = tsk_edge_table_add_row(edges, e.left, e.right,
+                                                 e.parent, e.child, NULL, 0);
+      if (id < 0) {
+        tsk_edge_table_truncate(edges, num_edges);
+        return static_cast<int>(id);
+      }
+    }
+    buffer.clear();
+    return 0;
+  }
+  const std::size_t n = static_cast<std::size_t>(num_edges) + buffer.size();
+  std::vector<double> left(n), right(n);
+  std::vector<tsk_id_t> parent(n), child(n);
+  const bool has_metadata = edges->metadata_length > 0;
+  std::vector<tsk_size_t> metadata_offset(has_metadata ? n + 1 : 0);
+  tsk_size_t e = 0;
+  std::size_t b = 0;
+  for (std::size_t k = 0; k < n; k++) {
+    const bool take_buffer =
+        e == num_edges || (b < buffer.size() && less(buffer[b], row(e)));
+    const rtsk_recorder_edge x = take_buffer ? buffer[b] : row(e);
+    left[k] = x.left;
+    right[k] = x.right;
+    parent[k] = x.parent;
+    child[k] = x.child;
+    if (has_metadata) {
+      metadata_offset[k + 1] =
+          metadata_offset[k] +
+          (take_buffer ? 0
+                       : edges->metadata_offset[e + 1] -
+                             edges->metadata_offset[e]);
+    }
+    if (take_buffer) {
+      b++;
+    } else {
+      e++;
+    }
+  }
+  std::vector<char> metadata;
+  if (has_metadata) {
+    metadata.assign(edges->metadata,
+                    edges->metadata + edges->metadata_length);
+  }
+  ret = tsk_edge_table_set_columns(
+      edges, static_cast<tsk_size_t>(n), left.data(), right.data(),
+      parent.data(), child.data(), has_metadata ? metadata.data() : NULL,
+      has_metadata ? metadata_offset.data() : NULL);
+  if (ret == 0) {
+    buffer.clear();
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Simplify the tables of a recorder
+// @param rec recorder
+// @param samples node IDs to keep as samples
+// @param node_map on output, the new ID of each node before simplification
+//   (\code{TSK_NULL} for removed nodes)
+// @details The buffered edges are added first with \code{recorder_flush()}.
+// @return 0 or a \code{tskit} error code.
+int recorder_simplify(rtsk_recorder *rec, const std::vector<tsk_id_t> &samples,
+                      std::vector<tsk_id_t> &node_map) {
+  int ret = recorder_flush(rec);
+  if (ret != 0) {
+    return ret;
+  }
+  node_map.assign(static_cast<std::size_t>(rec->tables.nodes.num_rows),
+                  TSK_NULL);
+  return tsk_table_collection_simplify(
+      &rec->tables, samples.data(), static_cast<tsk_size_t>(samples.size()), 0,
+      node_map.data());
+}
+
+// Rows per task of the table scans in integrity_check
+constexpr std::size_t kIntegrityChunkSize = 1 << 16;
+
+// INTERNAL
+// @title Check the integrity of a table collection with worker threads
+// @details This is a port of \code{tsk_table_collection_check_integrity()}
+//   and its (static) helpers in \code{tskit C}, returning the same results.
+//   The checks of the tables are independent scans over their rows, so the
+//   rows of each table are split into chunks (mutation chunks start at a new
+//   site) that worker threads check concurrently. Each chunk records its
+//   first error, and the error reported is the one \code{tskit} would find
+//   first: tables in the \code{tskit} order, then rows. Non-contiguous edge
+//   parents are found in a sequential pass over the rows where the parent
+//   changes. The tree and mutation parent checks sweep along the genome, so
+//   they run on the calling thread once the scans have passed. Worker
+//   threads must not call the \code{R} API.
+class integrity_check {
+public:
+  integrity_check(const tsk_table_collection_t *tables, tsk_flags_t options,
+                  std::size_t chunk_size = kIntegrityChunkSize)
+      : tables_(tables), options_(options), chunk_size_(chunk_size) {
+    if (options_ & TSK_CHECK_MUTATION_PARENTS) {
+      options_ |= TSK_CHECK_TREES;
+    }
+    if (options_ & TSK_CHECK_TREES) {
+      options_ |= TSK_CHECK_EDGE_ORDERING | TSK_CHECK_SITE_ORDERING |
+                  TSK_CHECK_SITE_DUPLICATES | TSK_CHECK_MUTATION_ORDERING |
+                  TSK_CHECK_MIGRATION_ORDERING | TSK_CHECK_INDEXES;
+    }
+  }
+
+  // @return The number of trees (with \code{TSK_CHECK_TREES}), 0, or a
+  //   \code{tskit} error code.
+  tsk_id_t run(int num_threads, worker_status &status) {
+    const double L = tables_->sequence_length;
+    if (!std::isfinite(L) || L <= 0) {
+      return TSK_ERR_BAD_SEQUENCE_LENGTH;
+    }
+    add_tasks(kOffsets, kNumOffsets);
+    add_tasks(kNodes, tables_->nodes.num_rows);
+    add_tasks(kEdges, tables_->edges.num_rows);
+    add_tasks(kSites, tables_->sites.num_rows);
+    add_tasks(kMutations, tables_->mutations.num_rows);
+    add_tasks(kMigrations, tables_->migrations.num_rows);
+    add_tasks(kIndividuals, tables_->individuals.num_rows);
+    const bool check_indexes = options_ & TSK_CHECK_INDEXES;
+    const bool has_index = tsk_table_collection_has_index(tables_, 0);
+    if (check_indexes && has_index) {
+      add_tasks(kIndexes, tables_->edges.num_rows);
+    }
+
+    // Tasks of tables after the first failed table are skipped
+    std::atomic<int> failed_scan{kNumScans};
+    block_queue queue(tasks_.size(), 1);
+    run_threads(num_threads, status, [&](int) {
+      std::size_t start, stop;
+      while (!status.failed() && queue.next(start, stop)) {
+        task &t = tasks_[start];
+        if (t.scan > failed_scan.load(std::memory_order_relaxed)) {
+          continue;
+        }
+        check(t);
+        int scan = failed_scan.load(std::memory_order_relaxed);
+        while (t.ret != 0 && t.scan < scan &&
+               !failed_scan.compare_exchange_weak(scan, t.scan)) {
+        }
+      }
+    });
+    if (status.failed()) {
+      return 0;
+    }
+
+    for (int scan = 0; scan < kNumScans; scan++) {
+      if (scan == kIndexes && check_indexes && !has_index) {
+        return TSK_ERR_TABLES_NOT_INDEXED;
+      }
+      const task *first = NULL;
+      for (const task &t : tasks_) {
+        if (t.scan == scan && t.ret != 0) {
+          first = &t;
+          break;
+        }
+      }
+      int ret = first == NULL ? 0 : first->ret;
+      if (scan == kEdges && (options_ & TSK_CHECK_EDGE_ORDERING)) {
+        ret = check_edge_parents(first, ret);
+      }
+      if (ret != 0) {
+        return ret;
+      }
+    }
+    tsk_id_t ret = 0;
+    if (options_ & TSK_CHECK_TREES) {
+      ret = check_trees();
+      if (ret >= 0 && (options_ & TSK_CHECK_MUTATION_PARENTS)) {
+        const int mut_ret = check_mutation_parents();
+        if (mut_ret != 0) {
+          ret = mut_ret;
+        }
+      }
+    }
+    return ret;
+  }
+
+private:
+  enum {
+    kOffsets,
+    kNodes,
+    kEdges,
+    kSites,
+    kMutations,
+    kMigrations,
+    kIndividuals,
+    kIndexes,
+    kNumScans
+  };
+  static constexpr std::size_t kNumOffsets = 8;
+
+  // A chunk of rows of one table, with its first error (if any)
+  struct task {
+    int scan;
+    std::size_t start;
+    std::size_t stop;
+    int ret = 0;
+    std::size_t row = 0;
+    bool ordering_error = false;
+    std::vector<std::size_t> parent_changes;
+  };
+
+  void add_tasks(int scan, tsk_size_t num_rows) {
+    const std::size_t n = static_cast<std::size_t>(num_rows);
+    const std::size_t chunk = scan == kOffsets ? 1 : chunk_size_;
+    const tsk_id_t *site = tables_->mutations.site;
+    std::size_t start = 0;
+    while (start < n) {
+      std::size_t stop = std::min(start + chunk, n);
+      // Mutation checks restart at each new site
+      while (scan == kMutations && stop < n && site[stop - 1] == site[stop]) {
+        stop++;
+      }
+      task t;
+      t.scan = scan;
+      t.start = start;
+      t.stop = stop;
+      tasks_.push_back(std::move(t));
+      start = stop;
+    }
+  }
+
+  void check(task &t) const {
+    switch (t.scan) {
+    case kOffsets:
+      check_offsets(t);
+      break;
+    case kNodes:
+      check_nodes(t);
+      break;
+    case kEdges:
+      check_edges(t);
+      break;
+    case kSites:
+      check_sites(t);
+      break;
+    case kMutations:
+      check_mutations(t);
+      break;
+    case kMigrations:
+      check_migrations(t);
+      break;
+    case kIndividuals:
+      check_individuals(t);
+      break;
+    case kIndexes:
+      check_indexes(t);
+      break;
+    }
+  }
+
+  static bool fail(task &t, std::size_t row, int ret) {
+    t.row = row;
+    t.ret = ret;
+    return true;
+  }
+
+  void check_offsets(task &t) const {
+    const tsk_table_collection_t &tc = *tables_;
+    const struct {
+      tsk_size_t num_rows;
+      const tsk_size_t *offsets;
+      tsk_size_t length;
+    } columns[kNumOffsets] = {
+        {tc.nodes.num_rows, tc.nodes.metadata_offset, tc.nodes.metadata_length},
+        {tc.sites.num_rows, tc.sites.ancestral_state_offset,
+         tc.sites.ancestral_state_length},
+        {tc.sites.num_rows, tc.sites.metadata_offset, tc.sites.metadata_length},
+        {tc.mutations.num_rows, tc.mutations.derived_state_offset,
+         tc.mutations.derived_state_length},
+        {tc.mutations.num_rows, tc.mutations.metadata_offset,
+         tc.mutations.metadata_length},
+        {tc.individuals.num_rows, tc.individuals.metadata_offset,
+         tc.individuals.metadata_length},
+        {tc.provenances.num_rows, tc.provenances.timestamp_offset,
+         tc.provenances.timestamp_length},
+        {tc.provenances.num_rows, tc.provenances.record_offset,
+         tc.provenances.record_length}};
+    const auto &c = columns[t.start];
+    bool ok = c.offsets[0] == 0 && c.offsets[c.num_rows] == c.length;
+    for (tsk_size_t j = 0; ok && j < c.num_rows; j++) {
+      ok = c.offsets[j] <= c.offsets[j + 1];
+    }
+    if (!ok) {
+      fail(t, t.start, TSK_ERR_BAD_OFFSET);
+    }
+  }
+
+  void check_nodes(task &t) const {
+    const tsk_node_table_t &nodes = tables_->nodes;
+    const tsk_id_t num_populations =
+        static_cast<tsk_id_t>(tables_->populations.num_rows);
+    const tsk_id_t num_individuals =
+        static_cast<tsk_id_t>(tables_->individuals.num_rows);
+    const bool check_population_refs =
+        !(options_ & TSK_NO_CHECK_POPULATION_REFS);
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      if (!std::isfinite(nodes.time[j])) {
+        fail(t, j, TSK_ERR_TIME_NONFINITE);
+        return;
+      }
+      const tsk_id_t population = nodes.population[j];
+      if (check_population_refs &&
+          (population < TSK_NULL || population >= num_populations)) {
+        fail(t, j, TSK_ERR_POPULATION_OUT_OF_BOUNDS);
+        return;
+      }
+      const tsk_id_t individual = nodes.individual[j];
+      if (individual < TSK_NULL || individual >= num_individuals) {
+        fail(t, j, TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS);
+        return;
+      }
+    }
+  }
+
+  void check_edges(task &t) const {
+    const tsk_edge_table_t &edges = tables_->edges;
+    const double *time = tables_->nodes.time;
+    const double L = tables_->sequence_length;
+    const tsk_id_t num_nodes = static_cast<tsk_id_t>(tables_->nodes.num_rows);
+    const bool check_ordering = options_ & TSK_CHECK_EDGE_ORDERING;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      const tsk_id_t parent = edges.parent[j];
+      const tsk_id_t child = edges.child[j];
+      const double left = edges.left[j];
+      const double right = edges.right[j];
+      int ret = 0;
+      if (parent == TSK_NULL) {
+        ret = TSK_ERR_NULL_PARENT;
+      } else if (parent < 0 || parent >= num_nodes) {
+        ret = TSK_ERR_NODE_OUT_OF_BOUNDS;
+      } else if (child == TSK_NULL) {
+        ret = TSK_ERR_NULL_CHILD;
+      } else if (child < 0 || child >= num_nodes) {
+        ret = TSK_ERR_NODE_OUT_OF_BOUNDS;
+      } else if (!(std::isfinite(left) && std::isfinite(right))) {
+        ret = TSK_ERR_GENOME_COORDS_NONFINITE;
+      } else if (left < 0) {
+        ret = TSK_ERR_LEFT_LESS_ZERO;
+      } else if (right > L) {
+        ret = TSK_ERR_RIGHT_GREATER_SEQ_LENGTH;
+      } else if (left >= right) {
+        ret = TSK_ERR_BAD_EDGE_INTERVAL;
+      } else if (time[child] >= time[parent]) {
+        ret = TSK_ERR_BAD_NODE_TIME_ORDERING;
+      }
+      if (ret != 0) {
+        fail(t, j, ret);
+        return;
+      }
+      if (!check_ordering || j == 0) {
+        continue;
+      }
+      // The previous row is checked by the previous chunk when this is the
+      // first row of a chunk
+      const tsk_id_t last_parent = edges.parent[j - 1];
+      if (last_parent < 0 || last_parent >= num_nodes) {
+        continue;
+      }
+      if (parent != last_parent) {
+        t.parent_changes.push_back(j);
+      }
+      const tsk_id_t last_child = edges.child[j - 1];
+      const double last_left = edges.left[j - 1];
+      if (time[parent] < time[last_parent]) {
+        ret = TSK_ERR_EDGES_NOT_SORTED_PARENT_TIME;
+      } else if (time[parent] == time[last_parent] && parent == last_parent) {
+        if (child < last_child) {
+          ret = TSK_ERR_EDGES_NOT_SORTED_CHILD;
+        } else if (child == last_child && left == last_left) {
+          ret = TSK_ERR_DUPLICATE_EDGES;
+        } else if (child == last_child && left < last_left) {
+          ret = TSK_ERR_EDGES_NOT_SORTED_LEFT;
+        }
+      }
+      if (ret != 0) {
+        t.ordering_error = true;
+        fail(t, j, ret);
+        return;
+      }
+    }
+  }
+
+  // @details Follows the rows where the edge parent changes up to the first
+  //   error of the edge chunks: a parent whose edges ended at a row where
+  //   the next parent has the same time must not have edges again. As in
+  //   \code{tskit}, this is checked before the ordering checks of a row.
+  int check_edge_parents(const task *first, int ret) const {
+    const tsk_edge_table_t &edges = tables_->edges;
+    const double *time = tables_->nodes.time;
+    const std::size_t first_row =
+        first == NULL ? static_cast<std::size_t>(edges.num_rows) : first->row;
+    const bool inclusive = first != NULL && first->ordering_error;
+    std::vector<char> parent_seen(
+        static_cast<std::size_t>(tables_->nodes.num_rows), 0);
+    for (const task &t : tasks_) {
+      if (t.scan != kEdges) {
+        continue;
+      }
+      for (const std::size_t j : t.parent_changes) {
+        if (j > first_row || (j == first_row && !inclusive)) {
+          return ret;
+        }
+        const tsk_id_t parent = edges.parent[j];
+        const tsk_id_t last_parent = edges.parent[j - 1];
+        if (parent_seen[static_cast<std::size_t>(parent)]) {
+          return TSK_ERR_EDGES_NONCONTIGUOUS_PARENTS;
+        }
+        if (time[parent] == time[last_parent]) {
+          parent_seen[static_cast<std::size_t>(last_parent)] = 1;
+        }
+      }
+    }
+    return ret;
+  }
+
+  void check_sites(task &t) const {
+    const double *position = tables_->sites.position;
+    const double L = tables_->sequence_length;
+    const bool check_ordering = options_ & TSK_CHECK_SITE_ORDERING;
+    const bool check_duplicates = options_ & TSK_CHECK_SITE_DUPLICATES;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      if (!std::isfinite(position[j]) || position[j] < 0 ||
+          position[j] >= L) {
+        fail(t, j, TSK_ERR_BAD_SITE_POSITION);
+        return;
+      }
+      if (j > 0 && check_duplicates && position[j - 1] == position[j]) {
+        fail(t, j, TSK_ERR_DUPLICATE_SITE_POSITION);
+        return;
+      }
+      if (j > 0 && check_ordering && position[j - 1] > position[j]) {
+        fail(t, j, TSK_ERR_UNSORTED_SITES);
+        return;
+      }
+    }
+  }
+
+  void check_mutations(task &t) const {
+    const tsk_mutation_table_t &mutations = tables_->mutations;
+    const tsk_id_t num_nodes = static_cast<tsk_id_t>(tables_->nodes.num_rows);
+    const tsk_id_t num_sites = static_cast<tsk_id_t>(tables_->sites.num_rows);
+    const tsk_id_t num_mutations = static_cast<tsk_id_t>(mutations.num_rows);
+    const double *node_time = tables_->nodes.time;
+    const bool check_ordering = options_ & TSK_CHECK_MUTATION_ORDERING;
+    double last_known_time = INFINITY;
+    int num_known_times = 0;
+    int num_unknown_times = 0;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      const tsk_id_t site = mutations.site[j];
+      if (site < 0 || site >= num_sites) {
+        fail(t, j, TSK_ERR_SITE_OUT_OF_BOUNDS);
+        return;
+      }
+      if (mutations.node[j] < 0 || mutations.node[j] >= num_nodes) {
+        fail(t, j, TSK_ERR_NODE_OUT_OF_BOUNDS);
+        return;
+      }
+      const tsk_id_t parent = mutations.parent[j];
+      if (parent < TSK_NULL || parent >= num_mutations) {
+        fail(t, j, TSK_ERR_MUTATION_OUT_OF_BOUNDS);
+        return;
+      }
+      if (parent == static_cast<tsk_id_t>(j)) {
+        fail(t, j, TSK_ERR_MUTATION_PARENT_EQUAL);
+        return;
+      }
+      const double time = mutations.time[j];
+      const bool unknown_time = tsk_is_unknown_time(time);
+      if (!unknown_time) {
+        if (!std::isfinite(time)) {
+          fail(t, j, TSK_ERR_TIME_NONFINITE);
+          return;
+        }
+        if (time < node_time[mutations.node[j]]) {
+          fail(t, j, TSK_ERR_MUTATION_TIME_YOUNGER_THAN_NODE);
+          return;
+        }
+      }
+      if (j > t.start && mutations.site[j - 1] != site) {
+        last_known_time = INFINITY;
+        num_known_times = 0;
+        num_unknown_times = 0;
+      }
+      if (unknown_time) {
+        num_unknown_times++;
+      } else {
+        num_known_times++;
+      }
+      if (num_unknown_times > 0 && num_known_times > 0) {
+        fail(t, j, TSK_ERR_MUTATION_TIME_HAS_BOTH_KNOWN_AND_UNKNOWN);
+        return;
+      }
+      if (parent != TSK_NULL) {
+        if (mutations.site[parent] != site) {
+          fail(t, j, TSK_ERR_MUTATION_PARENT_DIFFERENT_SITE);
+          return;
+        }
+        if (!unknown_time && time > mutations.time[parent]) {
+          fail(t, j, TSK_ERR_MUTATION_TIME_OLDER_THAN_PARENT_MUTATION);
+          return;
+        }
+      }
+      if (check_ordering) {
+        if (j > 0 && mutations.site[j - 1] > site) {
+          fail(t, j, TSK_ERR_UNSORTED_MUTATIONS);
+          return;
+        }
+        if (parent != TSK_NULL && parent > static_cast<tsk_id_t>(j)) {
+          fail(t, j, TSK_ERR_MUTATION_PARENT_AFTER_CHILD);
+          return;
+        }
+        if (!unknown_time) {
+          if (time > last_known_time) {
+            fail(t, j, TSK_ERR_UNSORTED_MUTATIONS);
+            return;
+          }
+          last_known_time = time;
+        }
+      }
+    }
+  }
+
+  void check_migrations(task &t) const {
+    const tsk_migration_table_t &migrations = tables_->migrations;
+    const double L = tables_->sequence_length;
+    const tsk_id_t num_nodes = static_cast<tsk_id_t>(tables_->nodes.num_rows);
+    const tsk_id_t num_populations =
+        static_cast<tsk_id_t>(tables_->populations.num_rows);
+    const bool check_population_refs =
+        !(options_ & TSK_NO_CHECK_POPULATION_REFS);
+    const bool check_ordering = options_ & TSK_CHECK_MIGRATION_ORDERING;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      const double left = migrations.left[j];
+      const double right = migrations.right[j];
+      int ret = 0;
+      if (migrations.node[j] < 0 || migrations.node[j] >= num_nodes) {
+        ret = TSK_ERR_NODE_OUT_OF_BOUNDS;
+      } else if (check_population_refs &&
+                 (migrations.source[j] < 0 ||
+                  migrations.source[j] >= num_populations ||
+                  migrations.dest[j] < 0 ||
+                  migrations.dest[j] >= num_populations)) {
+        ret = TSK_ERR_POPULATION_OUT_OF_BOUNDS;
+      } else if (!std::isfinite(migrations.time[j])) {
+        ret = TSK_ERR_TIME_NONFINITE;
+      } else if (j > 0 && check_ordering &&
+                 migrations.time[j - 1] > migrations.time[j]) {
+        ret = TSK_ERR_UNSORTED_MIGRATIONS;
+      } else if (!(std::isfinite(left) && std::isfinite(right))) {
+        ret = TSK_ERR_GENOME_COORDS_NONFINITE;
+      } else if (left < 0) {
+        ret = TSK_ERR_LEFT_LESS_ZERO;
+      } else if (right > L) {
+        ret = TSK_ERR_RIGHT_GREATER_SEQ_LENGTH;
+      } else if (left >= right) {
+        ret = TSK_ERR_BAD_EDGE_INTERVAL;
+      }
+      if (ret != 0) {
+        fail(t, j, ret);
+        return;
+      }
+    }
+  }
+
+  void check_individuals(task &t) const {
+    const tsk_individual_table_t &individuals = tables_->individuals;
+    const tsk_id_t num_individuals =
+        static_cast<tsk_id_t>(individuals.num_rows);
+    const bool check_ordering = options_ & TSK_CHECK_INDIVIDUAL_ORDERING;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      const tsk_id_t id = static_cast<tsk_id_t>(j);
+      for (tsk_size_t k = individuals.parents_offset[j];
+           k < individuals.parents_offset[j + 1]; k++) {
+        const tsk_id_t parent = individuals.parents[k];
+        if (parent != TSK_NULL && (parent < 0 || parent >= num_individuals)) {
+          fail(t, j, TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS);
+          return;
+        }
+        if (parent == id) {
+          fail(t, j, TSK_ERR_INDIVIDUAL_SELF_PARENT);
+          return;
+        }
+        if (check_ordering && parent != TSK_NULL && parent >= id) {
+          fail(t, j, TSK_ERR_UNSORTED_INDIVIDUALS);
+          return;
+        }
+      }
+    }
+  }
+
+  void check_indexes(task &t) const {
+    const tsk_id_t num_edges = static_cast<tsk_id_t>(tables_->edges.num_rows);
+    const tsk_id_t *insertion = tables_->indexes.edge_insertion_order;
+    const tsk_id_t *removal = tables_->indexes.edge_removal_order;
+    for (std::size_t j = t.start; j < t.stop; j++) {
+      if (insertion[j] < 0 || insertion[j] >= num_edges || removal[j] < 0 ||
+          removal[j] >= num_edges) {
+        fail(t, j, TSK_ERR_EDGE_OUT_OF_BOUNDS);
+        return;
+      }
+    }
+  }
+
+  // @details Port of \code{tsk_table_collection_check_tree_integrity()}.
+  tsk_id_t check_trees() const {
+    const tsk_table_collection_t &tc = *tables_;
+    const double L = tc.sequence_length;
+    const tsk_id_t num_sites = static_cast<tsk_id_t>(tc.sites.num_rows);
+    const tsk_id_t num_mutations =
+        static_cast<tsk_id_t>(tc.mutations.num_rows);
+    const std::size_t num_edges = static_cast<std::size_t>(tc.edges.num_rows);
+    const tsk_id_t *I = tc.indexes.edge_insertion_order;
+    const tsk_id_t *O = tc.indexes.edge_removal_order;
+    const tsk_edge_table_t &edges = tc.edges;
+    std::vector<tsk_id_t> parent(static_cast<std::size_t>(tc.nodes.num_rows),
+                                 TSK_NULL);
+    std::vector<int8_t> used_edges(num_edges, 0);
+    double tree_left = 0;
+    tsk_id_t num_trees = 0;
+    std::size_t j = 0, k = 0;
+    tsk_id_t site = 0, mutation = 0;
+    while (j < num_edges || tree_left < L) {
+      while (k < num_edges && edges.right[O[k]] == tree_left) {
+        const tsk_id_t e = O[k];
+        if (used_edges[e] != 1) {
+          return TSK_ERR_TABLES_BAD_INDEXES;
+        }
+        parent[edges.child[e]] = TSK_NULL;
+        used_edges[e]++;
+        k++;
+      }
+      while (j < num_edges && edges.left[I[j]] == tree_left) {
+        const tsk_id_t e = I[j];
+        if (used_edges[e] != 0) {
+          return TSK_ERR_TABLES_BAD_INDEXES;
+        }
+        used_edges[e]++;
+        const tsk_id_t u = edges.child[e];
+        if (parent[u] != TSK_NULL) {
+          return TSK_ERR_BAD_EDGES_CONTRADICTORY_CHILDREN;
+        }
+        parent[u] = edges.parent[e];
+        j++;
+      }
+      double tree_right = L;
+      if (j < num_edges) {
+        tree_right = std::min(tree_right, edges.left[I[j]]);
+      }
+      if (k < num_edges) {
+        tree_right = std::min(tree_right, edges.right[O[k]]);
+      }
+      while (site < num_sites && tc.sites.position[site] < tree_right) {
+        while (mutation < num_mutations &&
+               tc.mutations.site[mutation] == site) {
+          const double time = tc.mutations.time[mutation];
+          const tsk_id_t p = parent[tc.mutations.node[mutation]];
+          if (!tsk_is_unknown_time(time) && p != TSK_NULL &&
+              tc.nodes.time[p] <= time) {
+            return TSK_ERR_MUTATION_TIME_OLDER_THAN_PARENT_NODE;
+          }
+          mutation++;
+        }
+        site++;
+      }
+      if (tree_right <= tree_left) {
+        return TSK_ERR_TABLES_BAD_INDEXES;
+      }
+      tree_left = tree_right;
+      if (num_trees == TSK_MAX_ID) {
+        return TSK_ERR_TREE_OVERFLOW;
+      }
+      num_trees++;
+    }
+    for (; k < num_edges; k++) {
+      if (edges.right[O[k]] != L) {
+        return TSK_ERR_TABLES_BAD_INDEXES;
+      }
+    }
+    return num_trees;
+  }
+
+  // @details Port of \code{tsk_table_collection_check_mutation_parents()}
+  //   and \code{tsk_table_collection_compute_mutation_parents_to_array()}.
+  int check_mutation_parents() const {
+    const tsk_table_collection_t &tc = *tables_;
+    const tsk_edge_table_t &edges = tc.edges;
+    const tsk_mutation_table_t &mutations = tc.mutations;
+    const std::size_t num_edges = static_cast<std::size_t>(edges.num_rows);
+    const std::size_t num_mutations =
+        static_cast<std::size_t>(mutations.num_rows);
+    const tsk_id_t num_sites = static_cast<tsk_id_t>(tc.sites.num_rows);
+    if (num_mutations == 0) {
+      return 0;
+    }
+    const tsk_id_t *I = tc.indexes.edge_insertion_order;
+    const tsk_id_t *O = tc.indexes.edge_removal_order;
+    const std::size_t num_nodes = static_cast<std::size_t>(tc.nodes.num_rows);
+    std::vector<tsk_id_t> parent(num_nodes, TSK_NULL);
+    std::vector<tsk_id_t> bottom_mutation(num_nodes, TSK_NULL);
+    std::vector<tsk_id_t> mutation_parent(num_mutations, TSK_NULL);
+    std::size_t j = 0, k = 0, mutation = 0;
+    tsk_id_t site = 0;
+    double left = 0;
+    while (j < num_edges || left < tc.sequence_length) {
+      while (k < num_edges && edges.right[O[k]] == left) {
+        parent[edges.child[O[k]]] = TSK_NULL;
+        k++;
+      }
+      while (j < num_edges && edges.left[I[j]] == left) {
+        parent[edges.child[I[j]]] = edges.parent[I[j]];
+        j++;
+      }
+      double right = tc.sequence_length;
+      if (j < num_edges) {
+        right = std::min(right, edges.left[I[j]]);
+      }
+      if (k < num_edges) {
+        right = std::min(right, edges.right[O[k]]);
+      }
+      while (site < num_sites && tc.sites.position[site] < right) {
+        const std::size_t first_mutation = mutation;
+        while (mutation < num_mutations && mutations.site[mutation] == site) {
+          const tsk_id_t u = mutations.node[mutation];
+          if (bottom_mutation[u] != TSK_NULL) {
+            mutation_parent[mutation] = bottom_mutation[u];
+          }
+          bottom_mutation[u] = static_cast<tsk_id_t>(mutation);
+          mutation++;
+        }
+        if (mutation > first_mutation + 1) {
+          for (std::size_t m = first_mutation; m < mutation; m++) {
+            if (mutation_parent[m] == TSK_NULL) {
+              tsk_id_t u = parent[mutations.node[m]];
+              while (u != TSK_NULL && bottom_mutation[u] == TSK_NULL) {
+                u = parent[u];
+              }
+              if (u != TSK_NULL) {
+                mutation_parent[m] = bottom_mutation[u];
+              }
+            }
+          }
+        }
+        for (std::size_t m = first_mutation; m < mutation; m++) {
+          bottom_mutation[mutations.node[m]] = TSK_NULL;
+          if (mutation_parent[m] > static_cast<tsk_id_t>(m)) {
+            return TSK_ERR_MUTATION_PARENT_AFTER_CHILD;
+          }
+        }
+        site++;
+      }
+      left = right;
+    }
+    for (std::size_t m = 0; m < num_mutations; m++) {
+      if (mutations.parent[m] != mutation_parent[m]) {
+        return TSK_ERR_BAD_MUTATION_PARENT;
+      }
+    }
+    return 0;
+  }
+
+  const tsk_table_collection_t *tables_;
+  tsk_flags_t options_;
+  std::size_t chunk_size_;
+  std::vector<task> tasks_;
+};
+
+// Rows per task when table columns are gathered in a new order
+constexpr std::size_t kGatherChunkSize = 1 << 16;
+
+// INTERNAL
+// @title Run a function over blocks of rows on worker threads
+// @param num_rows number of rows
+// @param num_threads number of threads
+// @param status shared worker status
+// @param body function called as \code{body(start, stop)} for each block of
+//   rows; it must not call the \code{R} API.
+template <typename BodyT>
+void run_row_blocks(std::size_t num_rows, int num_threads,
+                    worker_status &status, BodyT body) {
+  block_queue queue(num_rows, kGatherChunkSize);
+  const int num_workers = static_cast<int>(std::max<std::size_t>(
+      1, std::min(static_cast<std::size_t>(num_threads), queue.num_blocks())));
+  run_threads(num_workers, status, [&](int) {
+    std::size_t start, stop;
+    while (!status.failed() && queue.next(start, stop)) {
+      body(start, stop);
+    }
+  });
+}
+
+// INTERNAL
+// @title Gather the rows of a column in a new order on worker threads
+// @param order old row ID of each new row
+// @param column old column
+// @param num_threads number of threads
+// @param status shared worker status
+// @return The new column.
+template <typename T>
+std::vector<T> gather_column(const std::vector<tsk_id_t> &order,
+                             const T *column, int num_threads,
+                             worker_status &status) {
+  std::vector<T> out(order.size());
+  run_row_blocks(order.size(), num_threads, status,
+                 [&](std::size_t start, std::size_t stop) {
+                   for (std::size_t k = start; k < stop; k++) {
+                     out[k] = column[order[k]];
+                   }
+                 });
+  return out;
+}
+
+// INTERNAL
+// @title A ragged column (values and offsets) of a \code{tskit} table
+template <typename T> struct ragged_column {
+  std::vector<T> data;
+  std::vector<tsk_size_t> offset;
+
+  // tsk_*_table_set_columns() rejects NULL for required columns even when
+  // they are empty
+  const T *data_ptr() const {
+    static const T empty{};
+    return data.empty() ? &empty : data.data();
+  }
+};
+
+// INTERNAL
+// @title Gather the rows of a ragged column in a new order on worker threads
+// @param order old row ID of each new row
+// @param data old values
+// @param offset old offsets
+// @param num_threads number of threads
+// @param status shared worker status
+// @details The new offsets are a (sequential) cumulative sum of the row
+//   lengths, and the values are then copied row by row on the threads.
+// @return The new ragged column.
+template <typename T>
+ragged_column<T> gather_ragged_column(const std::vector<tsk_id_t> &order,
+                                      const T *data, const tsk_size_t *offset,
+                                      int num_threads, worker_status &status) {
+  ragged_column<T> out;
+  out.offset.resize(order.size() + 1);
+  out.offset[0] = 0;
+  for (std::size_t k = 0; k < order.size(); k++) {
+    out.offset[k + 1] =
+        out.offset[k] + offset[order[k] + 1] - offset[order[k]];
+  }
+  out.data.resize(static_cast<std::size_t>(out.offset.back()));
+  run_row_blocks(order.size(), num_threads, status,
+                 [&](std::size_t start, std::size_t stop) {
+                   for (std::size_t k = start; k < stop; k++) {
+                     std::copy(data + offset[order[k]],
+                               data + offset[order[k] + 1],
+                               out.data.begin() +
+                                   static_cast<std::ptrdiff_t>(out.offset[k]));
+                   }
+                 });
+  return out;
+}
+
+// INTERNAL
+// @title Renumber IDs on worker threads
+// @param ids IDs to renumber in place (\code{TSK_NULL} values are kept)
+// @param num_ids number of IDs
+// @param id_map new ID of each old ID
+// @param num_threads number of threads
+// @param status shared worker status
+void remap_ids(tsk_id_t *ids, std::size_t num_ids,
+               const std::vector<tsk_id_t> &id_map, int num_threads,
+               worker_status &status) {
+  run_row_blocks(num_ids, num_threads, status,
+                 [&](std::size_t start, std::size_t stop) {
+                   for (std::size_t k = start; k < stop; k++) {
+                     if (ids[k] != TSK_NULL) {
+                       ids[k] = id_map[static_cast<std::size_t>(ids[k])];
+                     }
+                   }
+                 });
+}
+
+// INTERNAL
+// @title Row IDs of sorted sort keys and the inverse map
+// @param keys sorted keys, each with the old row ID in \code{id}
+// @param order on output, the old row ID of each new row
+// @param id_map on output, the new row ID of each old row
+template <typename KeyT>
+void sorted_order(const std::vector<KeyT> &keys, std::vector<tsk_id_t> &order,
+                  std::vector<tsk_id_t> &id_map) {
+  order.resize(keys.size());
+  id_map.resize(keys.size());
+  for (std::size_t k = 0; k < keys.size(); k++) {
+    order[k] = keys[k].id;
+    id_map[static_cast<std::size_t>(keys[k].id)] = static_cast<tsk_id_t>(k);
+  }
+}
+
+// INTERNAL
+// @title Sort key of an edge in the table order
+// @details As \code{cmp_edge()} in \code{tskit C}: parent time, parent,
+//   child, and left, with ties broken by edge ID.
+struct edge_sort_key {
+  double time;
+  tsk_id_t parent;
+  tsk_id_t child;
+  double left;
+  tsk_id_t id;
+
+  bool operator<(const edge_sort_key &other) const {
+    if (time != other.time) {
+      return time < other.time;
+    }
+    if (parent != other.parent) {
+      return parent < other.parent;
+    }
+    if (child != other.child) {
+      return child < other.child;
+    }
+    if (left != other.left) {
+      return left < other.left;
+    }
+    return id < other.id;
+  }
+};
+
+// INTERNAL
+// @title Sort key of a site in the table order
+// @details As \code{cmp_site()} in \code{tskit C}: position, with ties
+//   broken by site ID.
+struct site_sort_key {
+  double position;
+  tsk_id_t id;
+
+  bool operator<(const site_sort_key &other) const {
+    if (position != other.position) {
+      return position < other.position;
+    }
+    return id < other.id;
+  }
+};
+
+// INTERNAL
+// @title Sort key of a mutation in the table order
+// @details As \code{cmp_mutation()} in \code{tskit C}: (new) site, then
+//   decreasing mutation time (when both are known), node time, and number
+//   of descendant mutations, then node, with ties broken by mutation ID.
+struct mutation_sort_key {
+  tsk_id_t site;
+  double time;
+  double node_time;
+  tsk_size_t num_descendants;
+  tsk_id_t node;
+  tsk_id_t id;
+
+  bool operator<(const mutation_sort_key &other) const {
+    if (site != other.site) {
+      return site < other.site;
+    }
+    if (!tsk_is_unknown_time(time) && !tsk_is_unknown_time(other.time) &&
+        time != other.time) {
+      return time > other.time;
+    }
+    if (node_time != other.node_time) {
+      return node_time > other.node_time;
+    }
+    if (num_descendants != other.num_descendants) {
+      return num_descendants > other.num_descendants;
+    }
+    if (node != other.node) {
+      return node < other.node;
+    }
+    return id < other.id;
+  }
+};
+
+// INTERNAL
+// @title Sort key of an individual in the canonical table order
+// @details As \code{cmp_individual_canonical()} in \code{tskit C}:
+//   decreasing number of descendant individuals, then the first node that
+//   refers to the individual, with ties broken by individual ID.
+struct individual_sort_key {
+  tsk_size_t num_descendants;
+  tsk_id_t first_node;
+  tsk_id_t id;
+
+  bool operator<(const individual_sort_key &other) const {
+    if (num_descendants != other.num_descendants) {
+      return num_descendants > other.num_descendants;
+    }
+    if (first_node != other.first_node) {
+      return first_node < other.first_node;
+    }
+    return id < other.id;
+  }
+};
+
+// INTERNAL
+// @title Sort the edge table with worker threads
+// @param tables table collection
+// @param num_threads number of threads
+// @param status shared worker status
+// @return 0 or a \code{tskit} error code.
+int sort_edge_table(tsk_table_collection_t *tables, int num_threads,
+                    worker_status &status) {
+  tsk_edge_table_t *edges = &tables->edges;
+  if (edges->num_rows == 0) {
+    return 0;
+  }
+  const double *time = tables->nodes.time;
+  std::vector<edge_sort_key> keys(static_cast<std::size_t>(edges->num_rows));
+  run_row_blocks(keys.size(), num_threads, status,
+                 [&](std::size_t start, std::size_t stop) {
+                   for (std::size_t e = start; e < stop; e++) {
+                     keys[e] = {time[edges->parent[e]], edges->parent[e],
+                                edges->child[e], edges->left[e],
+                                static_cast<tsk_id_t>(e)};
+                   }
+                 });
+  parallel_sort(keys, num_threads, status);
+  std::vector<tsk_id_t> order, id_map;
+  sorted_order(keys, order, id_map);
+  const std::vector<double> left =
+      gather_column(order, edges->left, num_threads, status);
+  const std::vector<double> right =
+      gather_column(order, edges->right, num_threads, status);
+  const std::vector<tsk_id_t> parent =
+      gather_column(order, edges->parent, num_threads, status);
+  const std::vector<tsk_id_t> child =
+      gather_column(order, edges->child, num_threads, status);
+  const bool has_metadata = edges->metadata_length > 0;
+  ragged_column<char> metadata;
+  if (has_metadata) {
+    metadata = gather_ragged_column(order, edges->metadata,
+                                    edges->metadata_offset, num_threads,
+                                    status);
+  }
+  if (status.failed()) {
+    return 0;
+  }
+  return tsk_edge_table_set_columns(
+      edges, edges->num_rows, left.data(), right.data(), parent.data(),
+      child.data(), has_metadata ? metadata.data_ptr() : NULL,
+      has_metadata ? metadata.offset.data() : NULL);
+}
+
+// INTERNAL
+// @title Sort the site table with worker threads
+// @param tables table collection
+// @param site_map on output, the new ID of each old site
+// @param num_threads number of threads
+// @param status shared worker status
+// @details The mutations are not updated; see \code{sort_mutation_table()}.
+// @return 0 or a \code{tskit} error code.
+int sort_site_table(tsk_table_collection_t *tables,
+                    std::vector<tsk_id_t> &site_map, int num_threads,
+                    worker_status &status) {
+  tsk_site_table_t *sites = &tables->sites;
+  if (sites->num_rows == 0) {
+    return 0;
+  }
+  std::vector<site_sort_key> keys(static_cast<std::size_t>(sites->num_rows));
+  for (std::size_t j = 0; j < keys.size(); j++) {
+    keys[j] = {sites->position[j], static_cast<tsk_id_t>(j)};
+  }
+  parallel_sort(keys, num_threads, status);
+  std::vector<tsk_id_t> order;
+  sorted_order(keys, order, site_map);
+  const std::vector<double> position =
+      gather_column(order, sites->position, num_threads, status);
+  const ragged_column<char> ancestral_state =
+      gather_ragged_column(order, sites->ancestral_state,
+                           sites->ancestral_state_offset, num_threads, status);
+  const ragged_column<char> metadata = gather_ragged_column(
+      order, sites->metadata, sites->metadata_offset, num_threads, status);
+  if (status.failed()) {
+    return 0;
+  }
+  return tsk_site_table_set_columns(
+      sites, sites->num_rows, position.data(), ancestral_state.data_ptr(),
+      ancestral_state.offset.data(), metadata.data_ptr(),
+      metadata.offset.data());
+}
+
+// INTERNAL
+// @title Sort the mutation table with worker threads
+// @param tables table collection
+// @param site_map new ID of each old site (see \code{sort_site_table()})
+// @param num_threads number of threads
+// @param status shared worker status
+// @details The numbers of descendant mutations are counted up the parent
+//   chains on the calling thread, as in \code{tskit C}.
+// @return 0 or a \code{tskit} error code.
+int sort_mutation_table(tsk_table_collection_t *tables,
+                        const std::vector<tsk_id_t> &site_map,
+                        int num_threads, worker_status &status) {
+  tsk_mutation_table_t *mutations = &tables->mutations;
+  const std::size_t num_mutations =
+      static_cast<std::size_t>(mutations->num_rows);
+  if (num_mutations == 0) {
+    return 0;
+  }
+  std::vector<tsk_size_t> num_descendants(num_mutations, 0);
+  for (std::size_t j = 0; j < num_mutations; j++) {
+    for (tsk_id_t p = mutations->parent[j]; p != TSK_NULL;
+         p = mutations->parent[p]) {
+      if (++num_descendants[static_cast<std::size_t>(p)] > num_mutations) {
+        return TSK_ERR_MUTATION_PARENT_INCONSISTENT;
+      }
+    }
+  }
+  const double *node_time = tables->nodes.time;
+  std::vector<mutation_sort_key> keys(num_mutations);
+  run_row_blocks(num_mutations, num_threads, status,
+                 [&](std::size_t start, std::size_t stop) {
+                   for (std::size_t j = start; j < stop; j++) {
+                     keys[j] = {site_map[static_cast<std::size_t>(
+                                    mutations->site[j])],
+                                mutations->time[j],
+                                node_time[mutations->node[j]],
+                                num_descendants[j], mutations->node[j],
+                                static_cast<tsk_id_t>(j)};
+                   }
+                 });
+  parallel_sort(keys, num_threads, status);
+  std::vector<tsk_id_t> order, mutation_map;
+  sorted_order(keys, order, mutation_map);
+  std::vector<tsk_id_t> site =
+      gather_column(order, mutations->site, num_threads, status);
+  const std::vector<tsk_id_t> node =
+      gather_column(order, mutations->node, num_threads, status);
+  std::vector<tsk_id_t> parent =
+      gather_column(order, mutations->parent, num_threads, status);
+  const std::vector<double> time =
+      gather_column(order, mutations->time, num_threads, status);
+  const ragged_column<char> derived_state =
+      gather_ragged_column(order, mutations->derived_state,
+                           mutations->derived_state_offset, num_threads,
+                           status);
+  const ragged_column<char> metadata =
+      gather_ragged_column(order, mutations->metadata,
+                           mutations->metadata_offset, num_threads, status);
+  remap_ids(site.data(), site.size(), site_map, num_threads, status);
+  remap_ids(parent.data(), parent.size(), mutation_map, num_threads, status);
+  if (status.failed()) {
+    return 0;
+  }
+  return tsk_mutation_table_set_columns(
+      mutations, mutations->num_rows, site.data(), node.data(), parent.data(),
+      time.data(), derived_state.data_ptr(), derived_state.offset.data(),
+      metadata.data_ptr(), metadata.offset.data());
+}
+
+// INTERNAL
+// @title Sort the individual table canonically with worker threads
+// @param tables table collection
+// @param num_threads number of threads
+// @param status shared worker status
+// @details The numbers of descendant individuals come from a topological
+//   sort of the individual pedigree on the calling thread, as in
+//   \code{tsk_individual_table_topological_sort()}. The individual parents
+//   and node individuals are renumbered.
+// @return 0 or a \code{tskit} error code.
+int sort_individual_table_canonical(tsk_table_collection_t *tables,
+                                    int num_threads, worker_status &status) {
+  tsk_individual_table_t *individuals = &tables->individuals;
+  tsk_node_table_t *nodes = &tables->nodes;
+  const std::size_t num_individuals =
+      static_cast<std::size_t>(individuals->num_rows);
+  if (num_individuals == 0) {
+    return 0;
+  }
+  std::vector<tsk_size_t> num_children(num_individuals, 0);
+  for (tsk_size_t k = 0; k < individuals->parents_length; k++) {
+    if (individuals->parents[k] != TSK_NULL) {
+      num_children[static_cast<std::size_t>(individuals->parents[k])]++;
+    }
+  }
+  // Individuals are processed once all their children have been
+  std::vector<tsk_size_t> num_descendants(num_individuals, 0);
+  std::vector<tsk_id_t> todo;
+  todo.reserve(num_individuals);
+  for (std::size_t i = num_individuals; i-- > 0;) {
+    if (num_children[i] == 0) {
+      todo.push_back(static_cast<tsk_id_t>(i));
+    }
+  }
+  for (std::size_t t = 0; t < todo.size(); t++) {
+    const std::size_t j = static_cast<std::size_t>(todo[t]);
+    for (tsk_size_t k = individuals->parents_offset[j];
+         k < individuals->parents_offset[j + 1]; k++) {
+      const tsk_id_t p = individuals->parents[k];
+      if (p != TSK_NULL) {
+        const std::size_t pp = static_cast<std::size_t>(p);
+        num_descendants[pp] += 1 + num_descendants[j];
+        if (--num_children[pp] == 0) {
+          todo.push_back(p);
+        }
+      }
+    }
+  }
+  // Individuals that were never processed are parts of cycles
+  if (todo.size() < num_individuals) {
+    return TSK_ERR_INDIVIDUAL_PARENT_CYCLE;
+  }
+  std::vector<individual_sort_key> keys(num_individuals);
+  for (std::size_t i = 0; i < num_individuals; i++) {
+    keys[i] = {num_descendants[i], static_cast<tsk_id_t>(nodes->num_rows),
+               static_cast<tsk_id_t>(i)};
+  }
+  for (tsk_size_t u = 0; u < nodes->num_rows; u++) {
+    const tsk_id_t i = nodes->individual[u];
+    if (i != TSK_NULL) {
+      individual_sort_key &key = keys[static_cast<std::size_t>(i)];
+      key.first_node = std::min(key.first_node, static_cast<tsk_id_t>(u));
+    }
+  }
+  parallel_sort(keys, num_threads, status);
+  std::vector<tsk_id_t> order, individual_map;
+  sorted_order(keys, order, individual_map);
+  const std::vector<tsk_flags_t> flags =
+      gather_column(order, individuals->flags, num_threads, status);
+  const ragged_column<double> location =
+      gather_ragged_column(order, individuals->location,
+                           individuals->location_offset, num_threads, status);
+  ragged_column<tsk_id_t> parents =
+      gather_ragged_column(order, individuals->parents,
+                           individuals->parents_offset, num_threads, status);
+  const ragged_column<char> metadata =
+      gather_ragged_column(order, individuals->metadata,
+                           individuals->metadata_offset, num_threads, status);
+  remap_ids(parents.data.data(), parents.data.size(), individual_map,
+            num_threads, status);
+  if (status.failed()) {
+    return 0;
+  }
+  int ret = tsk_individual_table_set_columns(
+      individuals, individuals->num_rows, flags.data(), location.data_ptr(),
+      location.offset.data(), parents.data_ptr(), parents.offset.data(),
+      metadata.data_ptr(), metadata.offset.data());
+  if (ret == 0) {
+    remap_ids(nodes->individual, static_cast<std::size_t>(nodes->num_rows),
+              individual_map, num_threads, status);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Sort a table collection canonically with worker threads
+// @param tables table collection, which must be valid (for example,
+//   straight after \code{tsk_table_collection_subset()})
+// @param num_threads number of threads
+// @param status shared worker status
+// @details This does what \code{tsk_table_sorter_run()} does with the
+//   sorter set up by \code{tsk_table_collection_canonicalise()}, but the
+//   edges, sites, mutations, and individuals are sorted with parallel stable
+//   sorts on keys that end with the row ID (so the order is the same as with
+//   the \code{tskit} comparators), and their columns are gathered in the new
+//   order on the worker threads. The migrations are sorted by \code{tskit}
+//   (which also drops the indexes). Check \code{status} after the call.
+// @return 0 or a \code{tskit} error code.
+int canonical_sort(tsk_table_collection_t *tables, int num_threads,
+                   worker_status &status) {
+  // Skipping the edges, sites, and mutations leaves only the migrations
+  tsk_bookmark_t skip = {};
+  skip.edges = tables->edges.num_rows;
+  skip.sites = tables->sites.num_rows;
+  skip.mutations = tables->mutations.num_rows;
+  int ret = tsk_table_collection_sort(tables, &skip, TSK_NO_CHECK_INTEGRITY);
+  if (ret == 0) {
+    ret = sort_edge_table(tables, num_threads, status);
+  }
+  std::vector<tsk_id_t> site_map;
+  if (ret == 0 && !status.failed()) {
+    ret = sort_site_table(tables, site_map, num_threads, status);
+  }
+  if (ret == 0 && !status.failed()) {
+    ret = sort_mutation_table(tables, site_map, num_threads, status);
+  }
+  if (ret == 0 && !status.failed()) {
+    ret = sort_individual_table_canonical(tables, num_threads, status);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Check that the shared nodes of two table collections have the same
+//   history
+// @param self table collection
+// @param other table collection
+// @param other_node_mapping node ID in \code{self} of each node in
+//   \code{other} (\code{TSK_NULL} for nodes that are not shared)
+// @details A port of the static \code{tsk_check_subset_equality()} in
+//   \code{tskit C}: both table collections are subset to the shared nodes,
+//   canonicalised, and compared.
+// @return 0 or a \code{tskit} error code.
+int union_check_shared(const tsk_table_collection_t *self,
+                       const tsk_table_collection_t *other,
+                       const tsk_id_t *other_node_mapping) {
+  std::vector<tsk_id_t> self_nodes, other_nodes;
+  for (tsk_size_t k = 0; k < other->nodes.num_rows; k++) {
+    if (other_node_mapping[k] != TSK_NULL) {
+      self_nodes.push_back(other_node_mapping[k]);
+      other_nodes.push_back(static_cast<tsk_id_t>(k));
+    }
+  }
+  const tsk_size_t num_shared = static_cast<tsk_size_t>(self_nodes.size());
+  tsk_table_collection_t self_copy, other_copy;
+  int ret = tsk_table_collection_copy(self, &self_copy, 0);
+  int other_ret = tsk_table_collection_copy(other, &other_copy, 0);
+  if (ret == 0) {
+    ret = other_ret;
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_subset(&self_copy, self_nodes.data(),
+                                      num_shared, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_subset(&other_copy, other_nodes.data(),
+                                      num_shared, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_canonicalise(&self_copy, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_canonicalise(&other_copy, 0);
+  }
+  if (ret == 0 &&
+      !tsk_table_collection_equals(&self_copy, &other_copy,
+                                   TSK_CMP_IGNORE_TS_METADATA |
+                                       TSK_CMP_IGNORE_PROVENANCE |
+                                       TSK_CMP_IGNORE_REFERENCE_SEQUENCE)) {
+    ret = TSK_ERR_UNION_DIFF_HISTORIES;
+  }
+  tsk_table_collection_free(&self_copy);
+  tsk_table_collection_free(&other_copy);
+  return ret;
+}
+
+// INTERNAL
+// @title Union of two table collections with bulk appends
+// @param self table collection to add to
+// @param other table collection to add from
+// @param other_node_mapping node ID in \code{self} of each node in
+//   \code{other} (\code{TSK_NULL} for nodes that are added)
+// @param options the \code{TSK_UNION_*} flags
+// @details This does what \code{tsk_table_collection_union()} does, with the
+//   same result, but the rows to add are first selected (and their IDs in
+//   \code{self} worked out) by scanning \code{other}, and each table then
+//   gets them with one \code{tsk_*_table_append_columns()} call instead of
+//   one \code{tsk_*_table_add_row()} call per row. The migrations are
+//   checked before anything is added, so \code{self} is not changed when
+//   either table collection has migrations.
+// @return 0 or a \code{tskit} error code.
+int union_tables(tsk_table_collection_t *self,
+                 const tsk_table_collection_t *other,
+                 const tsk_id_t *other_node_mapping, tsk_flags_t options) {
+  const bool add_populations = !(options & TSK_UNION_NO_ADD_POP);
+  const bool all_edges = options & TSK_UNION_ALL_EDGES;
+  const bool all_mutations = options & TSK_UNION_ALL_MUTATIONS;
+  int ret = static_cast<int>(tsk_table_collection_check_integrity(self, 0));
+  if (ret == 0) {
+    ret = static_cast<int>(tsk_table_collection_check_integrity(other, 0));
+  }
+  if (ret != 0) {
+    return ret;
+  }
+  const std::size_t num_other_nodes =
+      static_cast<std::size_t>(other->nodes.num_rows);
+  for (std::size_t k = 0; k < num_other_nodes; k++) {
+    if (other_node_mapping[k] >= static_cast<tsk_id_t>(self->nodes.num_rows) ||
+        other_node_mapping[k] < TSK_NULL) {
+      return TSK_ERR_UNION_BAD_MAP;
+    }
+  }
+  if (self->migrations.num_rows != 0 || other->migrations.num_rows != 0) {
+    return TSK_ERR_MIGRATIONS_NOT_SUPPORTED;
+  }
+  if (!(options & TSK_UNION_NO_CHECK_SHARED)) {
+    ret = union_check_shared(self, other, other_node_mapping);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+
+  // Select the nodes, individuals, and populations to add, in the order
+  // tskit adds them. Individuals of shared nodes map to the individuals of
+  // the nodes in self.
+  std::vector<tsk_id_t> node_map(num_other_nodes);
+  std::vector<tsk_id_t> individual_map(
+      static_cast<std::size_t>(other->individuals.num_rows), TSK_NULL);
+  std::vector<tsk_id_t> population_map(
+      static_cast<std::size_t>(other->populations.num_rows), TSK_NULL);
+  std::vector<tsk_id_t> new_nodes, new_individuals, new_populations;
+  for (std::size_t k = 0; k < num_other_nodes; k++) {
+    const tsk_id_t i = other->nodes.individual[k];
+    if (other_node_mapping[k] != TSK_NULL && i != TSK_NULL) {
+      individual_map[static_cast<std::size_t>(i)] =
+          self->nodes.individual[other_node_mapping[k]];
+    }
+  }
+  for (std::size_t k = 0; k < num_other_nodes; k++) {
+    if (other_node_mapping[k] != TSK_NULL) {
+      node_map[k] = other_node_mapping[k];
+      continue;
+    }
+    const tsk_id_t i = other->nodes.individual[k];
+    if (i != TSK_NULL && individual_map[static_cast<std::size_t>(i)] ==
+                             TSK_NULL) {
+      individual_map[static_cast<std::size_t>(i)] = static_cast<tsk_id_t>(
+          self->individuals.num_rows + new_individuals.size());
+      new_individuals.push_back(i);
+    }
+    const tsk_id_t p = other->nodes.population[k];
+    if (p != TSK_NULL) {
+      tsk_id_t &mapped = population_map[static_cast<std::size_t>(p)];
+      if (!add_populations) {
+        mapped = p;
+      } else if (mapped == TSK_NULL) {
+        mapped = static_cast<tsk_id_t>(self->populations.num_rows +
+                                       new_populations.size());
+        new_populations.push_back(p);
+      }
+    }
+    node_map[k] =
+        static_cast<tsk_id_t>(self->nodes.num_rows + new_nodes.size());
+    new_nodes.push_back(static_cast<tsk_id_t>(k));
+  }
+
+  // Select the edges, sites, and mutations to add
+  std::vector<tsk_id_t> new_edges, new_sites, new_mutations;
+  for (tsk_size_t e = 0; e < other->edges.num_rows; e++) {
+    if (all_edges || other_node_mapping[other->edges.parent[e]] == TSK_NULL ||
+        other_node_mapping[other->edges.child[e]] == TSK_NULL) {
+      new_edges.push_back(static_cast<tsk_id_t>(e));
+    }
+  }
+  std::vector<tsk_id_t> site_map(
+      static_cast<std::size_t>(other->sites.num_rows), TSK_NULL);
+  auto add_site = [&](tsk_id_t s) {
+    site_map[static_cast<std::size_t>(s)] = static_cast<tsk_id_t>(
+        self->sites.num_rows + new_sites.size());
+    new_sites.push_back(s);
+  };
+  if (all_mutations) {
+    for (tsk_size_t s = 0; s < other->sites.num_rows; s++) {
+      add_site(static_cast<tsk_id_t>(s));
+    }
+  }
+  // As in tskit, the mutations are taken in site order
+  tsk_size_t m = 0;
+  for (tsk_size_t s = 0; s < other->sites.num_rows; s++) {
+    for (; m < other->mutations.num_rows &&
+           other->mutations.site[m] == static_cast<tsk_id_t>(s);
+         m++) {
+      if (all_mutations ||
+          other_node_mapping[other->mutations.node[m]] == TSK_NULL) {
+        if (site_map[s] == TSK_NULL) {
+          add_site(static_cast<tsk_id_t>(s));
+        }
+        new_mutations.push_back(static_cast<tsk_id_t>(m));
+      }
+    }
+  }
+
+  // Append the selected rows, one table at a time
+  worker_status status;
+  if (!new_individuals.empty()) {
+    const tsk_individual_table_t *individuals = &other->individuals;
+    const std::vector<tsk_flags_t> flags =
+        gather_column(new_individuals, individuals->flags, 1, status);
+    const ragged_column<double> location = gather_ragged_column(
+        new_individuals, individuals->location, individuals->location_offset,
+        1, status);
+    ragged_column<tsk_id_t> parents = gather_ragged_column(
+        new_individuals, individuals->parents, individuals->parents_offset, 1,
+        status);
+    const ragged_column<char> metadata = gather_ragged_column(
+        new_individuals, individuals->metadata, individuals->metadata_offset,
+        1, status);
+    remap_ids(parents.data.data(), parents.data.size(), individual_map, 1,
+              status);
+    ret = tsk_individual_table_append_columns(
+        &self->individuals, static_cast<tsk_size_t>(new_individuals.size()),
+        flags.data(), location.data_ptr(), location.offset.data(),
+        parents.data_ptr(), parents.offset.data(), metadata.data_ptr(),
+        metadata.offset.data());
+  }
+  if (ret == 0 && !new_populations.empty()) {
+    const ragged_column<char> metadata =
+        gather_ragged_column(new_populations, other->populations.metadata,
+                             other->populations.metadata_offset, 1, status);
+    ret = tsk_population_table_append_columns(
+        &self->populations, static_cast<tsk_size_t>(new_populations.size()),
+        metadata.data_ptr(), metadata.offset.data());
+  }
+  if (ret == 0 && !new_nodes.empty()) {
+    const tsk_node_table_t *nodes = &other->nodes;
+    const std::vector<tsk_flags_t> flags =
+        gather_column(new_nodes, nodes->flags, 1, status);
+    const std::vector<double> time =
+        gather_column(new_nodes, nodes->time, 1, status);
+    std::vector<tsk_id_t> population =
+        gather_column(new_nodes, nodes->population, 1, status);
+    std::vector<tsk_id_t> individual =
+        gather_column(new_nodes, nodes->individual, 1, status);
+    const ragged_column<char> metadata = gather_ragged_column(
+        new_nodes, nodes->metadata, nodes->metadata_offset, 1, status);
+    remap_ids(population.data(), population.size(), population_map, 1,
+              status);
+    remap_ids(individual.data(), individual.size(), individual_map, 1,
+              status);
+    ret = tsk_node_table_append_columns(
+        &self->nodes, static_cast<tsk_size_t>(new_nodes.size()), flags.data(),
+        time.data(), population.data(), individual.data(),
+        metadata.data_ptr(), metadata.offset.data());
+  }
+  if (ret == 0 && !new_edges.empty()) {
+    const tsk_edge_table_t *edges = &other->edges;
+    const std::vector<double> left =
+        gather_column(new_edges, edges->left, 1, status);
+    const std::vector<double> right =
+        gather_column(new_edges, edges->right, 1, status);
+    std::vector<tsk_id_t> parent =
+        gather_column(new_edges, edges->parent, 1, status);
+    std::vector<tsk_id_t> child =
+        gather_column(new_edges, edges->child, 1, status);
+    const ragged_column<char> metadata = gather_ragged_column(
+        new_edges, edges->metadata, edges->metadata_offset, 1, status);
+    remap_ids(parent.data(), parent.size(), node_map, 1, status);
+    remap_ids(child.data(), child.size(), node_map, 1, status);
+    const bool has_metadata = !metadata.data.empty();
+    ret = tsk_edge_table_append_columns(
+        &self->edges, static_cast<tsk_size_t>(new_edges.size()), left.data(),
+        right.data(), parent.data(), child.data(),
+        has_metadata ? metadata.data_ptr() : NULL,
+        has_metadata ? metadata.offset.data() : NULL);
+  }
+  if (ret == 0 && !new_sites.empty()) {
+    const tsk_site_table_t *sites = &other->sites;
+    const std::vector<double> position =
+        gather_column(new_sites, sites->position, 1, status);
+    const ragged_column<char> ancestral_state =
+        gather_ragged_column(new_sites, sites->ancestral_state,
+                             sites->ancestral_state_offset, 1, status);
+    const ragged_column<char> metadata = gather_ragged_column(
+        new_sites, sites->metadata, sites->metadata_offset, 1, status);
+    ret = tsk_site_table_append_columns(
+        &self->sites, static_cast<tsk_size_t>(new_sites.size()),
+        position.data(), ancestral_state.data_ptr(),
+        ancestral_state.offset.data(), metadata.data_ptr(),
+        metadata.offset.data());
+  }
+  if (ret == 0 && !new_mutations.empty()) {
+    const tsk_mutation_table_t *mutations = &other->mutations;
+    std::vector<tsk_id_t> site =
+        gather_column(new_mutations, mutations->site, 1, status);
+    std::vector<tsk_id_t> node =
+        gather_column(new_mutations, mutations->node, 1, status);
+    // The parents are computed once the tables are sorted
+    const std::vector<tsk_id_t> parent(new_mutations.size(), TSK_NULL);
+    const std::vector<double> time =
+        gather_column(new_mutations, mutations->time, 1, status);
+    const ragged_column<char> derived_state =
+        gather_ragged_column(new_mutations, mutations->derived_state,
+                             mutations->derived_state_offset, 1, status);
+    const ragged_column<char> metadata = gather_ragged_column(
+        new_mutations, mutations->metadata, mutations->metadata_offset, 1,
+        status);
+    remap_ids(site.data(), site.size(), site_map, 1, status);
+    remap_ids(node.data(), node.size(), node_map, 1, status);
+    ret = tsk_mutation_table_append_columns(
+        &self->mutations, static_cast<tsk_size_t>(new_mutations.size()),
+        site.data(), node.data(), parent.data(), time.data(),
+        derived_state.data_ptr(), derived_state.offset.data(),
+        metadata.data_ptr(), metadata.offset.data());
+  }
+
+  // Sort, deduplicate the sites, sort again (the mutations of merged sites
+  // may be out of order), and compute the mutation parents, as tskit does
+  if (ret == 0) {
+    ret = tsk_table_collection_sort(self, NULL, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_deduplicate_sites(self, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_sort(self, NULL, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_build_index(self, 0);
+  }
+  if (ret == 0) {
+    ret = tsk_table_collection_compute_mutation_parents(self, 0);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Registry of table collections that borrow tables from a tree
+//   sequence
+// @details Maps each table collection from
+//   \code{rtsk_treeseq_copy_tables(lazy = true)} to the \code{RTSK_*} mask
+//   of the tables (see \code{RcppTskit.hpp}) that it still borrows.
+// @return The registry.
+std::unordered_map<const tsk_table_collection_t *, unsigned> &
+borrowed_tables() {
+  static std::unordered_map<const tsk_table_collection_t *, unsigned> borrowed;
+  return borrowed;
+}
+
+// INTERNAL
+// @title Copy the borrowed tables of a table collection
+// @param tc table collection.
+// @param tables bitwise \code{RTSK_*} mask of the tables to copy.
+// @details Registered as the C callable \code{rtsk_table_collection_own}
+//   (see \code{RcppTskit.hpp}). The indexes are copied with their own
+//   length, which differs from the number of edges when edges were added
+//   after dumping the tables.
+// @return 0 or a \code{tskit} error code, in which case the table that
+//   failed stays borrowed.
+int table_collection_own(tsk_table_collection_t *tc, unsigned tables) {
+  auto &registry = borrowed_tables();
+  auto it = registry.find(tc);
+  if (it == registry.end()) {
+    return 0;
+  }
+  unsigned &borrowed = it->second;
+  auto own = [&](unsigned bit, auto *table, auto copy, auto free_table) {
+    if (!(tables & borrowed & bit)) {
+      return 0;
+    }
+    const auto columns = *table;
+    int ret = copy(&columns, table, 0);
+    if (ret != 0) {
+      free_table(table);
+      *table = columns;
+      return ret;
+    }
+    borrowed &= ~bit;
+    return 0;
+  };
+  int ret = own(RTSK_INDIVIDUALS, &tc->individuals, tsk_individual_table_copy,
+                tsk_individual_table_free);
+  if (ret == 0) {
+    ret = own(RTSK_NODES, &tc->nodes, tsk_node_table_copy, tsk_node_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_EDGES, &tc->edges, tsk_edge_table_copy, tsk_edge_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_MIGRATIONS, &tc->migrations, tsk_migration_table_copy,
+              tsk_migration_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_SITES, &tc->sites, tsk_site_table_copy, tsk_site_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_MUTATIONS, &tc->mutations, tsk_mutation_table_copy,
+              tsk_mutation_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_POPULATIONS, &tc->populations, tsk_population_table_copy,
+              tsk_population_table_free);
+  }
+  if (ret == 0) {
+    ret = own(RTSK_PROVENANCES, &tc->provenances, tsk_provenance_table_copy,
+              tsk_provenance_table_free);
+  }
+  if (ret == 0 && (tables & borrowed & RTSK_INDEXES)) {
+    const tsk_size_t size = tc->indexes.num_edges * sizeof(tsk_id_t);
+    tsk_id_t *insertion = static_cast<tsk_id_t *>(tsk_malloc(size));
+    tsk_id_t *removal = static_cast<tsk_id_t *>(tsk_malloc(size));
+    if (insertion == NULL || removal == NULL) {
+      tsk_safe_free(insertion);
+      tsk_safe_free(removal);
+      ret = TSK_ERR_NO_MEMORY;
+    } else {
+      tsk_memcpy(insertion, tc->indexes.edge_insertion_order, size);
+      tsk_memcpy(removal, tc->indexes.edge_removal_order, size);
+      tc->indexes.edge_insertion_order = insertion;
+      tc->indexes.edge_removal_order = removal;
+      borrowed &= ~RTSK_INDEXES;
+    }
+  }
+  if (borrowed == 0) {
+    registry.erase(it);
+  }
+  return ret;
+}
+
+// INTERNAL
+// @title Forget the borrowed tables of a table collection
+// @param tc table collection.
+// @param tables bitwise \code{RTSK_*} mask of the tables to forget.
+// @details Registered as the C callable \code{rtsk_table_collection_release}
+//   (see \code{RcppTskit.hpp}). The forgotten tables are zeroed, neither
+//   copied nor freed.
+void table_collection_release(tsk_table_collection_t *tc, unsigned tables) {
+  auto &registry = borrowed_tables();
+  auto it = registry.find(tc);
+  if (it == registry.end()) {
+    return;
+  }
+  const unsigned released = it->second & tables;
+  if (released & RTSK_INDIVIDUALS) {
+    tc->individuals = tsk_individual_table_t{};
+  }
+  if (released & RTSK_NODES) {
+    tc->nodes = tsk_node_table_t{};
+  }
+  if (released & RTSK_EDGES) {
+    tc->edges = tsk_edge_table_t{};
+  }
+  if (released & RTSK_MIGRATIONS) {
+    tc->migrations = tsk_migration_table_t{};
+  }
+  if (released & RTSK_SITES) {
+    tc->sites = tsk_site_table_t{};
+  }
+  if (released & RTSK_MUTATIONS) {
+    tc->mutations = tsk_mutation_table_t{};
+  }
+  if (released & RTSK_POPULATIONS) {
+    tc->populations = tsk_population_table_t{};
+  }
+  if (released & RTSK_PROVENANCES) {
+    tc->provenances = tsk_provenance_table_t{};
+  }
+  if (released & RTSK_INDEXES) {
+    tc->indexes = {};
+  }
+  it->second &= ~released;
+  if (it->second == 0) {
+    registry.erase(it);
+  }
+}
+
+// INTERNAL
+// @title Own the tables of a table collection before modifying them
+// @param tables table collection.
+// @param mask bitwise \code{RTSK_*} tables (see \code{RcppTskit.hpp}) that
+//   the caller modifies.
+// @details A table collection from
+//   \code{rtsk_treeseq_copy_tables(lazy = true)} borrows its tables from a
+//   tree sequence; the borrowed tables in \code{mask} are copied here, so
+//   the tree sequence is never modified.
+void own_tables(tsk_table_collection_t *tables, unsigned mask) {
+  int ret = table_collection_own(tables, mask);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+} // namespace
+
+// INTERNAL
+// @title Register the C callables of RcppTskit
+// @param dll the \code{DllInfo} of RcppTskit.
+// @details Called when the package is loaded. Code using
+//   \code{RcppTskit.hpp} (also in other packages) reaches the registry of
+//   borrowed tables through these callables.
+// [[Rcpp::init]]
+void rtsk_register_ccallables(DllInfo *dll) {
+  (void)dll;
+  R_RegisterCCallable("RcppTskit", "rtsk_table_collection_own",
+                      reinterpret_cast<DL_FUNC>(&table_collection_own));
+  R_RegisterCCallable("RcppTskit", "rtsk_table_collection_release",
+                      reinterpret_cast<DL_FUNC>(&table_collection_release));
+}
+
+// TEST-ONLY
+// @title Test helper for validating tskit flags
+// @param options that will be validated
+// @param supported integer bitmask for supported options
+// @return Validated flags as integer.
+// [[Rcpp::export]]
+int test_validate_options(int options, int supported) {
+  const tsk_flags_t out = validate_options(
+      options, static_cast<tsk_flags_t>(supported), "test_validate_options");
+  return static_cast<int>(out);
+}
+
+// TEST-ONLY
+// @title Test helper for the concurrent integrity check in small chunks
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options bitwise \code{TSK_CHECK_*} flags.
+// @param threads number of threads checking the tables.
+// @param chunk_size rows per chunk, small enough to split small tables.
+// @return The number of trees, 0, or the \code{tskit} error code (no error is
+//   raised) - testing against \code{test_tsk_table_collection_check_integrity}.
+// [[Rcpp::export]]
+int test_integrity_check(SEXP tc, int options, int threads, int chunk_size) {
+  const int num_threads = validate_threads(threads, "test_integrity_check");
+  if (chunk_size < 1) {
+    Rcpp::stop("chunk_size must be positive");
+  }
+  rtsk_table_collection_t tc_xptr(tc);
+  worker_status status;
+  const tsk_id_t ret =
+      integrity_check(tc_xptr, static_cast<tsk_flags_t>(options),
+                      static_cast<std::size_t>(chunk_size))
+          .run(num_threads, status);
+  status.stop_if_failed();
+  return static_cast<int>(ret);
+}
+
+// TEST-ONLY
+// @title Test helper for integer64 wrapping of \code{tsk_size_t}
+// @param value character representation of unsigned integer
+// @param force_range_error logical flag for testing range-check branch
+// @return \code{R bit64::integer64} object.
+// [[Rcpp::export]]
+SEXP test_rtsk_wrap_tsk_size_t_as_integer64(const std::string &value,
+                                            bool force_range_error = false) {
+  unsigned long long parsed = 0;
+  std::size_t parsed_chars = 0;
+  try {
+    parsed = std::stoull(value, &parsed_chars, 10);
+  } catch (const std::exception &) {
+    Rcpp::stop("value must be a valid base-10 unsigned integer string");
+  }
+  if (parsed_chars != value.size()) {
+    Rcpp::stop("value must be a valid base-10 unsigned integer string");
+  }
+  const tsk_size_t tsk_value = static_cast<tsk_size_t>(parsed);
+  if (force_range_error ||
+      static_cast<unsigned long long>(tsk_value) != parsed) {
+    Rcpp::stop("value is out of range for tsk_size_t");
+  }
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_value, "test_rtsk_wrap_tsk_size_t_as_integer64");
+}
+
+// PUBLIC
+//' @title Report the version of installed kastore C API
+//' @details The version is stored in the installed header \code{kastore.h}.
+//' @return A named vector with three elements \code{major}, \code{minor}, and
+//'   \code{patch}.
+//' @examples
+//' kastore_version()
+//' @export
+// [[Rcpp::export]]
+Rcpp::IntegerVector kastore_version() {
+  // Rcpp::_["major"] is shorthand for Rcpp::Named("major")
+  return Rcpp::IntegerVector::create(Rcpp::_["major"] = KAS_VERSION_MAJOR,
+                                     Rcpp::_["minor"] = KAS_VERSION_MINOR,
+                                     Rcpp::_["patch"] = KAS_VERSION_PATCH);
+}
+
+// PUBLIC
+//' @title Report the version of installed \code{tskit} C API
+//' @details The version is defined in the installed header \code{tskit/core.h}.
+//' @return A named vector with three elements \code{major}, \code{minor}, and
+//'   \code{patch}.
+//' @examples
+//' tskit_version()
+//' @export
+// [[Rcpp::export]]
+Rcpp::IntegerVector tskit_version() {
+  return Rcpp::IntegerVector::create(Rcpp::_["major"] = TSK_VERSION_MAJOR,
+                                     Rcpp::_["minor"] = TSK_VERSION_MINOR,
+                                     Rcpp::_["patch"] = TSK_VERSION_PATCH);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_load
+// @title Load a tree sequence from a file
+// @param filename a string specifying the full path of the tree sequence file.
+// @param options passed to \code{tskit C} (see details and note that only
+//   \code{TSK_LOAD_SKIP_TABLES} and \code{TSK_LOAD_SKIP_REFERENCE_SEQUENCE},
+//   but not \code{TSK_NO_INIT}, are supported by this wrapper).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_load}.
+// @return An external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object
+// @seealso \code{\link{ts_load}} and
+//   \code{\link[=TreeSequence]{TreeSequence$new}} on how this function is used
+//   and presented to users.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// is(ts_xptr)
+// ts_xptr
+// RcppTskit:::rtsk_treeseq_get_num_nodes(ts_xptr)
+// ts <- TreeSequence$new(xptr = ts_xptr)
+// is(ts)
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_load(const std::string &filename, int options = 0) {
+  const tsk_flags_t flags = validate_load_options(options, "rtsk_treeseq_load");
+  // tsk_treeseq_t ts; // on stack, destroyed end of func, must free resources
+  tsk_treeseq_t *ts_ptr = new tsk_treeseq_t(); // on heap, persists function
+  // See also https://tskit.dev/tskit/docs/stable/c-api.html#api-structure
+  int ret = tsk_treeseq_load(ts_ptr, filename.c_str(), flags);
+  if (ret != 0) {
+    tsk_treeseq_free(ts_ptr);
+    delete ts_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  // Wrap standard/raw ts_ptr for R as an external pointer handle (xptr)
+  // "true" below means that R will call finaliser on garbage collection
+  rtsk_treeseq_t ts_xptr(ts_ptr, true);
+  return ts_xptr;
+}
+
+// PUBLIC, wrapper for tsk_table_collection_load
+// @title Load a table collection from a file
+// @param filename a string specifying the full path of the tree sequence file.
+// @param options passed to \code{tskit C} (see details and note that only
+//   \code{TSK_LOAD_SKIP_TABLES} and \code{TSK_LOAD_SKIP_REFERENCE_SEQUENCE},
+//   but not \code{TSK_NO_INIT}, are supported by this wrapper).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_load}.
+// @return An external pointer to table collection as a
+//   \code{tsk_table_collection_t} object
+// @seealso \code{\link{tc_load}} and
+//   \code{\link[=TableCollection]{TableCollection$new}} on how this function is
+//   used and presented to users.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// is(tc_xptr)
+// tc_xptr
+// RcppTskit:::rtsk_table_collection_print(tc_xptr)
+// tc <- TableCollection$new(xptr = tc_xptr)
+// is(tc)
+// [[Rcpp::export]]
+SEXP rtsk_table_collection_load(const std::string &filename, int options = 0) {
+  const tsk_flags_t flags =
+      validate_load_options(options, "rtsk_table_collection_load");
+  tsk_table_collection_t *tc_ptr = new tsk_table_collection_t();
+  int ret = tsk_table_collection_load(tc_ptr, filename.c_str(), flags);
+  if (ret != 0) {
+    tsk_table_collection_free(tc_ptr);
+    delete tc_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  // Wrap standard/raw tc_ptr for R as an external pointer handle (xptr)
+  // "true" below means that R will call finaliser on garbage collection
+  rtsk_table_collection_t tc_xptr(tc_ptr, true);
+  return tc_xptr;
+}
+
+// PUBLIC, wrapper for tsk_treeseq_dump
+// @title Write a tree sequence to a file
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param filename a string specifying the full path of the tree sequence file.
+// @param options passed to \code{tskit C} (see details and note that
+//   these options are currently unused in \code{tskit} and should be \code{0}).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_dump}.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// dump_file <- tempfile()
+// RcppTskit:::rtsk_treeseq_dump(ts_xptr, dump_file)
+// file.remove(dump_file)
+// [[Rcpp::export]]
+void rtsk_treeseq_dump(SEXP ts, const std::string &filename, int options = 0) {
+  const tsk_flags_t flags = validate_options(options, 0, "rtsk_treeseq_dump");
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_treeseq_dump");
+  int ret = tsk_treeseq_dump(ts_xptr, filename.c_str(), flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_dump
+// @title Write a table collection to a file
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param filename a string specifying the full path of the tree sequence file.
+// @param options passed to \code{tskit C} (see details and note that
 //   these options are currently unused in \code{tskit} and should be \code{0}).
 // @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_dump}.
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_dump}.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// dump_file <- tempfile()
+// RcppTskit:::rtsk_table_collection_dump(tc_xptr, dump_file)
+// file.remove(dump_file)
+// [[Rcpp::export]]
+void rtsk_table_collection_dump(SEXP tc, const std::string &filename,
+                                int options = 0) {
+  const tsk_flags_t flags =
+      validate_options(options, 0, "rtsk_table_collection_dump");
+  rtsk_table_collection_t tc_xptr(tc);
+  int ret = tsk_table_collection_dump(tc_xptr, filename.c_str(), flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_treeseq_copy_tables
+// @title Copy a tree sequence's tables into a table collection
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper does not support \code{TSK_NO_INIT}, but supports
+//   \code{TSK_COPY_FILE_UUID}).
+// @param lazy logical; borrow the tables instead of copying them (see
+//   details)?
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_copy_tables}.
+//   With \code{lazy = true} the table collection instead borrows the tables
+//   and edge indexes of the tree sequence (whose external pointer it keeps
+//   alive) and copies a table only when it is first modified by an
+//   \code{RcppTskit} function; only the top-level metadata, time units,
+//   reference sequence, and file UUID are copied here. Other code must call
+//   \code{rtsk_table_collection_own()} (see \code{RcppTskit.hpp}) before
+//   it modifies such a table collection with \code{tskit C} functions.
+//   See also low-level Python-C call of \code{TreeSequence_dump_tables} at
+//   \url{https://github.com/tskit-dev/tskit/blob/dc394d72d121c99c6dcad88f7a4873880924dd72/python/_tskitmodule.c#L5323}
+// @return An external pointer to table collection as a
+//   \code{tsk_table_collection_t} object
+// @seealso \code{\link{tc_load}} and
+//   \code{\link[=TreeSequence]{TreeSequence$dump_tables}} on how this function
+//   is used and presented to users.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// tc_xptr <- RcppTskit:::rtsk_treeseq_copy_tables(ts_xptr)
+// is(tc_xptr)
+// tc_xptr
+// RcppTskit:::rtsk_table_collection_print(tc_xptr)
+// tc_xptr <- RcppTskit:::rtsk_treeseq_copy_tables(ts_xptr, lazy = TRUE)
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_copy_tables(SEXP ts, int options = 0, bool lazy = false) {
+  const tsk_flags_t flags =
+      validate_copy_tables_options(options, "rtsk_treeseq_copy_tables");
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_treeseq_copy_tables");
+  tsk_table_collection_t *tc_ptr = new tsk_table_collection_t();
+  if (!lazy) {
+    int ret = tsk_treeseq_copy_tables(ts_xptr, tc_ptr, flags);
+    if (ret != 0) {
+      tsk_table_collection_free(tc_ptr);
+      delete tc_ptr;
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    // Wrap standard/raw tc_ptr for R as an external pointer handle (xptr)
+    // "true" below means that R will call finaliser on garbage collection
+    rtsk_table_collection_t tc_xptr(tc_ptr, true);
+    return tc_xptr;
+  }
+  const tsk_table_collection_t *tables = ts_xptr->tables;
+  // Copy everything but the tables and indexes, which are swapped for empty
+  // ones in a shallow copy of the tree sequence's table collection
+  tsk_table_collection_t empty;
+  int ret = tsk_table_collection_init(&empty, 0);
+  if (ret != 0) {
+    tsk_table_collection_free(&empty);
+    delete tc_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  tsk_table_collection_t header = *tables;
+  header.individuals = empty.individuals;
+  header.nodes = empty.nodes;
+  header.edges = empty.edges;
+  header.migrations = empty.migrations;
+  header.sites = empty.sites;
+  header.mutations = empty.mutations;
+  header.populations = empty.populations;
+  header.provenances = empty.provenances;
+  header.indexes = empty.indexes;
+  ret = tsk_table_collection_copy(&header, tc_ptr, flags);
+  tsk_table_collection_free(&empty);
+  if (ret != 0) {
+    tsk_table_collection_free(tc_ptr);
+    delete tc_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  tsk_individual_table_free(&tc_ptr->individuals);
+  tsk_node_table_free(&tc_ptr->nodes);
+  tsk_edge_table_free(&tc_ptr->edges);
+  tsk_migration_table_free(&tc_ptr->migrations);
+  tsk_site_table_free(&tc_ptr->sites);
+  tsk_mutation_table_free(&tc_ptr->mutations);
+  tsk_population_table_free(&tc_ptr->populations);
+  tsk_provenance_table_free(&tc_ptr->provenances);
+  tc_ptr->individuals = tables->individuals;
+  tc_ptr->nodes = tables->nodes;
+  tc_ptr->edges = tables->edges;
+  tc_ptr->migrations = tables->migrations;
+  tc_ptr->sites = tables->sites;
+  tc_ptr->mutations = tables->mutations;
+  tc_ptr->populations = tables->populations;
+  tc_ptr->provenances = tables->provenances;
+  tc_ptr->indexes = tables->indexes;
+  borrowed_tables()[tc_ptr] = RTSK_ALL_TABLES;
+  // The tree sequence is protected for as long as the tables borrow from it
+  rtsk_table_collection_t tc_xptr(tc_ptr, true, R_NilValue, ts);
+  return tc_xptr;
+}
+
+// PUBLIC, wrapper for tsk_treeseq_init
+// @title Initialise a tree sequence from a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports
+//   \code{TSK_TS_INIT_BUILD_INDEXES} and
+//   \code{TSK_TS_INIT_COMPUTE_MUTATION_PARENTS}, but not
+//   \code{TSK_TAKE_OWNERSHIP}; use \code{consume} instead).
+// @param topology_only logical; build the tree sequence without sites and
+//   mutations (for topology and branch statistics)?
+// @param consume logical; move the tables into the tree sequence instead of
+//   copying them (see details)?
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_init}.
+//   See also low-level Python-C call of \code{TreeSequence_load_tables} at
+//   \url{https://github.com/tskit-dev/tskit/blob/dc394d72d121c99c6dcad88f7a4873880924dd72/python/_tskitmodule.c#L5292}.
+//   With \code{topology_only = TRUE}, the tables except sites, mutations,
+//   and the reference sequence are copied and handed over to
+//   \code{tsk_treeseq_init()} with \code{TSK_TAKE_OWNERSHIP} (our copy is
+//   not reachable from \code{R}), so the sites and mutations are neither
+//   copied nor indexed. Such a tree sequence is marked as topology-only:
+//   functions that need sites, mutations, or the reference sequence (such
+//   as \code{rtsk_treeseq_get_num_sites()}, the genotype decoders, and
+//   \code{rtsk_treeseq_dump()}) raise an error instead of returning empty
+//   results (see \code{rtsk_treeseq_is_topology_only()}). A full tree
+//   sequence can be initialised from the same table collection when sites
+//   are needed. The breakpoints of the trees are still found in one
+//   sequential pass by \code{tsk_treeseq_init()}.
+//
+//   With \code{consume = TRUE}, the tables are handed over to
+//   \code{tsk_treeseq_init()} with \code{TSK_TAKE_OWNERSHIP} in O(1): the
+//   \code{tsk_table_collection_t} struct (not its columns) is moved into
+//   \code{tsk_malloc()} memory, which \code{tsk_treeseq_free()} frees with
+//   \code{free()}, and the external pointer \code{tc} is cleared, so that
+//   later use of it raises an error. Tables that \code{tc} borrows from
+//   another tree sequence (see \code{rtsk_treeseq_copy_tables()}) are copied
+//   first. If the initialisation fails, the tables are handed back to
+//   \code{tc}.
+// @return An external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object
+// @seealso \code{\link{tc_load}} and
+//   \code{\link[=TableCollection]{TableCollection$tree_sequence}} on how this
+//   function is used and presented to users.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_print(tc_xptr)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_init(tc_xptr)
+// RcppTskit:::rtsk_treeseq_print(ts_xptr)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_init(tc_xptr, topology_only = TRUE)
+// RcppTskit:::rtsk_treeseq_is_topology_only(ts_xptr)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_init(tc_xptr, consume = TRUE)
+// RcppTskit:::rtsk_treeseq_get_num_sites(ts_xptr)
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_init(SEXP tc, int options = 0, bool topology_only = false,
+                       bool consume = false) {
+  const tsk_flags_t flags =
+      validate_treeseq_init_options(options, "rtsk_treeseq_init");
+  if (topology_only && consume) {
+    Rcpp::stop("rtsk_treeseq_init does not support topology_only with "
+               "consume");
+  }
+  rtsk_table_collection_t tc_xptr(tc);
+  if (consume) {
+    // Borrowed tables stay owned by the other tree sequence, so are copied
+    own_tables(tc_xptr, RTSK_ALL_TABLES);
+  }
+  tsk_treeseq_t *ts_ptr = new tsk_treeseq_t();
+  int ret;
+  if (topology_only) {
+    // tsk_treeseq_free() frees the tables with free(), so they are allocated
+    // with tsk_malloc()
+    tsk_table_collection_t *tables = static_cast<tsk_table_collection_t *>(
+        tsk_malloc(sizeof(tsk_table_collection_t)));
+    if (tables == NULL) {
+      delete ts_ptr;
+      Rcpp::stop(tsk_strerror(TSK_ERR_NO_MEMORY));
+    }
+    ret = copy_topology_tables(tc_xptr, tables);
+    if (ret != 0) {
+      tsk_table_collection_free(tables);
+      tsk_safe_free(tables);
+      delete ts_ptr;
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    // The tree sequence owns the tables from here on, also on failure
+    ret = tsk_treeseq_init(ts_ptr, tables, flags | TSK_TAKE_OWNERSHIP);
+  } else if (consume) {
+    // Only the struct is moved into tsk_malloc() memory, as above; the
+    // columns are handed over as they are
+    tsk_table_collection_t *source = tc_xptr;
+    tsk_table_collection_t *tables = static_cast<tsk_table_collection_t *>(
+        tsk_malloc(sizeof(tsk_table_collection_t)));
+    if (tables == NULL) {
+      delete ts_ptr;
+      Rcpp::stop(tsk_strerror(TSK_ERR_NO_MEMORY));
+    }
+    *tables = *source;
+    ret = tsk_treeseq_init(ts_ptr, tables, flags | TSK_TAKE_OWNERSHIP);
+    if (ret == 0) {
+      // Leave tc moved-from: a cleared external pointer is never finalised
+      // and raises an error when it is used
+      R_ClearExternalPtr(tc);
+      R_SetExternalPtrProtected(tc, R_NilValue);
+      delete source;
+    } else {
+      // Hand the tables back to tc (with any index built on the way)
+      *source = *tables;
+      ts_ptr->tables = NULL;
+      tsk_safe_free(tables);
+    }
+  } else {
+    ret = tsk_treeseq_init(ts_ptr, tc_xptr, flags);
+  }
+  if (ret != 0) {
+    tsk_treeseq_free(ts_ptr);
+    delete ts_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  // Wrap standard/raw ts_ptr for R as an external pointer handle (xptr)
+  // "true" below means that R will call finaliser on garbage collection
+  rtsk_treeseq_t ts_xptr(ts_ptr, true,
+                         topology_only ? topology_only_tag() : R_NilValue);
+  return ts_xptr;
+}
+
+// PUBLIC, RcppTskit extension
+// @title Is a tree sequence initialised without sites and mutations
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @return \code{TRUE} for a tree sequence from
+//   \code{rtsk_treeseq_init(topology_only = TRUE)}, otherwise \code{FALSE}.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_init(tc_xptr, topology_only = TRUE)
+// RcppTskit:::rtsk_treeseq_is_topology_only(ts_xptr)
+// [[Rcpp::export]]
+bool rtsk_treeseq_is_topology_only(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return R_ExternalPtrTag(ts) == topology_only_tag();
+}
+
+// See tsk_treeseq_t inst/include/tskit/tskit/trees.h on which elements
+// are there in a tsk_treeseq_t type.
+// Here is a copy with comments on what we have implemented in RcppTskit:
+//  * tsk_size_t num_trees; SCALAR, IMPLEMENTED HERE
+//  * tsk_size_t num_samples; SCALAR, IMPLEMENTED HERE
+//  * tsk_id_t *samples; ARRAY, TODO LATER #49
+//  * bool time_uncalibrated; SKIPPED (for now) since we have time_units
+//  * bool discrete_genome; SCALAR, IMPLEMENTED HERE
+//  * bool discrete_time; SCALAR, IMPLEMENTED HERE
+//  * double min_time; SCALAR, IMPLEMENTED HERE
+//  * double max_time; SCALAR, IMPLEMENTED HERE
+//  * double *breakpoints; ARRAY, TODO LATER #49
+//  * tsk_id_t *sample_index_map; ARRAY, TODO LATER #49
+//  * tsk_id_t *individual_nodes_mem; ARRAY, TODO LATER #49
+//  * tsk_id_t **individual_nodes; ARRAY, TODO LATER #49
+//  * tsk_size_t *individual_nodes_length; ARRAY, TODO LATER #49
+//  * tsk_site_t *tree_sites_mem; ARRAY, TODO LATER #49
+//  * tsk_site_t **tree_sites; ARRAY, TODO LATER #49
+//  * tsk_size_t *tree_sites_length; ARRAY, TODO LATER #49
+//  * tsk_mutation_t *site_mutations_mem; ARRAY, TODO LATER #49
+//  * tsk_mutation_t **site_mutations; ARRAY, TODO LATER #49
+//  * tsk_size_t *site_mutations_length; ARRAY, TODO LATER #49
+//  * tsk_table_collection_t *tables; SKIPPED since we might look into
+//    table-column arrays/vectors
+//
+// Here is the Python API summary
+// https://tskit.dev/tskit/docs/stable/python-api.html#trees-and-tree-sequences
+// https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence
+// https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.max_root_time
+// is a scalar property (which we have strived to implement / mirror here),
+// but this one requires table-column arrays, which we will look into in #49
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_provenances
+// @describeIn rtsk_treeseq_summary Get the number of provenances in a tree
+// sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_provenances(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_treeseq_get_num_provenances(ts_xptr),
+      "rtsk_treeseq_get_num_provenances");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_populations
+// @describeIn rtsk_treeseq_summary Get the number of populations in a tree
+// sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_populations(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_treeseq_get_num_populations(ts_xptr),
+      "rtsk_treeseq_get_num_populations");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_migrations
+// @describeIn rtsk_treeseq_summary Get the number of migrations in a tree
+// sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_migrations(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_treeseq_get_num_migrations(ts_xptr),
+      "rtsk_treeseq_get_num_migrations");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_individuals
+// @describeIn rtsk_treeseq_summary Get the number of individuals in a tree
+// sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_individuals(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_treeseq_get_num_individuals(ts_xptr),
+      "rtsk_treeseq_get_num_individuals");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_samples
+// @describeIn rtsk_treeseq_summary Get the number of samples (of nodes) in a
+// tree
+//   sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_samples(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_samples(ts_xptr),
+                                           "rtsk_treeseq_get_num_samples");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_nodes
+// @describeIn rtsk_treeseq_summary Get the number of nodes in a tree sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_nodes(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_nodes(ts_xptr),
+                                           "rtsk_treeseq_get_num_nodes");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_edges
+// @describeIn rtsk_treeseq_summary Get the number of edges in a tree sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_edges(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_edges(ts_xptr),
+                                           "rtsk_treeseq_get_num_edges");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_trees
+// @describeIn rtsk_treeseq_summary Get the number of trees in a tree sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_trees(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_trees(ts_xptr),
+                                           "rtsk_treeseq_get_num_trees");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_sites
+// @describeIn rtsk_treeseq_summary Get the number of sites in a tree sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_sites(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_treeseq_get_num_sites");
+  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_sites(ts_xptr),
+                                           "rtsk_treeseq_get_num_sites");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_num_mutations
+// @describeIn rtsk_treeseq_summary Get the number of mutations in a tree
+// sequence
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_get_num_mutations(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_treeseq_get_num_mutations");
+  return rtsk_wrap_tsk_size_t_as_integer64(
+      tsk_treeseq_get_num_mutations(ts_xptr), "rtsk_treeseq_get_num_mutations");
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_sequence_length
+// @describeIn rtsk_treeseq_summary Get the sequence length
+// [[Rcpp::export]]
+double rtsk_treeseq_get_sequence_length(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return tsk_treeseq_get_sequence_length(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_discrete_genome
+// @describeIn rtsk_treeseq_summary Get the discrete genome status
+// [[Rcpp::export]]
+bool rtsk_treeseq_get_discrete_genome(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return tsk_treeseq_get_discrete_genome(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_has_reference_sequence
+// @describeIn rtsk_treeseq_summary Does the tree sequence hold a reference
+// genome
+//   sequence
+// @details Note that \code{tsk_treeseq_has_reference_sequence} is undocumented
+//   method in the \code{tskit C} API (see \code{trees.h}), but documented in
+//   \code{tskit Python} API
+//   https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.has_reference_sequence
+// [[Rcpp::export]]
+bool rtsk_treeseq_has_reference_sequence(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_treeseq_has_reference_sequence");
+  return tsk_treeseq_has_reference_sequence(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_time_units and
+// tsk_treeseq_get_time_units_length.
+// @describeIn rtsk_treeseq_summary Get the time units string
+// [[Rcpp::export]]
+Rcpp::String rtsk_treeseq_get_time_units(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  const char *p = tsk_treeseq_get_time_units(ts_xptr);
+  tsk_size_t n = tsk_treeseq_get_time_units_length(ts_xptr);
+  std::string time_units;
+  if (n > 0 && p != NULL) {
+    time_units.assign(p, p + n);
+  }
+  return Rcpp::String(time_units);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_discrete_time
+// @describeIn rtsk_treeseq_summary Get the discrete time status
+// [[Rcpp::export]]
+bool rtsk_treeseq_get_discrete_time(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return tsk_treeseq_get_discrete_time(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_min_time
+// @describeIn rtsk_treeseq_summary Get the min time in node table and mutation
+// table
+// [[Rcpp::export]]
+double rtsk_treeseq_get_min_time(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return tsk_treeseq_get_min_time(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_max_time
+// @describeIn rtsk_treeseq_summary Get the max time in node table and mutation
+// table
+// [[Rcpp::export]]
+double rtsk_treeseq_get_max_time(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  return tsk_treeseq_get_max_time(ts_xptr);
+}
+
+// PUBLIC, wrapper for tsk_treeseq_get_file_uuid
+// @describeIn rtsk_treeseq_summary Get the file uuid string
+// [[Rcpp::export]]
+Rcpp::String rtsk_treeseq_get_file_uuid(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  const char *p = tsk_treeseq_get_file_uuid(ts_xptr);
+  if (p == NULL || p[0] == '\0') {
+    return Rcpp::String(NA_STRING);
+  }
+  return Rcpp::String(p);
+}
+
+// PUBLIC, RcppTskit extension
+// @name rtsk_treeseq_summary
+// @title Summary of properties and number of records in a tree sequence
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @details These functions return the summary of properties and number of
+//   records in a tree sequence, by calling
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_provenances},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_populations},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_migrations},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_individuals},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_samples},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_nodes},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_edges},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_trees},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_sites},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_mutations},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_sequence_length},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_discrete_genome},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_has_reference_sequence},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_time_units},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_discrete_time},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_min_time},
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_max_time},
+//   and
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_file_uuid},
+// @return \code{rtsk_treeseq_summary} returns a named list with numbers and
+//   values, while functions \code{rtsk_treeseq_*} return the number or value
+//   for each item. Count-like values are returned as \code{R bit64::integer64}
+//   to approach range in \code{C tsk_size_t / uint64_t}
+//   (see \code{rtsk_wrap_tsk_size_t_as_integer64} for more details).
+//   For a tree sequence from \code{rtsk_treeseq_init(topology_only = TRUE)},
+//   the summary has \code{NA} for \code{num_sites}, \code{num_mutations},
+//   and \code{has_reference_sequence}, whose functions raise an error.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// RcppTskit:::rtsk_treeseq_summary(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_provenances(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_populations(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_migrations(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_individuals(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_samples(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_nodes(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_edges(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_trees(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_sites(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_mutations(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_sequence_length(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_discrete_genome(ts_xptr)
+// RcppTskit:::rtsk_treeseq_has_reference_sequence(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_time_units(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_discrete_time(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_min_time(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_max_time(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_file_uuid(ts_xptr)
+// EXTENSION: composite summary helper (no single tsk_* equivalent).
+// [[Rcpp::export]]
+Rcpp::List rtsk_treeseq_summary(SEXP ts) {
+  const bool topology_only = rtsk_treeseq_is_topology_only(ts);
+  Rcpp::LogicalVector na = Rcpp::LogicalVector::create(NA_LOGICAL);
+  return Rcpp::List::create(
+      Rcpp::_["num_provenances"] = rtsk_treeseq_get_num_provenances(ts),
+      Rcpp::_["num_populations"] = rtsk_treeseq_get_num_populations(ts),
+      Rcpp::_["num_migrations"] = rtsk_treeseq_get_num_migrations(ts),
+      Rcpp::_["num_individuals"] = rtsk_treeseq_get_num_individuals(ts),
+      Rcpp::_["num_samples"] = rtsk_treeseq_get_num_samples(ts),
+      Rcpp::_["num_nodes"] = rtsk_treeseq_get_num_nodes(ts),
+      Rcpp::_["num_edges"] = rtsk_treeseq_get_num_edges(ts),
+      Rcpp::_["num_trees"] = rtsk_treeseq_get_num_trees(ts),
+      Rcpp::_["num_sites"] =
+          topology_only ? SEXP(na) : rtsk_treeseq_get_num_sites(ts),
+      Rcpp::_["num_mutations"] =
+          topology_only ? SEXP(na) : rtsk_treeseq_get_num_mutations(ts),
+      Rcpp::_["sequence_length"] = rtsk_treeseq_get_sequence_length(ts),
+      Rcpp::_["discrete_genome"] = rtsk_treeseq_get_discrete_genome(ts),
+      Rcpp::_["has_reference_sequence"] =
+          topology_only
+              ? SEXP(na)
+              : Rcpp::wrap(rtsk_treeseq_has_reference_sequence(ts)),
+      Rcpp::_["time_units"] = rtsk_treeseq_get_time_units(ts),
+      Rcpp::_["discrete_time"] = rtsk_treeseq_get_discrete_time(ts),
+      Rcpp::_["min_time"] = rtsk_treeseq_get_min_time(ts),
+      Rcpp::_["max_time"] = rtsk_treeseq_get_max_time(ts),
+      Rcpp::_["file_uuid"] = rtsk_treeseq_get_file_uuid(ts));
+}
+
+// PUBLIC, RcppTskit extension
+// @title Get the length of metadata in a tree sequence and its tables
+// @param ts tree sequence as a \code{\link{TreeSequence}} object or
+//   an external pointer to tree sequence as a \code{tsk_treeseq_t} object.
+// @details This function returns the length of metadata stored on the tree
+//   sequence and in each table by calling
+//   \code{ts->tables->metadata_length} and
+//   \code{ts->tables->x->metadata_length} on each table \code{x}, e.g.,
+// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_population_table_t.metadata_length}.
+// @return A named list with the length of metadata as \code{R bit64::integer64}
+//   values.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// RcppTskit:::rtsk_treeseq_metadata_length(ts_xptr)
+// [[Rcpp::export]]
+Rcpp::List rtsk_treeseq_metadata_length(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  const tsk_table_collection_t *tables = ts_xptr->tables;
+  return Rcpp::List::create(
+      // The tree sequence metadata is the tables collection metadata and
+      // tsk_treeseq_get_metadata_length() returns self->tables->metadata_length
+      // Rcpp::_["ts"] =
+      //    static_cast<int>(tsk_treeseq_get_metadata_length(ts_xptr)),
+      // hence we just use that here
+      Rcpp::_["ts"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->metadata_length,
+          "rtsk_treeseq_metadata_length/tables->metadata_length"),
+      Rcpp::_["populations"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->populations.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->populations.metadata_length"),
+      Rcpp::_["migrations"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->migrations.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->migrations.metadata_length"),
+      Rcpp::_["individuals"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->individuals.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->individuals.metadata_length"),
+      Rcpp::_["nodes"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->nodes.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->nodes.metadata_length"),
+      Rcpp::_["edges"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->edges.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->edges.metadata_length"),
+      Rcpp::_["sites"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->sites.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->sites.metadata_length"),
+      Rcpp::_["mutations"] = rtsk_wrap_tsk_size_t_as_integer64(
+          tables->mutations.metadata_length,
+          "rtsk_treeseq_metadata_length/tables->mutations.metadata_length"));
+}
+
+// INTERNAL (for now)
+// # nocov start
+// TODO: Metadata notes if we do anything with metadata #36
+//       https://github.com/HighlanderLab/RcppTskit/issues/36
+// This is how we would get metadata, but it will be raw bytes,
+// so would have to work with schema and codes ...
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// RcppTskit:::rtsk_treeseq_get_metadata(ts_xptr)
+// slendr::ts_metadata(slim_ts)
+Rcpp::String rtsk_treeseq_get_metadata(SEXP ts) {
+  rtsk_treeseq_t ts_xptr(ts);
+  const char *p = tsk_treeseq_get_metadata(ts_xptr);
+  tsk_size_t n = tsk_treeseq_get_metadata_length(ts_xptr);
+  std::string metadata;
+  if (n > 0 && p != NULL) {
+    metadata.assign(p, p + n);
+  }
+  return Rcpp::String(metadata);
+}
+// # nocov end
+
+// TODO: Metadata notes if we do anything with metadata #36
+//       https://github.com/HighlanderLab/RcppTskit/issues/36
+// int rtsk_treeseq_metadata_schema_length(const SEXP ts) {
+//  rtsk_treeseq_t ts_xptr(ts);
+//  return static_cast<int>(tsk_treeseq_get_metadata_schema_length(ts_xptr));
+// }
+// TODO: test the above function
+// TODO: document the above function
+// TODO: expose the above function to R, including TreeSequence method
+
+// TODO: Develop tsk_treeseq_get_metadata
+// TODO: Metadata notes if we do anything with metadata #36
+//       https://github.com/HighlanderLab/RcppTskit/issues/36
+
+// PUBLIC, RcppTskit extension
+// @title Write all trees of a tree sequence to a file in Newick format
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param filename a string specifying the full path of the output file.
+// @param precision integer number of decimal places for branch lengths
+//   (between 0 and 16).
+// @param interval logical; if \code{TRUE}, prefix each tree with the
+//   \code{ms}-style \code{[span]} of its genomic interval.
+// @param compress logical; if \code{TRUE}, write a gzip-compressed file.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_NEWICK_LEGACY_MS_LABELS}).
+// @details This function iterates over all trees and calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_convert_newick}
+//   for each tree, writing one tree per line. The Newick string of every tree
+//   is rendered into one buffer that is reused across trees and only grown
+//   (doubled) when \code{tsk_convert_newick} reports
+//   \code{TSK_ERR_BUFFER_OVERFLOW}, and the strings are written to a buffered
+//   (optionally gzip-compressed) stream. Every tree must have a single root.
 // @return No return value; called for side effects.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
-// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
-// dump_file <- tempfile()
-// RcppTskit:::rtsk_table_collection_dump(tc_xptr, dump_file)
-// file.remove(dump_file)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// newick_file <- tempfile(fileext = ".nwk")
+// RcppTskit:::rtsk_treeseq_write_newick(ts_xptr, newick_file)
+// readLines(newick_file, n = 2)
+// file.remove(newick_file)
 // [[Rcpp::export]]
-void rtsk_table_collection_dump(SEXP tc, const std::string &filename,
-                                int options = 0) {
-  const tsk_flags_t flags =
-      validate_options(options, 0, "rtsk_table_collection_dump");
-  rtsk_table_collection_t tc_xptr(tc);
-  int ret = tsk_table_collection_dump(tc_xptr, filename.c_str(), flags);
+void rtsk_treeseq_write_newick(SEXP ts, const std::string &filename,
+                               int precision = 14, bool interval = true,
+                               bool compress = false, int options = 0) {
+  if (precision < 0 || precision > 16) {
+    Rcpp::stop("rtsk_treeseq_write_newick requires precision between 0 and "
+               "16");
+  }
+  if (options < 0) {
+    Rcpp::stop("rtsk_treeseq_write_newick does not support negative options");
+  }
+  const tsk_flags_t flags = static_cast<tsk_flags_t>(options);
+  const tsk_flags_t unsupported = flags & ~kNewickSupportedFlags;
+  if (unsupported != 0) {
+    Rcpp::stop("rtsk_treeseq_write_newick only supports option "
+               "TSK_NEWICK_LEGACY_MS_LABELS (1 << 0); unsupported bits: 0x%X",
+               static_cast<unsigned int>(unsupported));
+  }
+  rtsk_treeseq_t ts_xptr(ts);
+  output_stream out(filename, compress);
+
+  tsk_tree_t tree;
+  int ret = tsk_tree_init(&tree, ts_xptr, 0);
+  if (ret != 0) {
+    tsk_tree_free(&tree);
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  std::vector<char> newick(1024);
+  char span[64];
+  bool multiple_roots = false;
+  for (ret = tsk_tree_first(&tree); ret == TSK_TREE_OK;
+       ret = tsk_tree_next(&tree)) {
+    if (tsk_tree_get_num_roots(&tree) != 1) {
+      multiple_roots = true;
+      break;
+    }
+    const tsk_id_t root = tsk_tree_get_left_root(&tree);
+    while ((ret = tsk_convert_newick(&tree, root,
+                                     static_cast<unsigned int>(precision),
+                                     flags, newick.size(), newick.data())) ==
+           TSK_ERR_BUFFER_OVERFLOW) {
+      newick.resize(2 * newick.size());
+    }
+    if (ret != 0) {
+      break;
+    }
+    if (interval) {
+      const int n = std::snprintf(span, sizeof(span), "[%.17g]",
+                                  tree.interval.right - tree.interval.left);
+      out.write(span, static_cast<std::size_t>(n));
+    }
+    out.write(newick.data(), std::strlen(newick.data()));
+    out.put('\n');
+  }
+  tsk_tree_free(&tree);
+  if (multiple_roots) {
+    Rcpp::stop("rtsk_treeseq_write_newick requires every tree to have a "
+               "single root");
+  }
   if (ret != 0) {
     Rcpp::stop(tsk_strerror(ret));
   }
+  out.close();
 }
 
-// PUBLIC, wrapper for tsk_treeseq_copy_tables
-// @title Copy a tree sequence's tables into a table collection
+// PUBLIC, RcppTskit extension
+// @title Decode a genotype matrix into compact bytes
 // @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
 //   object.
+// @param sites integer vector of site IDs (0-based); \code{NULL} means all
+//   sites.
+// @param samples integer vector of sample node IDs (0-based); \code{NULL}
+//   means all samples of the tree sequence.
+// @param format genotype encoding, one of \code{"int8"}, \code{"2bit"}, or
+//   \code{"bitpacked"} (see details).
+// @param threads number of threads decoding blocks of sites in parallel.
+// @param filename a string specifying the full path of the output file;
+//   \code{""} means that the genotypes are returned as a matrix.
 // @param options passed to \code{tskit C} (see details and note that
-//   this wrapper does not support \code{TSK_NO_INIT}, but supports
-//   \code{TSK_COPY_FILE_UUID}).
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
 // @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_copy_tables}.
-//   See also low-level Python-C call of \code{TreeSequence_dump_tables} at
-//   \url{https://github.com/tskit-dev/tskit/blob/dc394d72d121c99c6dcad88f7a4873880924dd72/python/_tskitmodule.c#L5323}
-// @return An external pointer to table collection as a
-//   \code{tsk_table_collection_t} object
-// @seealso \code{\link{tc_load}} and
-//   \code{\link[=TreeSequence]{TreeSequence$dump_tables}} on how this function
-//   is used and presented to users.
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_decode}
+//   on blocks of consecutive sites, with one \code{tsk_variant_t} per thread,
+//   and packs the genotypes of each site straight into the output, so only
+//   one site per thread is ever held as \code{int32_t}. Encodings are:
+//   \code{int8} one byte per sample holding the allele index and \code{0xFF}
+//   for missing data (up to 255 alleles); \code{2bit} four samples per byte,
+//   sample \code{j} in bits \code{2 * (j mod 4)}, holding the allele index
+//   and \code{3} for missing data (up to 3 alleles); \code{bitpacked} eight
+//   samples per byte, sample \code{j} in bit \code{j mod 8}, set for the
+//   non-ancestral allele (biallelic sites without missing data).
+//   When \code{filename} is given, sites are decoded in chunks and written
+//   to the file in order, one site after another with the same layout as
+//   the columns of the returned matrix, so the whole matrix is never held in
+//   memory.
+// @return A raw matrix with one column per site and one row per sample
+//   (\code{int8}) or per byte of packed samples, or no return value when
+//   \code{filename} is given.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
 // ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// tc_xptr <- RcppTskit:::rtsk_treeseq_copy_tables(ts_xptr)
-// is(tc_xptr)
-// tc_xptr
-// RcppTskit:::rtsk_table_collection_print(tc_xptr)
+// G <- RcppTskit:::rtsk_treeseq_genotype_matrix(ts_xptr)
+// dim(G)
+// G[, 1:3]
+// G <- RcppTskit:::rtsk_treeseq_genotype_matrix(ts_xptr, format = "2bit")
+// dim(G)
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_copy_tables(SEXP ts, int options = 0) {
-  const tsk_flags_t flags =
-      validate_copy_tables_options(options, "rtsk_treeseq_copy_tables");
+SEXP rtsk_treeseq_genotype_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> sites = R_NilValue,
+    Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    const std::string &format = "int8", int threads = 1,
+    const std::string &filename = "", int options = 0) {
+  const char *caller = "rtsk_treeseq_genotype_matrix";
+  const tsk_flags_t flags = validate_variant_options(options, caller);
+  const genotype_format fmt = parse_genotype_format(format, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  tsk_table_collection_t *tc_ptr = new tsk_table_collection_t();
-  int ret = tsk_treeseq_copy_tables(ts_xptr, tc_ptr, flags);
-  if (ret != 0) {
-    tsk_table_collection_free(tc_ptr);
-    delete tc_ptr;
-    Rcpp::stop(tsk_strerror(ret));
+  require_sites(ts, caller);
+
+  const std::vector<tsk_id_t> site_ids = sites_or_all(ts_xptr, sites, caller);
+  const std::vector<tsk_id_t> sample_ids = int_vector_to_tsk_id_vector(
+      nullable_to_vector_or_empty<Rcpp::IntegerVector>(samples));
+  const std::size_t num_samples =
+      samples.isNull() ? static_cast<std::size_t>(ts_xptr->num_samples)
+                       : sample_ids.size();
+  if (!samples.isNull() && sample_ids.empty()) {
+    Rcpp::stop("%s requires at least one sample", caller);
   }
-  // Wrap standard/raw tc_ptr for R as an external pointer handle (xptr)
-  // "true" below means that R will call finaliser on garbage collection
-  rtsk_table_collection_t tc_xptr(tc_ptr, true);
-  return tc_xptr;
+  const std::size_t num_sites = site_ids.size();
+  const std::size_t bytes_per_site = genotype_bytes_per_site(fmt, num_samples);
+
+  num_threads = threads_for_sites(num_threads, num_sites);
+  variant_set variants(ts_xptr, sample_ids, flags, num_threads);
+
+  // Decode sites [first, last) of site_ids into out (bytes_per_site each)
+  auto decode = [&](std::size_t first, std::size_t last, unsigned char *out) {
+    decode_sites(variants, num_threads, site_ids.data() + first, last - first,
+                 caller, [&](const tsk_variant_t *variant, std::size_t j) {
+                   return pack_genotypes(variant, fmt,
+                                         out + j * bytes_per_site);
+                 });
+  };
+
+  if (filename.empty()) {
+    const std::size_t max_dim =
+        static_cast<std::size_t>(std::numeric_limits<int>::max());
+    if (bytes_per_site > max_dim || num_sites > max_dim) {
+      Rcpp::stop("%s: matrix is too large for R, write it to a file instead",
+                 caller);
+    }
+    Rcpp::RawMatrix out(static_cast<int>(bytes_per_site),
+                        static_cast<int>(num_sites));
+    decode(0, num_sites, RAW(out));
+    return out;
+  }
+
+  output_stream file(filename, false);
+  const std::size_t chunk_sites = sites_per_chunk(bytes_per_site, num_threads);
+  std::vector<unsigned char> chunk;
+  for (std::size_t first = 0; first < num_sites; first += chunk_sites) {
+    const std::size_t last = std::min(first + chunk_sites, num_sites);
+    chunk.resize((last - first) * bytes_per_site);
+    decode(first, last, chunk.data());
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+    Rcpp::checkUserInterrupt();
+  }
+  file.close();
+  return R_NilValue;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_init
-// @title Initialise a tree sequence from a table collection
-// @param tc an external pointer to table collection as a
-//   \code{tsk_table_collection_t} object.
+// PUBLIC, RcppTskit extension
+// @title Create an iterator over the variants (sites) of a tree sequence
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param samples integer vector of sample node IDs (0-based); \code{NULL}
+//   means all samples of the tree sequence.
 // @param options passed to \code{tskit C} (see details and note that
-//   this wrapper supports
-//   \code{TSK_TS_INIT_BUILD_INDEXES} and
-//   \code{TSK_TS_INIT_COMPUTE_MUTATION_PARENTS}, but not
-//   \code{TSK_TAKE_OWNERSHIP}).
-//   \code{TSK_TAKE_OWNERSHIP} is unsupported because the input
-//   table collection remains reachable via R external pointer (risk of
-//   dangling alias / double-free), and because the ownership path of
-//   \code{tsk_treeseq_free()} is based on C
-//   \code{malloc()/free()}, while this wrapper manages that outer struct with
-//   C++ \code{new()/delete()}.
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
 // @details This function calls
-//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_init}.
-//   See also low-level Python-C call of \code{TreeSequence_load_tables} at
-//   \url{https://github.com/tskit-dev/tskit/blob/dc394d72d121c99c6dcad88f7a4873880924dd72/python/_tskitmodule.c#L5292}
-// @return An external pointer to tree sequence as a \code{tsk_treeseq_t}
-//   object
-// @seealso \code{\link{tc_load}} and
-//   \code{\link[=TableCollection]{TableCollection$tree_sequence}} on how this
-//   function is used and presented to users.
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_init}.
+//   The iterator keeps a reference to \code{ts}, so the tree sequence is not
+//   garbage collected while the iterator is in use.
+// @return An external pointer to a variant iterator.
+// @seealso \code{\link{rtsk_variant_iterator_next_block}} and
+//   \code{\link[=TreeSequence]{TreeSequence$variants}} on how this function
+//   is used and presented to users.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
-// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
-// RcppTskit:::rtsk_table_collection_print(tc_xptr)
-// ts_xptr <- RcppTskit:::rtsk_treeseq_init(tc_xptr)
-// RcppTskit:::rtsk_treeseq_print(ts_xptr)
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// it_xptr <- RcppTskit:::rtsk_variant_iterator_init(ts_xptr)
+// block <- RcppTskit:::rtsk_variant_iterator_next_block(it_xptr, 5L)
+// str(block)
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_init(SEXP tc, int options = 0) {
+SEXP rtsk_variant_iterator_init(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    int options = 0) {
   const tsk_flags_t flags =
-      validate_treeseq_init_options(options, "rtsk_treeseq_init");
-  rtsk_table_collection_t tc_xptr(tc);
-  tsk_treeseq_t *ts_ptr = new tsk_treeseq_t();
-  int ret = tsk_treeseq_init(ts_ptr, tc_xptr, flags);
+      validate_variant_options(options, "rtsk_variant_iterator_init");
+  rtsk_treeseq_t ts_xptr(ts);
+  require_sites(ts, "rtsk_variant_iterator_init");
+  const std::vector<tsk_id_t> sample_ids = int_vector_to_tsk_id_vector(
+      nullable_to_vector_or_empty<Rcpp::IntegerVector>(samples));
+  if (!samples.isNull() && sample_ids.empty()) {
+    Rcpp::stop("rtsk_variant_iterator_init requires at least one sample");
+  }
+  rtsk_variant_iterator *it_ptr = new rtsk_variant_iterator();
+  int ret = tsk_variant_init(
+      &it_ptr->variant, ts_xptr, samples.isNull() ? NULL : sample_ids.data(),
+      static_cast<tsk_size_t>(sample_ids.size()), NULL, flags);
   if (ret != 0) {
-    tsk_treeseq_free(ts_ptr);
-    delete ts_ptr;
+    rtsk_variant_iterator_free(it_ptr);
     Rcpp::stop(tsk_strerror(ret));
   }
-  // Wrap standard/raw ts_ptr for R as an external pointer handle (xptr)
-  // "true" below means that R will call finaliser on garbage collection
-  rtsk_treeseq_t ts_xptr(ts_ptr, true);
-  return ts_xptr;
+  it_ptr->next_site = 0;
+  // "true" below means that R will call finaliser on garbage collection,
+  // while ts is protected from garbage collection by the iterator
+  rtsk_variant_iterator_t it_xptr(it_ptr, true, R_NilValue, ts);
+  return it_xptr;
 }
 
-// See tsk_treeseq_t inst/include/tskit/tskit/trees.h on which elements
-// are there in a tsk_treeseq_t type.
-// Here is a copy with comments on what we have implemented in RcppTskit:
-//  * tsk_size_t num_trees; SCALAR, IMPLEMENTED HERE
-//  * tsk_size_t num_samples; SCALAR, IMPLEMENTED HERE
-//  * tsk_id_t *samples; ARRAY, TODO LATER #49
-//  * bool time_uncalibrated; SKIPPED (for now) since we have time_units
-//  * bool discrete_genome; SCALAR, IMPLEMENTED HERE
-//  * bool discrete_time; SCALAR, IMPLEMENTED HERE
-//  * double min_time; SCALAR, IMPLEMENTED HERE
-//  * double max_time; SCALAR, IMPLEMENTED HERE
-//  * double *breakpoints; ARRAY, TODO LATER #49
-//  * tsk_id_t *sample_index_map; ARRAY, TODO LATER #49
-//  * tsk_id_t *individual_nodes_mem; ARRAY, TODO LATER #49
-//  * tsk_id_t **individual_nodes; ARRAY, TODO LATER #49
-//  * tsk_size_t *individual_nodes_length; ARRAY, TODO LATER #49
-//  * tsk_site_t *tree_sites_mem; ARRAY, TODO LATER #49
-//  * tsk_site_t **tree_sites; ARRAY, TODO LATER #49
-//  * tsk_size_t *tree_sites_length; ARRAY, TODO LATER #49
-//  * tsk_mutation_t *site_mutations_mem; ARRAY, TODO LATER #49
-//  * tsk_mutation_t **site_mutations; ARRAY, TODO LATER #49
-//  * tsk_size_t *site_mutations_length; ARRAY, TODO LATER #49
-//  * tsk_table_collection_t *tables; SKIPPED since we might look into
-//    table-column arrays/vectors
-//
-// Here is the Python API summary
-// https://tskit.dev/tskit/docs/stable/python-api.html#trees-and-tree-sequences
-// https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence
-// https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.max_root_time
-// is a scalar property (which we have strived to implement / mirror here),
-// but this one requires table-column arrays, which we will look into in #49
-
-// PUBLIC, wrapper for tsk_treeseq_get_num_provenances
-// @describeIn rtsk_treeseq_summary Get the number of provenances in a tree
-// sequence
+// PUBLIC, RcppTskit extension
+// @title Decode the next block of variants (sites) of a tree sequence
+// @param it an external pointer to a variant iterator from
+//   \code{rtsk_variant_iterator_init}.
+// @param block_size maximum number of sites in the block.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_decode}
+//   for each site in the block. The \code{tsk_variant_t} of the iterator,
+//   including its genotype buffer, is private to the iterator and reused
+//   across sites and blocks, while every block is returned in a new genotype
+//   matrix, so blocks never share memory with each other.
+// @return \code{NULL} when all sites have been decoded, otherwise a list with
+//   the site IDs (0-based) \code{site}, the site positions \code{position},
+//   a sites by samples integer matrix \code{genotypes} of allele indices
+//   (\code{NA} for missing data), and a list of allele character vectors
+//   \code{alleles}.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// it_xptr <- RcppTskit:::rtsk_variant_iterator_init(ts_xptr)
+// while (!is.null(block <- RcppTskit:::rtsk_variant_iterator_next_block(
+//   it_xptr, 10L))) {
+//   print(dim(block$genotypes))
+// }
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_provenances(SEXP ts) {
-  rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_treeseq_get_num_provenances(ts_xptr),
-      "rtsk_treeseq_get_num_provenances");
-}
+SEXP rtsk_variant_iterator_next_block(SEXP it, int block_size = 1000) {
+  if (block_size < 1) {
+    Rcpp::stop("rtsk_variant_iterator_next_block requires block_size to be a "
+               "positive integer");
+  }
+  rtsk_variant_iterator_t it_xptr(it);
+  tsk_variant_t *variant = &it_xptr->variant;
+  const tsk_size_t num_sites = tsk_treeseq_get_num_sites(variant->tree_sequence);
+  const tsk_id_t first = it_xptr->next_site;
+  if (static_cast<tsk_size_t>(first) >= num_sites) {
+    return R_NilValue;
+  }
+  const int n = static_cast<int>(std::min<tsk_size_t>(
+      static_cast<tsk_size_t>(block_size),
+      num_sites - static_cast<tsk_size_t>(first)));
+  const int num_samples = static_cast<int>(variant->num_samples);
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_populations
-// @describeIn rtsk_treeseq_summary Get the number of populations in a tree
-// sequence
-// [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_populations(SEXP ts) {
-  rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_treeseq_get_num_populations(ts_xptr),
-      "rtsk_treeseq_get_num_populations");
+  Rcpp::IntegerMatrix genotypes(n, num_samples);
+  int *g = INTEGER(genotypes);
+  Rcpp::IntegerVector site_ids(n);
+  Rcpp::NumericVector positions(n);
+  Rcpp::List alleles(n);
+  for (int i = 0; i < n; i++) {
+    const tsk_id_t site = first + static_cast<tsk_id_t>(i);
+    int ret = tsk_variant_decode(variant, site, 0);
+    if (ret != 0) {
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    const int32_t *site_genotypes = variant->genotypes;
+    for (int j = 0; j < num_samples; j++) {
+      const int32_t value = site_genotypes[j];
+      g[i + static_cast<R_xlen_t>(j) * n] =
+          value == TSK_MISSING_DATA ? NA_INTEGER : value;
+    }
+    Rcpp::CharacterVector site_alleles(
+        static_cast<R_xlen_t>(variant->num_alleles));
+    for (tsk_size_t k = 0; k < variant->num_alleles; k++) {
+      site_alleles[k] = std::string(variant->alleles[k],
+                                    variant->allele_lengths[k]);
+    }
+    site_ids[i] = site;
+    positions[i] = variant->site.position;
+    alleles[i] = site_alleles;
+  }
+  it_xptr->next_site = first + static_cast<tsk_id_t>(n);
+  return Rcpp::List::create(Rcpp::_["site"] = site_ids,
+                            Rcpp::_["position"] = positions,
+                            Rcpp::_["genotypes"] = genotypes,
+                            Rcpp::_["alleles"] = alleles);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_migrations
-// @describeIn rtsk_treeseq_summary Get the number of migrations in a tree
-// sequence
+// PUBLIC, RcppTskit extension
+// @title Reset a variant iterator to the first site
+// @param it an external pointer to a variant iterator from
+//   \code{rtsk_variant_iterator_init}.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// it_xptr <- RcppTskit:::rtsk_variant_iterator_init(ts_xptr)
+// b1 <- RcppTskit:::rtsk_variant_iterator_next_block(it_xptr, 5L)
+// RcppTskit:::rtsk_variant_iterator_reset(it_xptr)
+// b2 <- RcppTskit:::rtsk_variant_iterator_next_block(it_xptr, 5L)
+// identical(b1, b2)
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_migrations(SEXP ts) {
-  rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_treeseq_get_num_migrations(ts_xptr),
-      "rtsk_treeseq_get_num_migrations");
+void rtsk_variant_iterator_reset(SEXP it) {
+  rtsk_variant_iterator_t it_xptr(it);
+  it_xptr->next_site = 0;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_individuals
-// @describeIn rtsk_treeseq_summary Get the number of individuals in a tree
-// sequence
+// PUBLIC, RcppTskit extension
+// @title Write genotypes of individuals to PLINK .bed/.bim/.fam files
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param prefix a string specifying the full path of the output files
+//   without the \code{.bed}, \code{.bim}, and \code{.fam} extensions.
+// @param individuals integer vector of individual IDs (0-based);
+//   \code{NULL} means all individuals of the tree sequence.
+// @param ploidy number of nodes of every individual (1 or 2).
+// @param contig a string with the chromosome code for the \code{.bim} file.
+// @param threads number of threads decoding blocks of sites in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_decode}
+//   over the nodes of the individuals (\code{ts->individual_nodes}) on blocks
+//   of consecutive sites, with one \code{tsk_variant_t} per thread, and packs
+//   the genotypes straight into SNP-major 2-bit \code{.bed} records. Chunks
+//   of sites are written in site order, so only one chunk is ever held in
+//   memory. In the \code{.bim} file, A1 is the derived allele and A2 is the
+//   ancestral allele, variant IDs are \code{site_<site ID>}, and positions
+//   are rounded to the nearest integer. Monomorphic sites get the missing
+//   allele code \code{0} for A1. Sites with more than two alleles cannot be
+//   stored in the \code{.bed} format and are skipped with a warning.
+//   In the \code{.fam} file, family and individual IDs are
+//   \code{tsk_<individual ID>}, with unknown parents, sex, and phenotype.
+//   All three files are opened before any is written, and they are removed
+//   if the export fails, so an error never leaves a partial set of files.
+//   See \url{https://www.cog-genomics.org/plink/1.9/formats} for the formats.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// prefix <- tempfile()
+// RcppTskit:::rtsk_treeseq_write_plink(ts_xptr, prefix)
+// readLines(paste0(prefix, ".fam"))
+// head(readLines(paste0(prefix, ".bim")))
+// file.remove(paste0(prefix, c(".bed", ".bim", ".fam")))
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_individuals(SEXP ts) {
+void rtsk_treeseq_write_plink(
+    SEXP ts, const std::string &prefix,
+    Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    int ploidy = 2, const std::string &contig = "1", int threads = 1,
+    int options = 0) {
+  const char *caller = "rtsk_treeseq_write_plink";
+  const tsk_flags_t flags = validate_variant_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
+  if (ploidy != 1 && ploidy != 2) {
+    Rcpp::stop("%s supports ploidy 1 or 2", caller);
+  }
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_treeseq_get_num_individuals(ts_xptr),
-      "rtsk_treeseq_get_num_individuals");
-}
+  require_sites(ts, caller);
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_samples
-// @describeIn rtsk_treeseq_summary Get the number of samples (of nodes) in a
-// tree
-//   sequence
-// [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_samples(SEXP ts) {
-  rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_samples(ts_xptr),
-                                           "rtsk_treeseq_get_num_samples");
+  const individual_node_set inds =
+      individuals_or_all(ts_xptr, individuals, caller);
+  const std::size_t num_individuals = inds.ids.size();
+  for (std::size_t k = 0; k < num_individuals; k++) {
+    const std::size_t num_nodes = inds.offsets[k + 1] - inds.offsets[k];
+    if (num_nodes != static_cast<std::size_t>(ploidy)) {
+      Rcpp::stop("%s: individual %d has %d nodes, but ploidy is %d", caller,
+                 static_cast<int>(inds.ids[k]), static_cast<int>(num_nodes),
+                 ploidy);
+    }
+  }
+  const std::vector<tsk_id_t> site_ids =
+      sites_or_all(ts_xptr, R_NilValue, caller);
+  const std::size_t num_sites = site_ids.size();
+  const std::size_t bytes_per_site = (num_individuals + 3) / 4;
+  const double *positions = ts_xptr->tables->sites.position;
+
+  num_threads = threads_for_sites(num_threads, num_sites);
+  variant_set variants(ts_xptr, inds.nodes, flags, num_threads);
+
+  output_file_set files({prefix + ".fam", prefix + ".bed", prefix + ".bim"});
+  output_stream &fam = files[0];
+  output_stream &bed = files[1];
+  output_stream &bim = files[2];
+  for (const tsk_id_t id : inds.ids) {
+    const std::string name = "tsk_" + std::to_string(id);
+    fam.write(name + " " + name + " 0 0 0 -9\n");
+  }
+
+  static const char magic[3] = {0x6c, 0x1b, 0x01};
+  bed.write(magic, sizeof(magic));
+
+  const std::size_t chunk_sites = sites_per_chunk(bytes_per_site, num_threads);
+  std::vector<unsigned char> chunk;
+  // alleles of each site in the chunk (pointing into the tables), with
+  // a NULL A2 for skipped sites
+  std::vector<const char *> a1(chunk_sites), a2(chunk_sites);
+  std::vector<tsk_size_t> a1_length(chunk_sites), a2_length(chunk_sites);
+  std::size_t num_skipped = 0;
+  std::string line;
+  for (std::size_t first = 0; first < num_sites; first += chunk_sites) {
+    const std::size_t last = std::min(first + chunk_sites, num_sites);
+    chunk.resize((last - first) * bytes_per_site);
+    decode_sites(variants, num_threads, site_ids.data() + first, last - first,
+                 caller,
+                 [&](const tsk_variant_t *variant,
+                     std::size_t j) -> const char * {
+                   if (variant->num_alleles > 2) {
+                     a2[j] = NULL;
+                     return NULL;
+                   }
+                   a2[j] = variant->alleles[0];
+                   a2_length[j] = variant->allele_lengths[0];
+                   if (variant->num_alleles == 2) {
+                     a1[j] = variant->alleles[1];
+                     a1_length[j] = variant->allele_lengths[1];
+                   } else {
+                     a1_length[j] = 0;
+                   }
+                   pack_plink_genotypes(variant, ploidy,
+                                        chunk.data() + j * bytes_per_site);
+                   return NULL;
+                 });
+    for (std::size_t j = 0; j < last - first; j++) {
+      if (a2[j] == NULL) {
+        num_skipped++;
+        continue;
+      }
+      bed.write(reinterpret_cast<const char *>(chunk.data()) +
+                    j * bytes_per_site,
+                bytes_per_site);
+      const tsk_id_t site = site_ids[first + j];
+      line = contig;
+      line += "\tsite_" + std::to_string(site) + "\t0\t" +
+              std::to_string(std::llround(positions[site])) + "\t";
+      // PLINK uses 0 for a missing allele code
+      line.append(a1_length[j] == 0 ? "0" : std::string(a1[j], a1_length[j]));
+      line += '\t';
+      line.append(a2_length[j] == 0 ? "0" : std::string(a2[j], a2_length[j]));
+      line += '\n';
+      bim.write(line);
+    }
+    Rcpp::checkUserInterrupt();
+  }
+  files.close();
+  if (num_skipped > 0) {
+    Rcpp::warning("%s skipped %d sites with more than two alleles", caller,
+                  static_cast<int>(num_skipped));
+  }
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_nodes
-// @describeIn rtsk_treeseq_summary Get the number of nodes in a tree sequence
+// PUBLIC, RcppTskit extension
+// @title Decode allele dosages of individuals
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param individuals integer vector of individual IDs (0-based);
+//   \code{NULL} means all individuals of the tree sequence.
+// @param sites integer vector of site IDs (0-based); \code{NULL} means all
+//   sites.
+// @param type \code{"double"} or \code{"int8"} (see details).
+// @param centre logical; if \code{TRUE}, subtract the mean dosage of each
+//   site (only with \code{type = "double"}).
+// @param scale logical; if \code{TRUE}, divide the dosages of each site by
+//   their standard deviation (only with \code{type = "double"}).
+// @param threads number of threads decoding blocks of sites in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_decode}
+//   over the nodes of the individuals (\code{ts->individual_nodes}) on blocks
+//   of consecutive sites, with one \code{tsk_variant_t} per thread, and sums
+//   the genotypes of each individual's nodes straight into the column of the
+//   site, so no haplotype matrix is held in memory. The dosage is the number
+//   of an individual's nodes that carry a non-ancestral allele; an individual
+//   with any missing node is missing. \code{double} returns \code{NA} for
+//   missing data and centres and scales each site as \code{base::scale()},
+//   ignoring missing data. \code{int8} returns one byte per dosage and
+//   \code{0xFF} for missing data.
+// @return A numeric or raw matrix with one row per individual and one column
+//   per site.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// X <- RcppTskit:::rtsk_treeseq_dosage_matrix(ts_xptr)
+// dim(X)
+// X[, 1:3]
+// Z <- RcppTskit:::rtsk_treeseq_dosage_matrix(ts_xptr, centre = TRUE)
+// colMeans(Z)[1:3]
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_nodes(SEXP ts) {
+SEXP rtsk_treeseq_dosage_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    Rcpp::Nullable<Rcpp::IntegerVector> sites = R_NilValue,
+    const std::string &type = "double", bool centre = false,
+    bool scale = false, int threads = 1, int options = 0) {
+  const char *caller = "rtsk_treeseq_dosage_matrix";
+  const tsk_flags_t flags = validate_variant_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
+  if (type != "double" && type != "int8") {
+    Rcpp::stop("%s supports type double or int8", caller);
+  }
+  const bool as_double = type == "double";
+  if (!as_double && (centre || scale)) {
+    Rcpp::stop("%s supports centre and scale only with type double", caller);
+  }
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_nodes(ts_xptr),
-                                           "rtsk_treeseq_get_num_nodes");
+  require_sites(ts, caller);
+
+  const individual_node_set inds =
+      individuals_or_all(ts_xptr, individuals, caller);
+  check_individuals_have_nodes(inds, caller);
+  const std::vector<tsk_id_t> site_ids = sites_or_all(ts_xptr, sites, caller);
+  const std::size_t num_individuals = inds.ids.size();
+  const std::size_t num_sites = site_ids.size();
+  const std::size_t max_dim =
+      static_cast<std::size_t>(std::numeric_limits<int>::max());
+  if (num_sites > max_dim) {
+    Rcpp::stop("%s: matrix is too large for R", caller);
+  }
+
+  num_threads = threads_for_sites(num_threads, num_sites);
+  variant_set variants(ts_xptr, inds.nodes, flags, num_threads);
+
+  if (!as_double) {
+    Rcpp::RawMatrix out(static_cast<int>(num_individuals),
+                        static_cast<int>(num_sites));
+    unsigned char *data = RAW(out);
+    decode_sites(
+        variants, num_threads, site_ids.data(), num_sites, caller,
+        [&](const tsk_variant_t *variant, std::size_t j) -> const char * {
+          unsigned char *column = data + j * num_individuals;
+          for (std::size_t k = 0; k < num_individuals; k++) {
+            const int dosage =
+                individual_dosage(variant->genotypes, inds, k);
+            column[k] = dosage < 0 ? 0xFF : static_cast<unsigned char>(dosage);
+          }
+          return NULL;
+        });
+    return out;
+  }
+
+  Rcpp::NumericMatrix out(static_cast<int>(num_individuals),
+                          static_cast<int>(num_sites));
+  double *data = REAL(out);
+  const double na = NA_REAL;
+  decode_sites(
+      variants, num_threads, site_ids.data(), num_sites, caller,
+      [&](const tsk_variant_t *variant, std::size_t j) -> const char * {
+        double *column = data + j * num_individuals;
+        double sum = 0;
+        std::size_t count = 0;
+        for (std::size_t k = 0; k < num_individuals; k++) {
+          const int dosage = individual_dosage(variant->genotypes, inds, k);
+          if (dosage < 0) {
+            column[k] = na;
+          } else {
+            column[k] = dosage;
+            sum += dosage;
+            count++;
+          }
+        }
+        if (centre || scale) {
+          standardise_column(column, num_individuals, sum, count, centre,
+                             scale);
+        }
+        return NULL;
+      });
+  return out;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_edges
-// @describeIn rtsk_treeseq_summary Get the number of edges in a tree sequence
+// PUBLIC, RcppTskit extension
+// @title Write genotypes of individuals to a VCF file
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param filename a string specifying the full path of the output file.
+// @param individuals integer vector of individual IDs (0-based);
+//   \code{NULL} means all individuals of the tree sequence, or every sample
+//   as a haploid individual when the tree sequence has no individuals.
+// @param contig a string with the contig (chromosome) ID.
+// @param position_transform \code{"round"} to round positions to the nearest
+//   integer or \code{"legacy"} to also make them strictly increasing from 1.
+// @param allow_position_zero logical; if \code{FALSE}, a site at position 0
+//   (not valid in VCF) raises an error.
+// @param compress logical; if \code{TRUE}, write a BGZF-compressed file
+//   (readable by \code{tabix} and \code{bcftools}), otherwise plain text.
+// @param threads number of threads decoding and compressing blocks of sites
+//   in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_variant_decode}
+//   over the nodes of the individuals (\code{ts->individual_nodes}) on blocks
+//   of consecutive sites, with one \code{tsk_variant_t} per thread. Each
+//   thread formats the VCF lines of a block into its own text buffer and
+//   compresses them into independent BGZF blocks, which are then written to
+//   the file in site order. The output follows \code{tskit Python}
+//   \code{TreeSequence.write_vcf()}: phased \code{GT} genotypes, \code{.} for
+//   missing data, and samples named \code{tsk_<individual ID>}. The file is
+//   opened only after the arguments and positions are validated, and an
+//   error or user interrupt while writing removes the partially written file.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// vcf_file <- tempfile(fileext = ".vcf")
+// RcppTskit:::rtsk_treeseq_write_vcf(ts_xptr, vcf_file,
+//                                    position_transform = "legacy",
+//                                    compress = FALSE)
+// readLines(vcf_file, n = 8)
+// file.remove(vcf_file)
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_edges(SEXP ts) {
+void rtsk_treeseq_write_vcf(
+    SEXP ts, const std::string &filename,
+    Rcpp::Nullable<Rcpp::IntegerVector> individuals = R_NilValue,
+    const std::string &contig = "1",
+    const std::string &position_transform = "round",
+    bool allow_position_zero = false, bool compress = true, int threads = 1,
+    int options = 0) {
+  const char *caller = "rtsk_treeseq_write_vcf";
+  const tsk_flags_t flags = validate_variant_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_edges(ts_xptr),
-                                           "rtsk_treeseq_get_num_edges");
+  require_sites(ts, caller);
+
+  individual_node_set inds;
+  if (individuals.isNull() && tsk_treeseq_get_num_individuals(ts_xptr) == 0) {
+    // Without individuals, every sample is a haploid individual
+    const std::size_t num_samples =
+        static_cast<std::size_t>(ts_xptr->num_samples);
+    inds.nodes.assign(ts_xptr->samples, ts_xptr->samples + num_samples);
+    for (std::size_t k = 0; k <= num_samples; k++) {
+      if (k < num_samples) {
+        inds.ids.push_back(static_cast<tsk_id_t>(k));
+      }
+      inds.offsets.push_back(k);
+    }
+  } else {
+    inds = individuals_or_all(ts_xptr, individuals, caller);
+    check_individuals_have_nodes(inds, caller);
+  }
+  const std::size_t num_individuals = inds.ids.size();
+  const std::vector<long long> positions = vcf_positions(
+      ts_xptr, position_transform, allow_position_zero, caller);
+  const std::vector<tsk_id_t> site_ids =
+      sites_or_all(ts_xptr, R_NilValue, caller);
+  const std::size_t num_sites = site_ids.size();
+
+  num_threads = threads_for_sites(num_threads, num_sites);
+  variant_set variants(ts_xptr, inds.nodes, flags, num_threads);
+  std::vector<std::unique_ptr<bgzf_compressor>> compressors;
+  if (compress) {
+    for (int t = 0; t < num_threads; t++) {
+      compressors.emplace_back(new bgzf_compressor());
+    }
+  }
+
+  long long contig_length = static_cast<long long>(
+      std::ceil(tsk_treeseq_get_sequence_length(ts_xptr)));
+  if (!positions.empty()) {
+    contig_length = std::max(contig_length, positions.back());
+  }
+  std::string header = "##fileformat=VCFv4.2\n##source=tskit ";
+  append_int(header, TSK_VERSION_MAJOR);
+  header += '.';
+  append_int(header, TSK_VERSION_MINOR);
+  header += '.';
+  append_int(header, TSK_VERSION_PATCH);
+  header += "\n##FILTER=<ID=PASS,Description=\"All filters passed\">\n"
+            "##contig=<ID=" +
+            contig + ",length=";
+  append_int(header, contig_length);
+  header += ">\n##FORMAT=<ID=GT,Number=1,Type=String,Description="
+            "\"Genotype\">\n"
+            "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+  for (const tsk_id_t id : inds.ids) {
+    header += "\ttsk_";
+    append_int(header, id);
+  }
+  header += '\n';
+
+  output_stream file(filename, false);
+  if (compress) {
+    std::string block;
+    if (!compressors[0]->compress(header.data(), header.size(), block)) {
+      Rcpp::stop("%s: failed to compress the output", caller);
+    }
+    file.write(block);
+  } else {
+    file.write(header);
+  }
+
+  const std::size_t chunk_sites = sites_per_chunk(
+      2 * inds.nodes.size() + contig.size() + 64, num_threads);
+  // output of each block of sites in the chunk, in order
+  std::vector<std::string> blocks;
+  for (std::size_t first = 0; first < num_sites; first += chunk_sites) {
+    const std::size_t last = std::min(first + chunk_sites, num_sites);
+    block_queue queue(last - first, kSiteBlockSize);
+    blocks.assign(queue.num_blocks(), std::string());
+    worker_status status;
+    run_threads(num_threads, status, [&](int thread_index) {
+      const tsk_variant_t *variant;
+      std::string text;
+      std::size_t start, stop;
+      while (!status.failed() && queue.next(start, stop)) {
+        text.clear();
+        for (std::size_t j = first + start; j < first + stop; j++) {
+          const tsk_id_t site = site_ids[j];
+          int ret = variants.decode(thread_index, site, &variant);
+          if (ret != 0) {
+            status.fail_tsk(ret);
+            return;
+          }
+          text += contig;
+          text += '\t';
+          append_int(text, positions[static_cast<std::size_t>(site)]);
+          text += "\t.\t";
+          text.append(variant->alleles[0], variant->allele_lengths[0]);
+          text += '\t';
+          if (variant->num_alleles < 2) {
+            text += '.';
+          }
+          for (tsk_size_t a = 1; a < variant->num_alleles; a++) {
+            if (a > 1) {
+              text += ',';
+            }
+            text.append(variant->alleles[a], variant->allele_lengths[a]);
+          }
+          text += "\t.\tPASS\t.\tGT";
+          const int32_t *genotypes = variant->genotypes;
+          for (std::size_t k = 0; k < num_individuals; k++) {
+            text += '\t';
+            for (std::size_t m = inds.offsets[k]; m < inds.offsets[k + 1];
+                 m++) {
+              if (m > inds.offsets[k]) {
+                text += '|';
+              }
+              const int32_t g = genotypes[m];
+              if (g == TSK_MISSING_DATA) {
+                text += '.';
+              } else if (g < 10) {
+                text += static_cast<char>('0' + g);
+              } else {
+                append_int(text, g);
+              }
+            }
+          }
+          text += '\n';
+        }
+        std::string &out = blocks[start / kSiteBlockSize];
+        if (compress) {
+          if (!compressors[static_cast<std::size_t>(thread_index)]->compress(
+                  text.data(), text.size(), out)) {
+            status.fail(std::string(caller) +
+                        ": failed to compress the output");
+            return;
+          }
+        } else {
+          out.swap(text);
+        }
+      }
+    });
+    status.stop_if_failed();
+    for (const std::string &block : blocks) {
+      file.write(block);
+    }
+    Rcpp::checkUserInterrupt();
+  }
+  if (compress) {
+    file.write(bgzf_compressor::eof());
+  }
+  file.close();
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_trees
-// @describeIn rtsk_treeseq_summary Get the number of trees in a tree sequence
+// PUBLIC, RcppTskit extension
+// @title Decode full-length sequence alignments of samples
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param samples integer vector of node IDs (0-based); \code{NULL} means all
+//   samples of the tree sequence.
+// @param left inclusive left coordinate of the alignments.
+// @param right exclusive right coordinate of the alignments; \code{NA}
+//   means the sequence length.
+// @param missing_char a single character for missing data and for positions
+//   without a reference sequence.
+// @param filename a string specifying the full path of a FASTA output file;
+//   \code{""} means that the alignments are returned as a matrix.
+// @param wrap_width number of characters per FASTA sequence line; 0 means no
+//   wrapping.
+// @param threads number of threads decoding chunks of samples in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ISOLATED_NOT_MISSING}).
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_decode_alignments}
+//   on chunks of samples in parallel, each writing its rows straight into
+//   the output. Sequences start from the reference sequence of the tree
+//   sequence (or \code{missing_char} when there is none), isolated samples
+//   are overlaid with \code{missing_char}, and sites are overlaid with the
+//   decoded alleles (which must be single characters). The tree sequence
+//   must have a discrete genome. When \code{filename} is given, chunks of
+//   samples are decoded and written to the FASTA file in order (with
+//   \code{n<node ID>} sequence names), so memory use is bounded by the chunk
+//   size rather than the number of samples.
+// @return A raw matrix with one column per sample holding its sequence, or
+//   no return value when \code{filename} is given.
+// @examples
+// ts_file <- system.file("examples/test_with_ref_seq.trees",
+//                        package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// A <- RcppTskit:::rtsk_treeseq_alignments(ts_xptr, left = 0, right = 20)
+// dim(A)
+// apply(A, 2, rawToChar)
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_trees(SEXP ts) {
+SEXP rtsk_treeseq_alignments(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    double left = 0, double right = NA_REAL,
+    const std::string &missing_char = "N", const std::string &filename = "",
+    int wrap_width = 60, int threads = 1, int options = 0) {
+  const char *caller = "rtsk_treeseq_alignments";
+  const tsk_flags_t flags = validate_variant_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
+  if (missing_char.size() != 1) {
+    Rcpp::stop("%s requires missing_char to be a single character", caller);
+  }
+  if (wrap_width < 0) {
+    Rcpp::stop("%s requires a non-negative wrap_width", caller);
+  }
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_trees(ts_xptr),
-                                           "rtsk_treeseq_get_num_trees");
+  require_sites(ts, caller);
+  const double sequence_length = tsk_treeseq_get_sequence_length(ts_xptr);
+  if (!tsk_treeseq_get_discrete_genome(ts_xptr)) {
+    Rcpp::stop("%s requires a discrete genome", caller);
+  }
+  if (std::isnan(right)) {
+    right = sequence_length;
+  }
+  if (std::trunc(left) != left || std::trunc(right) != right || left < 0 ||
+      right > sequence_length || left >= right) {
+    Rcpp::stop("%s requires integer left and right with "
+               "0 <= left < right <= sequence length",
+               caller);
+  }
+
+  std::vector<tsk_id_t> nodes;
+  if (samples.isNull()) {
+    nodes.assign(ts_xptr->samples, ts_xptr->samples + ts_xptr->num_samples);
+  } else {
+    nodes = int_vector_to_tsk_id_vector(Rcpp::as<Rcpp::IntegerVector>(samples));
+  }
+  if (nodes.empty()) {
+    Rcpp::stop("%s requires at least one sample", caller);
+  }
+  const std::size_t num_nodes = nodes.size();
+  const std::size_t L = static_cast<std::size_t>(right - left);
+
+  // Reference sequence of the tree sequence, or missing_char throughout
+  const tsk_reference_sequence_t *ref = &ts_xptr->tables->reference_sequence;
+  std::string filler;
+  const char *ref_seq = ref->data;
+  tsk_size_t ref_seq_length = ref->data_length;
+  if (ref_seq_length == 0) {
+    filler.assign(static_cast<std::size_t>(sequence_length), missing_char[0]);
+    ref_seq = filler.data();
+    ref_seq_length = static_cast<tsk_size_t>(filler.size());
+  } else if (ref_seq_length != static_cast<tsk_size_t>(sequence_length)) {
+    Rcpp::stop("%s requires the reference sequence to span the sequence "
+               "length",
+               caller);
+  }
+
+  // Decode alignments of nodes [first, last) into out (L bytes each), one
+  // contiguous part of the samples per thread, since every call of
+  // tsk_treeseq_decode_alignments() iterates over all trees and sites
+  auto decode = [&](std::size_t first, std::size_t last, char *out) {
+    const std::size_t n = last - first;
+    const int chunk_threads = static_cast<int>(
+        std::min<std::size_t>(static_cast<std::size_t>(num_threads), n));
+    block_queue queue(n, (n + chunk_threads - 1) / chunk_threads);
+    worker_status status;
+    run_threads(chunk_threads, status, [&](int) {
+      std::size_t start, stop;
+      while (!status.failed() && queue.next(start, stop)) {
+        int ret = tsk_treeseq_decode_alignments(
+            ts_xptr, ref_seq, ref_seq_length, nodes.data() + first + start,
+            static_cast<tsk_size_t>(stop - start), left, right,
+            missing_char[0], out + start * L, flags);
+        if (ret != 0) {
+          status.fail_tsk(ret);
+          return;
+        }
+      }
+    });
+    status.stop_if_failed();
+  };
+
+  if (filename.empty()) {
+    const std::size_t max_dim =
+        static_cast<std::size_t>(std::numeric_limits<int>::max());
+    if (L > max_dim || num_nodes > max_dim) {
+      Rcpp::stop("%s: matrix is too large for R, write it to a file instead",
+                 caller);
+    }
+    Rcpp::RawMatrix out(static_cast<int>(L), static_cast<int>(num_nodes));
+    decode(0, num_nodes, reinterpret_cast<char *>(RAW(out)));
+    return out;
+  }
+
+  output_stream file(filename, false);
+  const std::size_t chunk_nodes = std::max<std::size_t>(
+      static_cast<std::size_t>(num_threads), kOutputChunkBytes / L);
+  const std::size_t width =
+      wrap_width == 0 ? L : static_cast<std::size_t>(wrap_width);
+  std::vector<char> chunk;
+  for (std::size_t first = 0; first < num_nodes; first += chunk_nodes) {
+    const std::size_t last = std::min(first + chunk_nodes, num_nodes);
+    chunk.resize((last - first) * L);
+    decode(first, last, chunk.data());
+    for (std::size_t i = first; i < last; i++) {
+      file.write(">n" + std::to_string(nodes[i]) + "\n");
+      const char *row = chunk.data() + (i - first) * L;
+      for (std::size_t pos = 0; pos < L; pos += width) {
+        file.write(row + pos, std::min(width, L - pos));
+        file.put('\n');
+      }
+    }
+    Rcpp::checkUserInterrupt();
+  }
+  file.close();
+  return R_NilValue;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_sites
-// @describeIn rtsk_treeseq_summary Get the number of sites in a tree sequence
+// PUBLIC, RcppTskit extension
+// @title Match haplotypes to the samples with the Li and Stephens forward
+//   algorithm
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param haplotypes integer matrix with one row per site and one column per
+//   query haplotype, holding allele indexes (\code{0} and \code{1}, or
+//   \code{0} to \code{3} for \code{A}, \code{C}, \code{G}, and \code{T} with
+//   \code{TSK_ALLELES_ACGT}) and \code{NA} for missing data.
+// @param recombination_rate probability of recombination between each site
+//   and the previous one, one for all sites or one per site.
+// @param mutation_rate probability of mutation at each site, one for all
+//   sites or one per site.
+// @param threads number of threads running query haplotypes in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ALLELES_ACGT}).
+// @details This function calls
+//   \url{https://github.com/tskit-dev/tskit/blob/main/c/tskit/haplotype_matching.h}
+//   \code{tsk_ls_hmm_forward()} for each query haplotype, with one
+//   \code{tsk_ls_hmm_t} and forward matrix per thread sharing the tree
+//   sequence, so haplotypes run in parallel. The forward probabilities are
+//   normalised at each site to avoid underflow, and the normalisation
+//   factors give the likelihood of the haplotype. The alleles of the tree
+//   sequence must be \code{0} and \code{1} (or \code{A}, \code{C}, \code{G},
+//   and \code{T} with \code{TSK_ALLELES_ACGT}).
+// @return A list with \code{log_likelihood}, the natural logarithm of the
+//   likelihood of each haplotype, and \code{normalisation_factor}, a numeric
+//   matrix with one row per site and one column per haplotype.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// it_xptr <- RcppTskit:::rtsk_variant_iterator_init(ts_xptr, samples = 0:1)
+// block <- RcppTskit:::rtsk_variant_iterator_next_block(it_xptr, 1000L)
+// # allele indexes of the sites to indexes of A, C, G, and T
+// H <- sapply(1:2, function(j) {
+//   mapply(function(g, a) match(a[g + 1L], c("A", "C", "G", "T")) - 1L,
+//          block$genotypes[, j], block$alleles)
+// })
+// fwd <- RcppTskit:::rtsk_treeseq_ls_forward(ts_xptr, H, 1e-2, 1e-3,
+//                                            options = bitwShiftL(1L, 16))
+// fwd$log_likelihood
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_sites(SEXP ts) {
+Rcpp::List
+rtsk_treeseq_ls_forward(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                        const Rcpp::NumericVector &recombination_rate,
+                        const Rcpp::NumericVector &mutation_rate,
+                        int threads = 1, int options = 0) {
+  const char *caller = "rtsk_treeseq_ls_forward";
+  const tsk_flags_t flags = validate_ls_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(tsk_treeseq_get_num_sites(ts_xptr),
-                                           "rtsk_treeseq_get_num_sites");
+  require_sites(ts, caller);
+  ls_inputs in = ls_validate_inputs(ts_xptr, haplotypes, recombination_rate,
+                                    mutation_rate, flags, caller);
+  const std::size_t num_sites = in.num_sites;
+  const std::size_t num_queries = in.num_queries;
+  num_threads = static_cast<int>(std::min<std::size_t>(
+      static_cast<std::size_t>(num_threads), num_queries));
+
+  Rcpp::NumericVector log_likelihood(static_cast<R_xlen_t>(num_queries));
+  Rcpp::NumericMatrix normalisation_factor(static_cast<int>(num_sites),
+                                           haplotypes.ncol());
+  double *ll = REAL(log_likelihood);
+  double *norm = REAL(normalisation_factor);
+  ls_hmm_set hmms(ts_xptr, in.recombination_rate, in.mutation_rate, flags,
+                  ls_algorithm::forward, num_threads);
+  run_ls_queries(hmms, num_threads, num_queries, caller,
+                 [&](ls_hmm_set::workspace &w, std::size_t q) {
+                   int32_t *h = in.haplotypes.data() + q * num_sites;
+                   int ret = tsk_ls_hmm_forward(&w.hmm, h, &w.forward,
+                                                TSK_NO_INIT);
+                   if (ret == 0) {
+                     std::copy(w.forward.normalisation_factor,
+                               w.forward.normalisation_factor + num_sites,
+                               norm + q * num_sites);
+                     ll[q] = ls_log_likelihood(&w.forward);
+                   }
+                   return ret;
+                 });
+  return Rcpp::List::create(
+      Rcpp::_["log_likelihood"] = log_likelihood,
+      Rcpp::_["normalisation_factor"] = normalisation_factor);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_num_mutations
-// @describeIn rtsk_treeseq_summary Get the number of mutations in a tree
-// sequence
+// PUBLIC, RcppTskit extension
+// @title Find the most likely copying paths of haplotypes with the Li and
+//   Stephens Viterbi algorithm
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param haplotypes integer matrix with one row per site and one column per
+//   query haplotype, holding allele indexes (\code{0} and \code{1}, or
+//   \code{0} to \code{3} for \code{A}, \code{C}, \code{G}, and \code{T} with
+//   \code{TSK_ALLELES_ACGT}) and \code{NA} for missing data.
+// @param recombination_rate probability of recombination between each site
+//   and the previous one, one for all sites or one per site.
+// @param mutation_rate probability of mutation at each site, one for all
+//   sites or one per site.
+// @param threads number of threads running query haplotypes in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ALLELES_ACGT}).
+// @details This function calls
+//   \url{https://github.com/tskit-dev/tskit/blob/main/c/tskit/haplotype_matching.h}
+//   \code{tsk_ls_hmm_viterbi()} and \code{tsk_viterbi_matrix_traceback()}
+//   for each query haplotype, with one \code{tsk_ls_hmm_t} and Viterbi
+//   matrix per thread sharing the tree sequence, so haplotypes run in
+//   parallel. See \code{rtsk_treeseq_ls_forward()} for the alleles.
+// @return A list with \code{path}, an integer matrix with one row per site
+//   and one column per haplotype holding the sample node IDs that the
+//   haplotype copies from, and \code{log_likelihood}, the natural logarithm
+//   of the probability of each path.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// it_xptr <- RcppTskit:::rtsk_variant_iterator_init(ts_xptr, samples = 0:1)
+// block <- RcppTskit:::rtsk_variant_iterator_next_block(it_xptr, 1000L)
+// # allele indexes of the sites to indexes of A, C, G, and T
+// H <- sapply(1:2, function(j) {
+//   mapply(function(g, a) match(a[g + 1L], c("A", "C", "G", "T")) - 1L,
+//          block$genotypes[, j], block$alleles)
+// })
+// vit <- RcppTskit:::rtsk_treeseq_ls_viterbi(ts_xptr, H, 1e-2, 1e-3,
+//                                            options = bitwShiftL(1L, 16))
+// vit$path[1:5, ]
 // [[Rcpp::export]]
-SEXP rtsk_treeseq_get_num_mutations(SEXP ts) {
+Rcpp::List
+rtsk_treeseq_ls_viterbi(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                        const Rcpp::NumericVector &recombination_rate,
+                        const Rcpp::NumericVector &mutation_rate,
+                        int threads = 1, int options = 0) {
+  const char *caller = "rtsk_treeseq_ls_viterbi";
+  const tsk_flags_t flags = validate_ls_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return rtsk_wrap_tsk_size_t_as_integer64(
-      tsk_treeseq_get_num_mutations(ts_xptr), "rtsk_treeseq_get_num_mutations");
+  require_sites(ts, caller);
+  ls_inputs in = ls_validate_inputs(ts_xptr, haplotypes, recombination_rate,
+                                    mutation_rate, flags, caller);
+  const std::size_t num_sites = in.num_sites;
+  const std::size_t num_queries = in.num_queries;
+  num_threads = static_cast<int>(std::min<std::size_t>(
+      static_cast<std::size_t>(num_threads), num_queries));
+
+  Rcpp::IntegerMatrix path(static_cast<int>(num_sites), haplotypes.ncol());
+  Rcpp::NumericVector log_likelihood(static_cast<R_xlen_t>(num_queries));
+  int *p = INTEGER(path);
+  double *ll = REAL(log_likelihood);
+  ls_hmm_set hmms(ts_xptr, in.recombination_rate, in.mutation_rate, flags,
+                  ls_algorithm::viterbi, num_threads);
+  run_ls_queries(hmms, num_threads, num_queries, caller,
+                 [&](ls_hmm_set::workspace &w, std::size_t q) {
+                   int32_t *h = in.haplotypes.data() + q * num_sites;
+                   int ret = tsk_ls_hmm_viterbi(&w.hmm, h, &w.viterbi,
+                                                TSK_NO_INIT);
+                   if (ret == 0) {
+                     ret = tsk_viterbi_matrix_traceback(
+                         &w.viterbi, p + q * num_sites, 0);
+                   }
+                   if (ret == 0) {
+                     ll[q] = ls_log_likelihood(&w.viterbi.matrix);
+                   }
+                   return ret;
+                 });
+  return Rcpp::List::create(Rcpp::_["path"] = path,
+                            Rcpp::_["log_likelihood"] = log_likelihood);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_sequence_length
-// @describeIn rtsk_treeseq_summary Get the sequence length
+// PUBLIC, RcppTskit extension
+// @title Compressed Li and Stephens forward and backward matrices of
+//   haplotypes
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param haplotypes integer matrix with one row per site and one column per
+//   query haplotype (see \code{rtsk_treeseq_ls_forward()}).
+// @param recombination_rate probability of recombination between each site
+//   and the previous one, one for all sites or one per site.
+// @param mutation_rate probability of mutation at each site, one for all
+//   sites or one per site.
+// @param threads number of threads running query haplotypes in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ALLELES_ACGT}).
+// @details This function calls \code{tsk_ls_hmm_forward()} and
+//   \code{tsk_ls_hmm_backward()} (see
+//   \url{https://github.com/tskit-dev/tskit/blob/main/c/tskit/haplotype_matching.h})
+//   for each query haplotype in parallel and copies the compressed matrices
+//   out of their \code{tsk_compressed_matrix_t} arenas without decoding
+//   them. Each site is stored as value transitions on the tree at the site:
+//   a sample takes the value of its nearest ancestor (or itself) among the
+//   transition nodes, which are listed so that ancestors come before
+//   descendants. Use \code{rtsk_treeseq_ls_decode()} to expand a matrix to
+//   one value per site and sample.
+// @return A list with \code{log_likelihood} of each haplotype and lists
+//   \code{forward} and \code{backward} with one compressed matrix per
+//   haplotype. A compressed matrix is a list with \code{normalisation_factor}
+//   and \code{num_transitions} per site, and the \code{node} and \code{value}
+//   of the transitions of all sites one after another.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// H <- matrix(NA_integer_, nrow = 25, ncol = 1)
+// H[1:3, 1] <- 2L # G
+// fb <- RcppTskit:::rtsk_treeseq_ls_forward_backward(
+//   ts_xptr, H, 1e-2, 1e-3, options = bitwShiftL(1L, 16)
+// )
+// str(fb$forward[[1]])
 // [[Rcpp::export]]
-double rtsk_treeseq_get_sequence_length(SEXP ts) {
+Rcpp::List rtsk_treeseq_ls_forward_backward(
+    SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+    const Rcpp::NumericVector &recombination_rate,
+    const Rcpp::NumericVector &mutation_rate, int threads = 1,
+    int options = 0) {
+  const char *caller = "rtsk_treeseq_ls_forward_backward";
+  const tsk_flags_t flags = validate_ls_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_get_sequence_length(ts_xptr);
+  require_sites(ts, caller);
+  ls_inputs in = ls_validate_inputs(ts_xptr, haplotypes, recombination_rate,
+                                    mutation_rate, flags, caller);
+  const std::size_t num_sites = in.num_sites;
+  const std::size_t num_queries = in.num_queries;
+  num_threads = static_cast<int>(std::min<std::size_t>(
+      static_cast<std::size_t>(num_threads), num_queries));
+
+  std::vector<ls_transitions> forward(num_queries), backward(num_queries);
+  Rcpp::NumericVector log_likelihood(static_cast<R_xlen_t>(num_queries));
+  double *ll = REAL(log_likelihood);
+  ls_hmm_set hmms(ts_xptr, in.recombination_rate, in.mutation_rate, flags,
+                  ls_algorithm::forward_backward, num_threads);
+  run_ls_queries(hmms, num_threads, num_queries, caller,
+                 [&](ls_hmm_set::workspace &w, std::size_t q) {
+                   int32_t *h = in.haplotypes.data() + q * num_sites;
+                   int ret = ls_forward_backward(w, h);
+                   if (ret == 0) {
+                     forward[q].assign(&w.forward);
+                     backward[q].assign(&w.backward);
+                     ll[q] = ls_log_likelihood(&w.forward);
+                   }
+                   return ret;
+                 });
+  Rcpp::List forward_out(static_cast<R_xlen_t>(num_queries));
+  Rcpp::List backward_out(static_cast<R_xlen_t>(num_queries));
+  for (std::size_t q = 0; q < num_queries; q++) {
+    forward_out[static_cast<R_xlen_t>(q)] = forward[q].wrap();
+    backward_out[static_cast<R_xlen_t>(q)] = backward[q].wrap();
+  }
+  return Rcpp::List::create(Rcpp::_["log_likelihood"] = log_likelihood,
+                            Rcpp::_["forward"] = forward_out,
+                            Rcpp::_["backward"] = backward_out);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_discrete_genome
-// @describeIn rtsk_treeseq_summary Get the discrete genome status
+// PUBLIC, RcppTskit extension
+// @title Posterior copying probabilities of haplotypes with the Li and
+//   Stephens model
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param haplotypes integer matrix with one row per site and one column per
+//   query haplotype (see \code{rtsk_treeseq_ls_forward()}).
+// @param recombination_rate probability of recombination between each site
+//   and the previous one, one for all sites or one per site.
+// @param mutation_rate probability of mutation at each site, one for all
+//   sites or one per site.
+// @param threads number of threads running query haplotypes in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ALLELES_ACGT}).
+// @details For each query haplotype in parallel, this function runs the
+//   forward and backward algorithms and then combines the two compressed
+//   matrices site by site on the trees: the posterior probability that the
+//   haplotype copies a sample is the product of its forward and backward
+//   values, normalised to sum to one over the samples. Neither the inputs
+//   nor the posterior are expanded to one value per sample, so memory is
+//   proportional to the number of transitions.
+// @return A list with \code{log_likelihood} of each haplotype and list
+//   \code{posterior} with one compressed matrix per haplotype (as in
+//   \code{rtsk_treeseq_ls_forward_backward()}, but without normalisation
+//   factors).
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// H <- matrix(NA_integer_, nrow = 25, ncol = 1)
+// H[1:3, 1] <- 2L # G
+// post <- RcppTskit:::rtsk_treeseq_ls_posterior(
+//   ts_xptr, H, 1e-2, 1e-3, options = bitwShiftL(1L, 16)
+// )
+// Q <- post$posterior[[1]]
+// P <- RcppTskit:::rtsk_treeseq_ls_decode(ts_xptr, Q$num_transitions, Q$node,
+//                                         Q$value)
+// rowSums(P)
 // [[Rcpp::export]]
-bool rtsk_treeseq_get_discrete_genome(SEXP ts) {
+Rcpp::List rtsk_treeseq_ls_posterior(
+    SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+    const Rcpp::NumericVector &recombination_rate,
+    const Rcpp::NumericVector &mutation_rate, int threads = 1,
+    int options = 0) {
+  const char *caller = "rtsk_treeseq_ls_posterior";
+  const tsk_flags_t flags = validate_ls_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_get_discrete_genome(ts_xptr);
+  require_sites(ts, caller);
+  ls_inputs in = ls_validate_inputs(ts_xptr, haplotypes, recombination_rate,
+                                    mutation_rate, flags, caller);
+  const std::size_t num_sites = in.num_sites;
+  const std::size_t num_queries = in.num_queries;
+  num_threads = static_cast<int>(std::min<std::size_t>(
+      static_cast<std::size_t>(num_threads), num_queries));
+
+  std::vector<ls_transitions> posterior(num_queries);
+  Rcpp::NumericVector log_likelihood(static_cast<R_xlen_t>(num_queries));
+  double *ll = REAL(log_likelihood);
+  ls_hmm_set hmms(ts_xptr, in.recombination_rate, in.mutation_rate, flags,
+                  ls_algorithm::forward_backward, num_threads);
+  run_ls_queries(hmms, num_threads, num_queries, caller,
+                 [&](ls_hmm_set::workspace &w, std::size_t q) {
+                   int32_t *h = in.haplotypes.data() + q * num_sites;
+                   int ret = ls_forward_backward(w, h);
+                   if (ret == 0) {
+                     ll[q] = ls_log_likelihood(&w.forward);
+                     ret = ls_visit_posterior(
+                         w, [&](const tsk_tree_t *, const tsk_site_t *) {
+                           posterior[q].add_site(w.posterior);
+                         });
+                   }
+                   return ret;
+                 });
+  Rcpp::List posterior_out(static_cast<R_xlen_t>(num_queries));
+  for (std::size_t q = 0; q < num_queries; q++) {
+    posterior_out[static_cast<R_xlen_t>(q)] = posterior[q].wrap();
+  }
+  return Rcpp::List::create(Rcpp::_["log_likelihood"] = log_likelihood,
+                            Rcpp::_["posterior"] = posterior_out);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_has_reference_sequence
-// @describeIn rtsk_treeseq_summary Does the tree sequence hold a reference
-// genome
-//   sequence
-// @details Note that \code{tsk_treeseq_has_reference_sequence} is undocumented
-//   method in the \code{tskit C} API (see \code{trees.h}), but documented in
-//   \code{tskit Python} API
-//   https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.has_reference_sequence
+// PUBLIC, RcppTskit extension
+// @title Decode a compressed Li and Stephens matrix
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param num_transitions integer vector with the number of transitions of
+//   each site.
+// @param node integer vector of the transition nodes of all sites.
+// @param value numeric vector of the transition values of all sites.
+// @details This function stores the transitions in a
+//   \code{tsk_compressed_matrix_t} and calls
+//   \code{tsk_compressed_matrix_decode()} (see
+//   \url{https://github.com/tskit-dev/tskit/blob/main/c/tskit/haplotype_matching.h}),
+//   which expands them to one value per site and sample. Transition nodes
+//   must be ordered so that ancestors come before descendants, as in the
+//   matrices from \code{rtsk_treeseq_ls_forward_backward()} and
+//   \code{rtsk_treeseq_ls_posterior()}.
+// @return A numeric matrix with one row per site and one column per sample.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// H <- matrix(NA_integer_, nrow = 25, ncol = 1)
+// fb <- RcppTskit:::rtsk_treeseq_ls_forward_backward(
+//   ts_xptr, H, 1e-2, 1e-3, options = bitwShiftL(1L, 16)
+// )
+// F <- fb$forward[[1]]
+// RcppTskit:::rtsk_treeseq_ls_decode(ts_xptr, F$num_transitions, F$node,
+//                                    F$value)[1:3, ]
 // [[Rcpp::export]]
-bool rtsk_treeseq_has_reference_sequence(SEXP ts) {
+Rcpp::NumericMatrix
+rtsk_treeseq_ls_decode(SEXP ts, const Rcpp::IntegerVector &num_transitions,
+                       const Rcpp::IntegerVector &node,
+                       const Rcpp::NumericVector &value) {
+  const char *caller = "rtsk_treeseq_ls_decode";
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_has_reference_sequence(ts_xptr);
+  require_sites(ts, caller);
+  const std::size_t num_sites =
+      static_cast<std::size_t>(tsk_treeseq_get_num_sites(ts_xptr));
+  const std::size_t num_samples =
+      static_cast<std::size_t>(tsk_treeseq_get_num_samples(ts_xptr));
+  if (static_cast<std::size_t>(num_transitions.size()) != num_sites) {
+    Rcpp::stop("%s requires num_transitions of length the number of sites",
+               caller);
+  }
+  if (node.size() != value.size()) {
+    Rcpp::stop("%s requires node and value of the same length", caller);
+  }
+  const std::size_t num_nodes =
+      static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts_xptr));
+  std::size_t total = 0;
+  for (const int n : num_transitions) {
+    if (n < 0) {
+      Rcpp::stop("%s requires non-negative num_transitions", caller);
+    }
+    total += static_cast<std::size_t>(n);
+  }
+  if (total != static_cast<std::size_t>(node.size())) {
+    Rcpp::stop("%s requires sum(num_transitions) node and value entries",
+               caller);
+  }
+  std::vector<tsk_value_transition_t> transitions(total);
+  for (std::size_t j = 0; j < total; j++) {
+    const int u = node[static_cast<R_xlen_t>(j)];
+    if (u < 0 || static_cast<std::size_t>(u) >= num_nodes) {
+      Rcpp::stop("%s requires node IDs between 0 and the number of nodes - 1",
+                 caller);
+    }
+    transitions[j].tree_node = static_cast<tsk_id_t>(u);
+    transitions[j].value_index = TSK_NULL;
+    transitions[j].value = value[static_cast<R_xlen_t>(j)];
+  }
+
+  tsk_compressed_matrix_t matrix;
+  int ret = tsk_compressed_matrix_init(&matrix, ts_xptr, 0, 0);
+  std::vector<double> values;
+  std::size_t offset = 0;
+  for (std::size_t l = 0; ret == 0 && l < num_sites; l++) {
+    const tsk_size_t n = static_cast<tsk_size_t>(num_transitions[l]);
+    ret = tsk_compressed_matrix_store_site(&matrix, static_cast<tsk_id_t>(l),
+                                           1, n, transitions.data() + offset);
+    offset += static_cast<std::size_t>(n);
+  }
+  if (ret == 0) {
+    values.resize(num_sites * num_samples);
+    ret = tsk_compressed_matrix_decode(&matrix, values.data());
+  }
+  tsk_compressed_matrix_free(&matrix);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  // tskit decodes one site after another, R stores one column after another
+  Rcpp::NumericMatrix out(static_cast<int>(num_sites),
+                          static_cast<int>(num_samples));
+  double *x = REAL(out);
+  for (std::size_t l = 0; l < num_sites; l++) {
+    for (std::size_t i = 0; i < num_samples; i++) {
+      x[l + i * num_sites] = values[l * num_samples + i];
+    }
+  }
+  return out;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_time_units and
-// tsk_treeseq_get_time_units_length.
-// @describeIn rtsk_treeseq_summary Get the time units string
+// PUBLIC, RcppTskit extension
+// @title Impute haplotypes at untyped sites with the Li and Stephens model
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object, whose samples are the reference haplotypes.
+// @param haplotypes integer matrix with one row per typed site and one
+//   column per target haplotype, holding allele indexes (\code{NA} for
+//   missing data, see \code{rtsk_treeseq_ls_forward()}).
+// @param sites integer vector of the typed site IDs (0-based, increasing),
+//   one per row of \code{haplotypes}; all other sites are imputed.
+// @param map_position increasing positions of the genetic map.
+// @param map_cm cumulative genetic distances (cM) at \code{map_position}.
+// @param ne effective population size, scaling genetic distances to
+//   recombination probabilities.
+// @param mutation_rate probability of mutation at each site, one for all
+//   sites or one per site.
+// @param filename a string specifying the full path of a VCF-like output
+//   file; \code{""} returns the dosages as a matrix instead.
+// @param contig a string with the contig (chromosome) ID of the file.
+// @param compress logical; if \code{TRUE}, write a gzip-compressed file.
+// @param threads number of threads imputing target haplotypes in parallel.
+// @param options passed to \code{tskit C} (see details and note that
+//   this wrapper supports \code{TSK_ALLELES_ACGT}).
+// @details For each target haplotype in parallel, this function runs
+//   \code{tsk_ls_hmm_forward()} and \code{tsk_ls_hmm_backward()} (see
+//   \url{https://github.com/tskit-dev/tskit/blob/main/c/tskit/haplotype_matching.h})
+//   with missing data at the untyped sites and then walks the trees once,
+//   combining the compressed matrices into the posterior copying
+//   probabilities of each site (see \code{rtsk_treeseq_ls_posterior()}).
+//   At an untyped site, the dosage is the posterior probability that the
+//   target carries an allele other than the ancestral state: the posterior
+//   mass of the samples below the mutations to derived states. Neither the
+//   matrices nor the posterior are expanded to one value per sample, and
+//   the compressed matrices of a thread are reused across targets. The file
+//   has one line per untyped site with the ancestral state as \code{REF},
+//   the derived states as \code{ALT}, and the dosage of each target (named
+//   \code{target_<index>}, 0-based) as \code{DS} with three decimals; the
+//   dosages are kept at that precision in memory until the file is written.
+//   The file is opened only once all targets are imputed, and an error or
+//   user interrupt while writing removes the partially written file.
+// @return A list with \code{site}, the untyped site IDs (0-based),
+//   \code{log_likelihood} of each target, and \code{dosage}, a numeric
+//   matrix with one row per untyped site and one column per target
+//   (\code{NULL} when writing a file).
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// H <- matrix(2L, nrow = 5, ncol = 2) # G
+// imp <- RcppTskit:::rtsk_treeseq_impute(
+//   ts_xptr, H, sites = 0:4, map_position = c(0, 100), map_cm = c(0, 0.01),
+//   ne = 1e4, mutation_rate = 1e-3, options = bitwShiftL(1L, 16)
+// )
+// head(imp$dosage)
 // [[Rcpp::export]]
-Rcpp::String rtsk_treeseq_get_time_units(SEXP ts) {
+Rcpp::List rtsk_treeseq_impute(SEXP ts, const Rcpp::IntegerMatrix &haplotypes,
+                               const Rcpp::IntegerVector &sites,
+                               const Rcpp::NumericVector &map_position,
+                               const Rcpp::NumericVector &map_cm, double ne,
+                               const Rcpp::NumericVector &mutation_rate,
+                               const std::string &filename = "",
+                               const std::string &contig = "1",
+                               bool compress = false, int threads = 1,
+                               int options = 0) {
+  const char *caller = "rtsk_treeseq_impute";
+  const tsk_flags_t flags = validate_ls_options(options, caller);
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  const char *p = tsk_treeseq_get_time_units(ts_xptr);
-  tsk_size_t n = tsk_treeseq_get_time_units_length(ts_xptr);
-  std::string time_units;
-  if (n > 0 && p != NULL) {
-    time_units.assign(p, p + n);
+  require_sites(ts, caller);
+  if (tsk_treeseq_get_num_samples(ts_xptr) == 0) {
+    Rcpp::stop("%s requires at least one sample", caller);
   }
-  return Rcpp::String(time_units);
+  const std::size_t num_sites =
+      static_cast<std::size_t>(tsk_treeseq_get_num_sites(ts_xptr));
+  const std::vector<tsk_id_t> typed = int_vector_to_tsk_id_vector(sites);
+  const std::size_t num_typed = typed.size();
+  for (std::size_t k = 0; k < num_typed; k++) {
+    if (typed[k] < 0 || static_cast<std::size_t>(typed[k]) >= num_sites) {
+      Rcpp::stop("%s: site IDs must be between 0 and the number of sites - 1",
+                 caller);
+    }
+    if (k > 0 && typed[k] <= typed[k - 1]) {
+      Rcpp::stop("%s requires increasing typed site IDs", caller);
+    }
+  }
+  if (static_cast<std::size_t>(haplotypes.nrow()) != num_typed) {
+    Rcpp::stop("%s requires one row of haplotypes per typed site", caller);
+  }
+  const std::vector<int32_t> targets =
+      ls_query_haplotypes(haplotypes, num_typed, flags, caller);
+  const std::size_t num_queries = static_cast<std::size_t>(haplotypes.ncol());
+  std::vector<double> rho =
+      ls_genetic_map_rates(ts_xptr, map_position, map_cm, ne, caller);
+  std::vector<double> mu =
+      ls_site_rates(mutation_rate, num_sites, "mutation_rate", caller);
+  num_threads = static_cast<int>(std::min<std::size_t>(
+      static_cast<std::size_t>(num_threads), num_queries));
+
+  // Row of each untyped site in the output, -1 for typed sites
+  std::vector<int> row(num_sites, 0);
+  for (const tsk_id_t site : typed) {
+    row[static_cast<std::size_t>(site)] = -1;
+  }
+  Rcpp::IntegerVector untyped(static_cast<R_xlen_t>(num_sites - num_typed));
+  std::size_t num_untyped = 0;
+  for (std::size_t l = 0; l < num_sites; l++) {
+    if (row[l] == 0) {
+      row[l] = static_cast<int>(num_untyped);
+      untyped[static_cast<R_xlen_t>(num_untyped++)] = static_cast<int>(l);
+    }
+  }
+
+  const bool to_file = !filename.empty();
+  Rcpp::NumericVector log_likelihood(static_cast<R_xlen_t>(num_queries));
+  double *ll = REAL(log_likelihood);
+  Rcpp::NumericMatrix dosage;
+  double *x = NULL;
+  // Dosages in thousandths, one untyped site after another, for the file
+  std::vector<uint16_t> ds;
+  if (to_file) {
+    ds.resize(num_untyped * num_queries);
+  } else {
+    dosage = Rcpp::NumericMatrix(static_cast<int>(num_untyped),
+                                 static_cast<int>(num_queries));
+    x = REAL(dosage);
+  }
+  ls_hmm_set hmms(ts_xptr, rho, mu, flags, ls_algorithm::forward_backward,
+                  num_threads);
+  run_ls_queries(
+      hmms, num_threads, num_queries, caller,
+      [&](ls_hmm_set::workspace &w, std::size_t q) {
+        std::vector<int32_t> h(num_sites, TSK_MISSING_DATA);
+        for (std::size_t k = 0; k < num_typed; k++) {
+          h[static_cast<std::size_t>(typed[k])] = targets[q * num_typed + k];
+        }
+        int ret = ls_forward_backward(w, h.data());
+        if (ret == 0) {
+          ll[q] = ls_log_likelihood(&w.forward);
+          ret = ls_visit_posterior(
+              w, [&](const tsk_tree_t *tree, const tsk_site_t *site) {
+                const int r = row[static_cast<std::size_t>(site->id)];
+                if (r < 0) {
+                  return;
+                }
+                const std::size_t k = static_cast<std::size_t>(r);
+                const double d = w.posterior.derived_dosage(tree, site);
+                if (to_file) {
+                  ds[k * num_queries + q] =
+                      static_cast<uint16_t>(std::lround(d * 1000));
+                } else {
+                  x[k + q * num_untyped] = d;
+                }
+              });
+        }
+        return ret;
+      });
+
+  if (!to_file) {
+    return Rcpp::List::create(Rcpp::_["site"] = untyped,
+                              Rcpp::_["log_likelihood"] = log_likelihood,
+                              Rcpp::_["dosage"] = dosage);
+  }
+  const std::vector<long long> positions =
+      vcf_positions(ts_xptr, "round", true, caller);
+  long long contig_length = static_cast<long long>(
+      std::ceil(tsk_treeseq_get_sequence_length(ts_xptr)));
+  if (!positions.empty()) {
+    contig_length = std::max(contig_length, positions.back());
+  }
+  output_stream file(filename, compress);
+  std::string text = "##fileformat=VCFv4.2\n##source=RcppTskit impute\n"
+                     "##contig=<ID=" +
+                     contig + ",length=";
+  append_int(text, contig_length);
+  text += ">\n##FORMAT=<ID=DS,Number=1,Type=Float,Description="
+          "\"Posterior probability of a derived allele\">\n"
+          "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+  for (std::size_t q = 0; q < num_queries; q++) {
+    text += "\ttarget_";
+    append_int(text, static_cast<long long>(q));
+  }
+  text += '\n';
+  file.write(text);
+  tsk_site_t site;
+  std::vector<std::string> alt;
+  for (std::size_t k = 0; k < num_untyped; k++) {
+    const tsk_id_t id = untyped[static_cast<R_xlen_t>(k)];
+    int ret = tsk_treeseq_get_site(ts_xptr, id, &site);
+    if (ret != 0) {
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    const std::string ref(site.ancestral_state, site.ancestral_state_length);
+    alt.clear();
+    for (tsk_size_t j = 0; j < site.mutations_length; j++) {
+      const std::string state(site.mutations[j].derived_state,
+                              site.mutations[j].derived_state_length);
+      if (state != ref &&
+          std::find(alt.begin(), alt.end(), state) == alt.end()) {
+        alt.push_back(state);
+      }
+    }
+    text = contig;
+    text += '\t';
+    append_int(text, positions[static_cast<std::size_t>(id)]);
+    text += "\t.\t";
+    text += ref;
+    text += '\t';
+    if (alt.empty()) {
+      text += '.';
+    }
+    for (std::size_t a = 0; a < alt.size(); a++) {
+      if (a > 0) {
+        text += ',';
+      }
+      text += alt[a];
+    }
+    text += "\t.\tPASS\t.\tDS";
+    for (std::size_t q = 0; q < num_queries; q++) {
+      const unsigned v = ds[k * num_queries + q];
+      text += '\t';
+      append_int(text, v / 1000);
+      text += '.';
+      text += static_cast<char>('0' + v / 100 % 10);
+      text += static_cast<char>('0' + v / 10 % 10);
+      text += static_cast<char>('0' + v % 10);
+    }
+    text += '\n';
+    file.write(text);
+  }
+  file.close();
+  return Rcpp::List::create(Rcpp::_["site"] = untyped,
+                            Rcpp::_["log_likelihood"] = log_likelihood,
+                            Rcpp::_["dosage"] = R_NilValue);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_discrete_time
-// @describeIn rtsk_treeseq_summary Get the discrete time status
+// PUBLIC, RcppTskit extension
+// @title Identity-by-descent segments of pairs of samples
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param within integer vector of sample node IDs (0-based) to find segments
+//   within; \code{NULL} means all samples when \code{between} is also
+//   \code{NULL}.
+// @param between list of integer vectors of sample node IDs (0-based) to
+//   find segments between (pairs in different vectors only).
+// @param min_span segments must be longer than this.
+// @param max_time most recent common ancestors must be at most this old;
+//   \code{NA} means no limit.
+// @param pairs logical; if \code{TRUE}, keep only the number and total span
+//   of the segments of each pair.
+// @param filename a string specifying the full path of a tab-separated file
+//   to write the segments to as they are found.
+// @param callback an \code{R} function called with blocks of segments as
+//   they are found.
+// @param block_size number of segments per call of \code{callback}.
+// @details This function finds the segments with the algorithm of
+//   \code{tsk_table_collection_ibd_within()} and
+//   \code{tsk_table_collection_ibd_between()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.ibd_segments}),
+//   which store all segments in memory in an AVL tree keyed by pair. Here
+//   each segment is handed on as soon as it is found: collected into
+//   columns, summed per pair (\code{pairs = TRUE}), written to
+//   \code{filename}, or passed to \code{callback}, so that the last two
+//   keep no segments or pairs in memory. At most one of \code{pairs},
+//   \code{filename}, and \code{callback} can be used.
+// @return A list with columns \code{a} and \code{b} (sample node IDs,
+//   \code{a < b}), \code{left}, \code{right}, and \code{node} (the most
+//   recent common ancestor) of the segments; with \code{pairs = TRUE}, a
+//   list with columns \code{a}, \code{b}, \code{num_segments}, and
+//   \code{total_span} of the pairs; with \code{filename} or \code{callback},
+//   a list with \code{num_segments} and \code{total_span} of all segments.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// seg <- RcppTskit:::rtsk_treeseq_ibd_segments(ts_xptr, within = 0:3)
+// head(as.data.frame(seg))
+// RcppTskit:::rtsk_treeseq_ibd_segments(ts_xptr, min_span = 10, pairs = TRUE)
 // [[Rcpp::export]]
-bool rtsk_treeseq_get_discrete_time(SEXP ts) {
+Rcpp::List rtsk_treeseq_ibd_segments(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> within = R_NilValue,
+    Rcpp::Nullable<Rcpp::List> between = R_NilValue, double min_span = 0,
+    double max_time = NA_REAL, bool pairs = false,
+    const std::string &filename = "",
+    Rcpp::Nullable<Rcpp::Function> callback = R_NilValue,
+    int block_size = 10000) {
+  const char *caller = "rtsk_treeseq_ibd_segments";
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_get_discrete_time(ts_xptr);
+  max_time = validate_ibd_filters(min_span, max_time, caller);
+  const bool to_file = !filename.empty();
+  const bool to_callback = callback.isNotNull();
+  if (pairs + to_file + to_callback > 1) {
+    Rcpp::stop("%s supports only one of pairs, filename, and callback",
+               caller);
+  }
+  if (block_size < 1) {
+    Rcpp::stop("%s requires a positive block_size", caller);
+  }
+  ibd_finder finder(ts_xptr, ibd_sample_sets(ts_xptr, within, between, caller),
+                    between.isNotNull(), min_span, max_time);
+
+  if (pairs) {
+    struct pair_summary {
+      double num_segments = 0;
+      double total_span = 0;
+    };
+    const int64_t num_nodes =
+        static_cast<int64_t>(tsk_treeseq_get_num_nodes(ts_xptr));
+    std::unordered_map<int64_t, pair_summary> summaries;
+    finder.run([&](tsk_id_t a, tsk_id_t b, double left, double right,
+                   tsk_id_t) {
+      pair_summary &x = summaries[a * num_nodes + b];
+      x.num_segments++;
+      x.total_span += right - left;
+    });
+    std::vector<int64_t> keys;
+    keys.reserve(summaries.size());
+    for (const auto &item : summaries) {
+      keys.push_back(item.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    const R_xlen_t n = static_cast<R_xlen_t>(keys.size());
+    Rcpp::IntegerVector a(n), b(n);
+    Rcpp::NumericVector num_segments(n), total_span(n);
+    for (R_xlen_t j = 0; j < n; j++) {
+      const int64_t key = keys[static_cast<std::size_t>(j)];
+      const pair_summary &x = summaries[key];
+      a[j] = static_cast<int>(key / num_nodes);
+      b[j] = static_cast<int>(key % num_nodes);
+      num_segments[j] = x.num_segments;
+      total_span[j] = x.total_span;
+    }
+    return Rcpp::List::create(Rcpp::_["a"] = a, Rcpp::_["b"] = b,
+                              Rcpp::_["num_segments"] = num_segments,
+                              Rcpp::_["total_span"] = total_span);
+  }
+
+  double num_segments = 0;
+  double total_span = 0;
+  if (to_file) {
+    output_stream file(filename, false);
+    file.write(std::string("a\tb\tleft\tright\tnode\n"));
+    char line[128];
+    finder.run([&](tsk_id_t a, tsk_id_t b, double left, double right,
+                   tsk_id_t node) {
+      const int n = std::snprintf(
+          line, sizeof(line), "%d\t%d\t%.17g\t%.17g\t%d\n",
+          static_cast<int>(a), static_cast<int>(b), left, right,
+          static_cast<int>(node));
+      file.write(line, static_cast<std::size_t>(n));
+      num_segments++;
+      total_span += right - left;
+    });
+    file.close();
+  } else if (to_callback) {
+    Rcpp::Function f(callback.get());
+    ibd_segment_columns block;
+    const std::size_t max_block = static_cast<std::size_t>(block_size);
+    finder.run([&](tsk_id_t a, tsk_id_t b, double left, double right,
+                   tsk_id_t node) {
+      block.add(a, b, left, right, node);
+      num_segments++;
+      total_span += right - left;
+      if (block.size() == max_block) {
+        f(block.wrap());
+        block.clear();
+      }
+    });
+    if (block.size() > 0) {
+      f(block.wrap());
+    }
+  } else {
+    ibd_segment_columns segments;
+    finder.run([&](tsk_id_t a, tsk_id_t b, double left, double right,
+                   tsk_id_t node) { segments.add(a, b, left, right, node); });
+    return segments.wrap();
+  }
+  return Rcpp::List::create(Rcpp::_["num_segments"] = num_segments,
+                            Rcpp::_["total_span"] = total_span);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_min_time
-// @describeIn rtsk_treeseq_summary Get the min time in node table and mutation
-// table
+// PUBLIC, RcppTskit extension
+// @title Pairwise identity-by-descent sharing of samples
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param samples integer vector of sample node IDs (0-based); \code{NULL}
+//   means all samples.
+// @param min_span segments must be longer than this.
+// @param max_time most recent common ancestors must be at most this old;
+//   \code{NA} means no limit.
+// @param sparse logical; if \code{TRUE}, return the pairs that share
+//   segments instead of a dense matrix.
+// @param threads number of threads running pairs of sample blocks in
+//   parallel.
+// @details The samples are split into blocks, and each pair of blocks runs
+//   the IBD finder of \code{rtsk_treeseq_ibd_segments()} on a worker thread:
+//   within the block for a block with itself, otherwise between the two
+//   blocks. The span of each segment is added straight to its pair, so
+//   segments are never stored. Pairs of blocks own disjoint pairs of
+//   samples, so threads write to the output without locking. There are as
+//   few blocks as give at least one pair of blocks per thread, because each
+//   run walks all edges.
+// @return A symmetric numeric matrix with the total span of the segments
+//   of each pair of samples, in the order of \code{samples}; with
+//   \code{sparse = TRUE}, a list with columns \code{a} and \code{b} (sample
+//   node IDs) and \code{total_span} of the pairs with segments, in the order
+//   of \code{samples} (\code{a} before \code{b}).
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// RcppTskit:::rtsk_treeseq_ibd_matrix(ts_xptr, samples = 0:3, max_time = 1)
 // [[Rcpp::export]]
-double rtsk_treeseq_get_min_time(SEXP ts) {
+SEXP rtsk_treeseq_ibd_matrix(
+    SEXP ts, Rcpp::Nullable<Rcpp::IntegerVector> samples = R_NilValue,
+    double min_span = 0, double max_time = NA_REAL, bool sparse = false,
+    int threads = 1) {
+  const char *caller = "rtsk_treeseq_ibd_matrix";
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_get_min_time(ts_xptr);
+  max_time = validate_ibd_filters(min_span, max_time, caller);
+  const std::size_t num_nodes =
+      static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts_xptr));
+  std::vector<tsk_id_t> sample_ids;
+  if (samples.isNull()) {
+    sample_ids.assign(ts_xptr->samples,
+                      ts_xptr->samples + ts_xptr->num_samples);
+  } else {
+    sample_ids = int_vector_to_tsk_id_vector(samples.get());
+  }
+  const std::size_t n = sample_ids.size();
+  // Index of each sample in the output, -1 for other nodes
+  std::vector<int> index(num_nodes, -1);
+  for (std::size_t k = 0; k < n; k++) {
+    const tsk_id_t u = sample_ids[k];
+    if (u < 0 || static_cast<std::size_t>(u) >= num_nodes) {
+      Rcpp::stop("%s: sample IDs must be between 0 and the number of "
+                 "nodes - 1",
+                 caller);
+    }
+    if (index[static_cast<std::size_t>(u)] != -1) {
+      Rcpp::stop("%s: sample %d is listed more than once", caller,
+                 static_cast<int>(u));
+    }
+    index[static_cast<std::size_t>(u)] = static_cast<int>(k);
+  }
+
+  std::size_t num_blocks = 1;
+  while (num_blocks < n &&
+         num_blocks * (num_blocks + 1) / 2 <
+             static_cast<std::size_t>(num_threads)) {
+    num_blocks++;
+  }
+  std::vector<std::pair<std::size_t, std::size_t>> tasks;
+  for (std::size_t i = 0; i < num_blocks; i++) {
+    for (std::size_t j = i; j < num_blocks; j++) {
+      tasks.emplace_back(i, j);
+    }
+  }
+  num_threads = static_cast<int>(
+      std::min<std::size_t>(static_cast<std::size_t>(num_threads),
+                            tasks.size()));
+  auto block_start = [&](std::size_t i) { return i * n / num_blocks; };
+
+  Rcpp::NumericMatrix dense;
+  double *x = NULL;
+  if (!sparse) {
+    dense = Rcpp::NumericMatrix(static_cast<int>(n), static_cast<int>(n));
+    x = REAL(dense);
+  }
+  // Total span of the pairs of each task, keyed by a * n + b
+  std::vector<std::unordered_map<int64_t, double>> pairs(
+      sparse ? tasks.size() : 0);
+  worker_status status;
+  block_queue queue(tasks.size(), 1);
+  run_threads(num_threads, status, [&](int) {
+    std::size_t t, stop;
+    while (!status.failed() && queue.next(t, stop)) {
+      const std::size_t i = tasks[t].first, j = tasks[t].second;
+      std::vector<tsk_id_t> sample_set(num_nodes, TSK_NULL);
+      for (std::size_t k = block_start(i); k < block_start(i + 1); k++) {
+        sample_set[static_cast<std::size_t>(sample_ids[k])] = 0;
+      }
+      if (j != i) {
+        for (std::size_t k = block_start(j); k < block_start(j + 1); k++) {
+          sample_set[static_cast<std::size_t>(sample_ids[k])] = 1;
+        }
+      }
+      ibd_finder finder(ts_xptr, std::move(sample_set), j != i, min_span,
+                        max_time);
+      finder.run(
+          [&](tsk_id_t a, tsk_id_t b, double left, double right, tsk_id_t) {
+            std::size_t ia =
+                static_cast<std::size_t>(index[static_cast<std::size_t>(a)]);
+            std::size_t ib =
+                static_cast<std::size_t>(index[static_cast<std::size_t>(b)]);
+            if (ia > ib) {
+              std::swap(ia, ib);
+            }
+            if (sparse) {
+              pairs[t][static_cast<int64_t>(ia * n + ib)] += right - left;
+            } else {
+              x[ia + ib * n] += right - left;
+              x[ib + ia * n] += right - left;
+            }
+          },
+          false);
+    }
+  });
+  status.stop_if_failed();
+  if (!sparse) {
+    return dense;
+  }
+
+  std::vector<std::pair<int64_t, double>> all;
+  for (const auto &task_pairs : pairs) {
+    all.insert(all.end(), task_pairs.begin(), task_pairs.end());
+  }
+  std::sort(all.begin(), all.end());
+  const R_xlen_t num_pairs = static_cast<R_xlen_t>(all.size());
+  Rcpp::IntegerVector a(num_pairs), b(num_pairs);
+  Rcpp::NumericVector total_span(num_pairs);
+  for (R_xlen_t k = 0; k < num_pairs; k++) {
+    const std::size_t key =
+        static_cast<std::size_t>(all[static_cast<std::size_t>(k)].first);
+    a[k] = static_cast<int>(sample_ids[key / n]);
+    b[k] = static_cast<int>(sample_ids[key % n]);
+    total_span[k] = all[static_cast<std::size_t>(k)].second;
+  }
+  return Rcpp::List::create(Rcpp::_["a"] = a, Rcpp::_["b"] = b,
+                            Rcpp::_["total_span"] = total_span);
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_max_time
-// @describeIn rtsk_treeseq_summary Get the max time in node table and mutation
-// table
+// PUBLIC, wrapper for tsk_treeseq_genealogical_nearest_neighbours
+// @title Genealogical nearest neighbours of focal nodes
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param focal integer vector of focal node IDs (0-based).
+// @param reference_sets list of integer vectors of node IDs (0-based), the
+//   disjoint reference sets.
+// @param threads number of threads, each computing a part of the focal
+//   nodes.
+// @details This function calls
+//   \code{tsk_treeseq_genealogical_nearest_neighbours()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.genealogical_nearest_neighbours})
+//   on contiguous parts of \code{focal} in parallel. Each call walks the
+//   trees of the tree sequence with its own edge state, which is shared by
+//   all focal nodes of its part, so there is one part per thread.
+// @return A numeric matrix with one row per focal node and one column per
+//   reference set, holding the span-weighted proportion of the nearest
+//   neighbours of the focal node in each reference set.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// RcppTskit:::rtsk_treeseq_genealogical_nearest_neighbours(
+//   ts_xptr, focal = 0:3, reference_sets = list(0:7, 8:15), threads = 2L
+// )
 // [[Rcpp::export]]
-double rtsk_treeseq_get_max_time(SEXP ts) {
+Rcpp::NumericMatrix rtsk_treeseq_genealogical_nearest_neighbours(
+    SEXP ts, const Rcpp::IntegerVector &focal,
+    const Rcpp::List &reference_sets, int threads = 1) {
+  const char *caller = "rtsk_treeseq_genealogical_nearest_neighbours";
+  int num_threads = validate_threads(threads, caller);
   rtsk_treeseq_t ts_xptr(ts);
-  return tsk_treeseq_get_max_time(ts_xptr);
+  const node_sets sets = list_to_node_sets(ts_xptr, reference_sets, caller);
+  const std::size_t num_sets = sets.sets.size();
+  const std::vector<tsk_id_t> focal_ids = int_vector_to_tsk_id_vector(focal);
+  const std::size_t num_focal = focal_ids.size();
+  const tsk_size_t num_nodes = tsk_treeseq_get_num_nodes(ts_xptr);
+  for (const tsk_id_t u : focal_ids) {
+    if (u < 0 || static_cast<tsk_size_t>(u) >= num_nodes) {
+      Rcpp::stop("%s: node IDs must be between 0 and the number of nodes - 1",
+                 caller);
+    }
+  }
+  num_threads = static_cast<int>(std::max<std::size_t>(
+      1, std::min<std::size_t>(static_cast<std::size_t>(num_threads),
+                               num_focal)));
+
+  Rcpp::NumericMatrix out(static_cast<int>(num_focal),
+                          static_cast<int>(num_sets));
+  double *x = REAL(out);
+  worker_status status;
+  run_threads(num_threads, status, [&](int thread_index) {
+    const std::size_t t = static_cast<std::size_t>(thread_index);
+    const std::size_t start = t * num_focal / num_threads;
+    const std::size_t stop = (t + 1) * num_focal / num_threads;
+    if (start == stop) {
+      return;
+    }
+    // tskit fills one row per focal node, R stores one column per set
+    std::vector<double> rows((stop - start) * num_sets);
+    int ret = tsk_treeseq_genealogical_nearest_neighbours(
+        ts_xptr, focal_ids.data() + start,
+        static_cast<tsk_size_t>(stop - start), sets.pointers.data(),
+        sets.sizes.data(), static_cast<tsk_size_t>(num_sets), 0, rows.data());
+    if (ret != 0) {
+      status.fail_tsk(ret);
+      return;
+    }
+    for (std::size_t j = start; j < stop; j++) {
+      for (std::size_t k = 0; k < num_sets; k++) {
+        x[j + k * num_focal] = rows[(j - start) * num_sets + k];
+      }
+    }
+  });
+  status.stop_if_failed();
+  return out;
 }
 
-// PUBLIC, wrapper for tsk_treeseq_get_file_uuid
-// @describeIn rtsk_treeseq_summary Get the file uuid string
+// PUBLIC, wrapper for tsk_treeseq_mean_descendants
+// @title Mean number of descendants of nodes in reference sets
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param reference_sets list of integer vectors of node IDs (0-based), the
+//   disjoint reference sets.
+// @details This function calls \code{tsk_treeseq_mean_descendants()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.mean_descendants}).
+// @return A numeric matrix with one row per node and one column per
+//   reference set, holding the mean number of descendants of the node in
+//   the set over the parts of the genome where the node is an ancestor of
+//   any reference node.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
+// C <- RcppTskit:::rtsk_treeseq_mean_descendants(ts_xptr, list(0:7, 8:15))
+// tail(C)
 // [[Rcpp::export]]
-Rcpp::String rtsk_treeseq_get_file_uuid(SEXP ts) {
+Rcpp::NumericMatrix rtsk_treeseq_mean_descendants(
+    SEXP ts, const Rcpp::List &reference_sets) {
+  const char *caller = "rtsk_treeseq_mean_descendants";
   rtsk_treeseq_t ts_xptr(ts);
-  const char *p = tsk_treeseq_get_file_uuid(ts_xptr);
-  if (p == NULL || p[0] == '\0') {
-    return Rcpp::String(NA_STRING);
+  const node_sets sets = list_to_node_sets(ts_xptr, reference_sets, caller);
+  const std::size_t num_sets = sets.sets.size();
+  const std::size_t num_nodes =
+      static_cast<std::size_t>(tsk_treeseq_get_num_nodes(ts_xptr));
+  std::vector<double> rows(num_nodes * num_sets);
+  int ret = tsk_treeseq_mean_descendants(
+      ts_xptr, sets.pointers.data(), sets.sizes.data(),
+      static_cast<tsk_size_t>(num_sets), 0, rows.data());
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
   }
-  return Rcpp::String(p);
+  Rcpp::NumericMatrix out(static_cast<int>(num_nodes),
+                          static_cast<int>(num_sets));
+  double *x = REAL(out);
+  for (std::size_t u = 0; u < num_nodes; u++) {
+    for (std::size_t k = 0; k < num_sets; k++) {
+      x[u + k * num_nodes] = rows[u * num_sets + k];
+    }
+  }
+  return out;
 }
 
-// PUBLIC, RcppTskit extension
-// @name rtsk_treeseq_summary
-// @title Summary of properties and number of records in a tree sequence
+// PUBLIC, wrapper for tsk_treeseq_kc_distance
+// @title Kendall-Colijn distance between two tree sequences
 // @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
 //   object.
-// @details These functions return the summary of properties and number of
-//   records in a tree sequence, by calling
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_provenances},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_populations},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_migrations},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_individuals},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_samples},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_nodes},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_edges},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_trees},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_sites},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_num_mutations},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_sequence_length},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_discrete_genome},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_has_reference_sequence},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_time_units},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_discrete_time},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_min_time},
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_max_time},
-//   and
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_treeseq_get_file_uuid},
-// @return \code{rtsk_treeseq_summary} returns a named list with numbers and
-//   values, while functions \code{rtsk_treeseq_*} return the number or value
-//   for each item. Count-like values are returned as \code{R bit64::integer64}
-//   to approach range in \code{C tsk_size_t / uint64_t}
-//   (see \code{rtsk_wrap_tsk_size_t_as_integer64} for more details).
+// @param other an external pointer to another tree sequence with the same
+//   samples and sequence length.
+// @param lambda weight of the branch lengths (between 0 for topology only
+//   and 1 for branch lengths only).
+// @param threads number of threads, each sweeping a part of the genome.
+// @details With \code{threads = 1} this function calls
+//   \code{tsk_treeseq_kc_distance()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.kc_distance}).
+//   Otherwise the genome is split at tree breakpoints of \code{ts} into one
+//   interval per thread, each thread seeks both tree sequences to the start
+//   of its interval with \code{tsk_tree_seek()} and sweeps the pairs of
+//   overlapping trees to the end of the interval, updating the KC vectors
+//   incrementally as \code{tskit} does. Each thread holds two KC vectors of
+//   length \eqn{n(n + 1) / 2} for \eqn{n} samples.
+// @return The span-weighted mean KC distance between the trees.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
 // ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// RcppTskit:::rtsk_treeseq_summary(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_provenances(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_populations(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_migrations(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_individuals(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_samples(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_nodes(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_edges(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_trees(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_sites(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_num_mutations(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_sequence_length(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_discrete_genome(ts_xptr)
-// RcppTskit:::rtsk_treeseq_has_reference_sequence(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_time_units(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_discrete_time(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_min_time(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_max_time(ts_xptr)
-// RcppTskit:::rtsk_treeseq_get_file_uuid(ts_xptr)
-// EXTENSION: composite summary helper (no single tsk_* equivalent).
+// RcppTskit:::rtsk_treeseq_kc_distance(ts_xptr, ts_xptr, threads = 2L)
 // [[Rcpp::export]]
-Rcpp::List rtsk_treeseq_summary(SEXP ts) {
-  return Rcpp::List::create(
-      Rcpp::_["num_provenances"] = rtsk_treeseq_get_num_provenances(ts),
-      Rcpp::_["num_populations"] = rtsk_treeseq_get_num_populations(ts),
-      Rcpp::_["num_migrations"] = rtsk_treeseq_get_num_migrations(ts),
-      Rcpp::_["num_individuals"] = rtsk_treeseq_get_num_individuals(ts),
-      Rcpp::_["num_samples"] = rtsk_treeseq_get_num_samples(ts),
-      Rcpp::_["num_nodes"] = rtsk_treeseq_get_num_nodes(ts),
-      Rcpp::_["num_edges"] = rtsk_treeseq_get_num_edges(ts),
-      Rcpp::_["num_trees"] = rtsk_treeseq_get_num_trees(ts),
-      Rcpp::_["num_sites"] = rtsk_treeseq_get_num_sites(ts),
-      Rcpp::_["num_mutations"] = rtsk_treeseq_get_num_mutations(ts),
-      Rcpp::_["sequence_length"] = rtsk_treeseq_get_sequence_length(ts),
-      Rcpp::_["discrete_genome"] = rtsk_treeseq_get_discrete_genome(ts),
-      Rcpp::_["has_reference_sequence"] =
-          rtsk_treeseq_has_reference_sequence(ts),
-      Rcpp::_["time_units"] = rtsk_treeseq_get_time_units(ts),
-      Rcpp::_["discrete_time"] = rtsk_treeseq_get_discrete_time(ts),
-      Rcpp::_["min_time"] = rtsk_treeseq_get_min_time(ts),
-      Rcpp::_["max_time"] = rtsk_treeseq_get_max_time(ts),
-      Rcpp::_["file_uuid"] = rtsk_treeseq_get_file_uuid(ts));
+double rtsk_treeseq_kc_distance(SEXP ts, SEXP other, double lambda = 0,
+                                int threads = 1) {
+  const char *caller = "rtsk_treeseq_kc_distance";
+  int num_threads = validate_threads(threads, caller);
+  if (!std::isfinite(lambda)) {
+    Rcpp::stop("%s requires a finite lambda", caller);
+  }
+  rtsk_treeseq_t ts_xptr(ts);
+  rtsk_treeseq_t other_xptr(other);
+  double result = 0;
+  if (num_threads == 1) {
+    int ret = tsk_treeseq_kc_distance(ts_xptr, other_xptr, lambda, &result);
+    if (ret != 0) {
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    return result;
+  }
+
+  // The input checks of tsk_treeseq_kc_distance()
+  const double sequence_length = tsk_treeseq_get_sequence_length(ts_xptr);
+  if (sequence_length != tsk_treeseq_get_sequence_length(other_xptr)) {
+    Rcpp::stop(tsk_strerror(TSK_ERR_SEQUENCE_LENGTH_MISMATCH));
+  }
+  const tsk_size_t num_samples = tsk_treeseq_get_num_samples(ts_xptr);
+  if (num_samples != tsk_treeseq_get_num_samples(other_xptr)) {
+    Rcpp::stop(tsk_strerror(TSK_ERR_SAMPLE_SIZE_MISMATCH));
+  }
+  if (!std::equal(tsk_treeseq_get_samples(ts_xptr),
+                  tsk_treeseq_get_samples(ts_xptr) + num_samples,
+                  tsk_treeseq_get_samples(other_xptr))) {
+    Rcpp::stop(tsk_strerror(TSK_ERR_SAMPLES_NOT_EQUAL));
+  }
+
+  const std::size_t num_trees =
+      static_cast<std::size_t>(tsk_treeseq_get_num_trees(ts_xptr));
+  const double *breakpoints = tsk_treeseq_get_breakpoints(ts_xptr);
+  num_threads = static_cast<int>(
+      std::min(static_cast<std::size_t>(num_threads), num_trees));
+  std::vector<std::unique_ptr<kc_sweep>> sweeps;
+  for (int t = 0; t < num_threads; t++) {
+    sweeps.emplace_back(new kc_sweep(ts_xptr));
+    sweeps.emplace_back(new kc_sweep(other_xptr));
+  }
+  std::vector<double> totals(static_cast<std::size_t>(num_threads), 0);
+  worker_status status;
+  run_threads(num_threads, status, [&](int thread_index) {
+    const std::size_t t = static_cast<std::size_t>(thread_index);
+    kc_sweep &a = *sweeps[2 * t];
+    kc_sweep &b = *sweeps[2 * t + 1];
+    double left = breakpoints[t * num_trees / num_threads];
+    const double stop = breakpoints[(t + 1) * num_trees / num_threads];
+    int ret = a.seek(left);
+    if (ret == 0) {
+      ret = b.seek(left);
+    }
+    double total = 0;
+    while (ret == 0) {
+      const double right = std::min({a.right(), b.right(), stop});
+      total += kc_sweep::distance(a, b, lambda) * (right - left);
+      left = right;
+      if (left >= stop) {
+        break;
+      }
+      if (a.right() == left) {
+        ret = a.next();
+      }
+      if (ret == 0 && b.right() == left) {
+        ret = b.next();
+      }
+    }
+    if (ret != 0) {
+      status.fail_tsk(ret);
+      return;
+    }
+    totals[t] = total;
+  });
+  status.stop_if_failed();
+  for (const double total : totals) {
+    result += total;
+  }
+  return result / sequence_length;
 }
 
-// PUBLIC, RcppTskit extension
-// @title Get the length of metadata in a tree sequence and its tables
-// @param ts tree sequence as a \code{\link{TreeSequence}} object or
-//   an external pointer to tree sequence as a \code{tsk_treeseq_t} object.
-// @details This function returns the length of metadata stored on the tree
-//   sequence and in each table by calling
-//   \code{ts->tables->metadata_length} and
-//   \code{ts->tables->x->metadata_length} on each table \code{x}, e.g.,
-// \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_population_table_t.metadata_length}.
-// @return A named list with the length of metadata as \code{R bit64::integer64}
-//   values.
+// PUBLIC, wrapper for tsk_treeseq_split_edges
+// @title Split the edges of a tree sequence at a time
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param time edges with a child younger and a parent older than
+//   \code{time} are split in two by a new node at \code{time}.
+// @param flags node flags of the new nodes.
+// @param population population ID of the new nodes (-1 for none).
+// @param metadata raw metadata of the new nodes (or \code{NULL}).
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function calls \code{tsk_treeseq_split_edges()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.split_edges}).
+//   Mutations above \code{time} on a split edge are moved to the new node.
+//   Together with \code{rtsk_treeseq_extend_haplotypes()} this can reduce
+//   the number of edges of inferred ARGs.
+// @return An external pointer to the new tree sequence as a
+//   \code{tsk_treeseq_t} object.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
 // ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// RcppTskit:::rtsk_treeseq_metadata_length(ts_xptr)
+// split_xptr <- RcppTskit:::rtsk_treeseq_split_edges(ts_xptr, time = 0.5)
+// RcppTskit:::rtsk_treeseq_get_num_edges(split_xptr)
 // [[Rcpp::export]]
-Rcpp::List rtsk_treeseq_metadata_length(SEXP ts) {
+SEXP rtsk_treeseq_split_edges(
+    SEXP ts, double time, int flags = 0, int population = -1,
+    Rcpp::Nullable<Rcpp::RawVector> metadata = R_NilValue, int options = 0) {
+  const tsk_flags_t tsk_options =
+      validate_options(options, 0, "rtsk_treeseq_split_edges");
   rtsk_treeseq_t ts_xptr(ts);
-  const tsk_table_collection_t *tables = ts_xptr->tables;
-  return Rcpp::List::create(
-      // The tree sequence metadata is the tables collection metadata and
-      // tsk_treeseq_get_metadata_length() returns self->tables->metadata_length
-      // Rcpp::_["ts"] =
-      //    static_cast<int>(tsk_treeseq_get_metadata_length(ts_xptr)),
-      // hence we just use that here
-      Rcpp::_["ts"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->metadata_length,
-          "rtsk_treeseq_metadata_length/tables->metadata_length"),
-      Rcpp::_["populations"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->populations.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->populations.metadata_length"),
-      Rcpp::_["migrations"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->migrations.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->migrations.metadata_length"),
-      Rcpp::_["individuals"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->individuals.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->individuals.metadata_length"),
-      Rcpp::_["nodes"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->nodes.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->nodes.metadata_length"),
-      Rcpp::_["edges"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->edges.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->edges.metadata_length"),
-      Rcpp::_["sites"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->sites.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->sites.metadata_length"),
-      Rcpp::_["mutations"] = rtsk_wrap_tsk_size_t_as_integer64(
-          tables->mutations.metadata_length,
-          "rtsk_treeseq_metadata_length/tables->mutations.metadata_length"));
+  require_sites(ts, "rtsk_treeseq_split_edges");
+  const Rcpp::RawVector metadata_vec =
+      nullable_to_vector_or_empty<Rcpp::RawVector>(metadata);
+  const tsk_size_t metadata_length =
+      static_cast<tsk_size_t>(metadata_vec.size());
+  const char *metadata_ptr =
+      metadata_length > 0 ? reinterpret_cast<const char *>(RAW(metadata_vec))
+                          : nullptr;
+  tsk_treeseq_t *output = new tsk_treeseq_t();
+  int ret = tsk_treeseq_split_edges(
+      ts_xptr, time, static_cast<tsk_flags_t>(flags),
+      static_cast<tsk_id_t>(population), metadata_ptr, metadata_length,
+      tsk_options, output);
+  if (ret != 0) {
+    tsk_treeseq_free(output);
+    delete output;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  rtsk_treeseq_t output_xptr(output, true);
+  return output_xptr;
 }
 
-// INTERNAL (for now)
-// # nocov start
-// TODO: Metadata notes if we do anything with metadata #36
-//       https://github.com/HighlanderLab/RcppTskit/issues/36
-// This is how we would get metadata, but it will be raw bytes,
-// so would have to work with schema and codes ...
+// PUBLIC, wrapper for tsk_treeseq_extend_haplotypes
+// @title Extend the haplotypes of a tree sequence
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param max_iter maximum number of iterations, each with a forward and a
+//   backward pass along the genome; iterations stop early when the number
+//   of edges no longer changes.
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function ports \code{tsk_treeseq_extend_haplotypes()} (see
+//   \url{https://tskit.dev/tskit/docs/stable/python-api.html#tskit.TreeSequence.extend_haplotypes}),
+//   which extends the spans of ancestral haplotypes over neighbouring trees
+//   where this is consistent with the trees, so fewer edges are needed, and
+//   gives the same tree sequence. Unlike \code{tskit}, which allocates its
+//   lists of edges anew in each pass and copies all tables for each pass,
+//   one arena of list entries and one copy of the tables are reused over
+//   all passes; each pass still sorts and indexes the edges, so the run
+//   time grows with \code{max_iter}; see
+//   \code{inst/examples/benchmark_compaction.R} for the trade-off.
+// @return An external pointer to the new tree sequence as a
+//   \code{tsk_treeseq_t} object.
+// @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
 // ts_xptr <- RcppTskit:::rtsk_treeseq_load(ts_file)
-// RcppTskit:::rtsk_treeseq_get_metadata(ts_xptr)
-// slendr::ts_metadata(slim_ts)
-Rcpp::String rtsk_treeseq_get_metadata(SEXP ts) {
+// ext_xptr <- RcppTskit:::rtsk_treeseq_extend_haplotypes(ts_xptr)
+// RcppTskit:::rtsk_treeseq_get_num_edges(ext_xptr)
+// [[Rcpp::export]]
+SEXP rtsk_treeseq_extend_haplotypes(SEXP ts, int max_iter = 10,
+                                    int options = 0) {
+  validate_options(options, 0, "rtsk_treeseq_extend_haplotypes");
   rtsk_treeseq_t ts_xptr(ts);
-  const char *p = tsk_treeseq_get_metadata(ts_xptr);
-  tsk_size_t n = tsk_treeseq_get_metadata_length(ts_xptr);
-  std::string metadata;
-  if (n > 0 && p != NULL) {
-    metadata.assign(p, p + n);
+  require_sites(ts, "rtsk_treeseq_extend_haplotypes");
+  tsk_treeseq_t *output = new tsk_treeseq_t();
+  int ret = haplotype_extender(ts_xptr).run(max_iter, output);
+  if (ret != 0) {
+    delete output;
+    Rcpp::stop(tsk_strerror(ret));
   }
-  return Rcpp::String(metadata);
+  rtsk_treeseq_t output_xptr(output, true);
+  return output_xptr;
 }
-// # nocov end
-
-// TODO: Metadata notes if we do anything with metadata #36
-//       https://github.com/HighlanderLab/RcppTskit/issues/36
-// int rtsk_treeseq_metadata_schema_length(const SEXP ts) {
-//  rtsk_treeseq_t ts_xptr(ts);
-//  return static_cast<int>(tsk_treeseq_get_metadata_schema_length(ts_xptr));
-// }
-// TODO: test the above function
-// TODO: document the above function
-// TODO: expose the above function to R, including TreeSequence method
-
-// TODO: Develop tsk_treeseq_get_metadata
-// TODO: Metadata notes if we do anything with metadata #36
-//       https://github.com/HighlanderLab/RcppTskit/issues/36
 
 // See tsk_treeseq_t inst/include/tskit/tskit/tables.h on which elements
 // are there in a tsk_table_collection_t type.
@@ -1050,8 +8027,19 @@ bool rtsk_table_collection_has_index(SEXP tc, int options = 0) {
 //   \code{tsk_table_collection_t} object.
 // @param options passed to \code{tskit C}, currently unused and should be
 //   set to \code{0}.
-// @details This function calls
+// @param threads number of threads sorting the edges.
+// @param incremental logical; keep the order of edges that are already
+//   indexed (the table collection was indexed before edges were appended)
+//   and merge the appended edges into it?
+// @details With \code{threads = 1} and \code{incremental = FALSE} this
+//   function calls
 //   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_build_index}.
+//   Otherwise the edge insertion and removal orders are built concurrently,
+//   each sorting the edges with a parallel merge sort, and set with
+//   \code{tsk_table_collection_set_indexes()}. The incremental mode first
+//   checks in one pass that the existing index still orders the indexed
+//   edges by their current columns and parent times; then only the appended
+//   edges are sorted and merged, otherwise all edges are sorted.
 // @return No return value; called for side effects.
 // @examples
 // ts_file <- system.file("examples/test.trees", package = "RcppTskit")
@@ -1061,17 +8049,119 @@ bool rtsk_table_collection_has_index(SEXP tc, int options = 0) {
 // RcppTskit:::rtsk_table_collection_has_index(tc_xptr)
 // RcppTskit:::rtsk_table_collection_build_index(tc_xptr)
 // RcppTskit:::rtsk_table_collection_has_index(tc_xptr)
+// RcppTskit:::rtsk_table_collection_drop_index(tc_xptr)
+// RcppTskit:::rtsk_table_collection_build_index(tc_xptr, threads = 2L)
+// RcppTskit:::rtsk_table_collection_has_index(tc_xptr)
 // [[Rcpp::export]]
-void rtsk_table_collection_build_index(SEXP tc, int options = 0) {
-  const tsk_flags_t flags =
-      validate_options(options, 0, "rtsk_table_collection_build_index");
+void rtsk_table_collection_build_index(SEXP tc, int options = 0,
+                                       int threads = 1,
+                                       bool incremental = false) {
+  const char *caller = "rtsk_table_collection_build_index";
+  const tsk_flags_t flags = validate_options(options, 0, caller);
+  const int num_threads = validate_threads(threads, caller);
   rtsk_table_collection_t tc_xptr(tc);
-  int ret = tsk_table_collection_build_index(tc_xptr, flags);
+  own_tables(tc_xptr, RTSK_INDEXES);
+  if (num_threads == 1 && !incremental) {
+    int ret = tsk_table_collection_build_index(tc_xptr, flags);
+    if (ret != 0) {
+      Rcpp::stop(tsk_strerror(ret));
+    }
+    return;
+  }
+
+  // An index only makes sense for sorted edges that refer to existing nodes
+  const tsk_table_collection_t *tables = tc_xptr;
+  worker_status status;
+  const tsk_id_t ret_id = integrity_check(tables, TSK_CHECK_EDGE_ORDERING)
+                              .run(num_threads, status);
+  status.stop_if_failed();
+  if (ret_id < 0) {
+    Rcpp::stop(tsk_strerror(static_cast<int>(ret_id)));
+  }
+  std::size_t num_indexed = 0;
+  if (incremental && tables->indexes.edge_insertion_order != NULL &&
+      tables->indexes.edge_removal_order != NULL &&
+      tables->indexes.num_edges <= tables->edges.num_rows) {
+    num_indexed = static_cast<std::size_t>(tables->indexes.num_edges);
+  }
+  std::vector<tsk_id_t> orders[2] = {
+      std::vector<tsk_id_t>(tables->indexes.edge_insertion_order,
+                            tables->indexes.edge_insertion_order +
+                                num_indexed),
+      std::vector<tsk_id_t>(tables->indexes.edge_removal_order,
+                            tables->indexes.edge_removal_order + num_indexed)};
+
+  // The insertion and removal orders are built concurrently, each on half of
+  // the threads
+  const int num_outer = std::min(num_threads, 2);
+  run_threads(num_outer, status, [&](int thread_index) {
+    for (int k = thread_index; k < 2; k += num_outer) {
+      const int num_inner = k == 0 ? (num_threads + 1) / 2 : num_threads / 2;
+      edge_index_order(tables, k == 0, num_indexed,
+                       orders[static_cast<std::size_t>(k)],
+                       std::max(num_inner, 1), status);
+    }
+  });
+  status.stop_if_failed();
+  int ret = tsk_table_collection_set_indexes(tc_xptr, orders[0].data(),
+                                             orders[1].data());
   if (ret != 0) {
     Rcpp::stop(tsk_strerror(ret));
   }
 }
 
+// PUBLIC, wrapper for tsk_table_collection_check_integrity
+// @title Check the integrity of a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C}: the bitwise \code{TSK_CHECK_*}
+//   flags and \code{TSK_NO_CHECK_POPULATION_REFS} (1 << 12).
+// @param threads number of threads checking the tables.
+// @details With \code{threads = 1} this function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_check_integrity}.
+//   Otherwise the tables are checked concurrently, with the rows of each
+//   table split into chunks across the threads, giving the same result. The
+//   tree and mutation parent checks (\code{TSK_CHECK_TREES} (1 << 7) and
+//   \code{TSK_CHECK_MUTATION_PARENTS} (1 << 8)) sweep along the genome and
+//   run on one thread after the table checks.
+// @return The number of trees with \code{TSK_CHECK_TREES}, otherwise 0; an
+//   error is raised if the tables are not valid.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_check_integrity(tc_xptr)
+// RcppTskit:::rtsk_table_collection_check_integrity(tc_xptr,
+//   options = bitwShiftL(1L, 7), threads = 2L)
+// [[Rcpp::export]]
+int rtsk_table_collection_check_integrity(SEXP tc, int options = 0,
+                                          int threads = 1) {
+  const char *caller = "rtsk_table_collection_check_integrity";
+  if (options < 0) {
+    Rcpp::stop("%s does not support negative options", caller);
+  }
+  const tsk_flags_t flags = static_cast<tsk_flags_t>(options);
+  const tsk_flags_t unsupported = flags & ~kCheckIntegritySupportedFlags;
+  if (unsupported != 0) {
+    Rcpp::stop("%s only supports TSK_CHECK_* options and "
+               "TSK_NO_CHECK_POPULATION_REFS (1 << 12); unsupported bits: 0x%X",
+               caller, static_cast<unsigned int>(unsupported));
+  }
+  const int num_threads = validate_threads(threads, caller);
+  rtsk_table_collection_t tc_xptr(tc);
+  tsk_id_t ret;
+  if (num_threads == 1) {
+    ret = tsk_table_collection_check_integrity(tc_xptr, flags);
+  } else {
+    worker_status status;
+    ret = integrity_check(tc_xptr, flags).run(num_threads, status);
+    status.stop_if_failed();
+  }
+  if (ret < 0) {
+    Rcpp::stop(tsk_strerror(static_cast<int>(ret)));
+  }
+  return static_cast<int>(ret);
+}
+
 // PUBLIC, wrapper for tsk_table_collection_drop_index
 // @title Drop indexes for a table collection
 // @param tc an external pointer to table collection as a
@@ -1092,6 +8182,8 @@ void rtsk_table_collection_drop_index(SEXP tc, int options = 0) {
   const tsk_flags_t flags =
       validate_options(options, 0, "rtsk_table_collection_drop_index");
   rtsk_table_collection_t tc_xptr(tc);
+  // Borrowed indexes are forgotten rather than freed
+  table_collection_release(tc_xptr, RTSK_INDEXES);
   int ret = tsk_table_collection_drop_index(tc_xptr, flags);
   // tsk_table_collection_drop_index() currently documents always returning 0;
   // so we test for possible future failures, but we cannot unit-test this
@@ -1105,9 +8197,256 @@ void rtsk_table_collection_drop_index(SEXP tc, int options = 0) {
 // TODO: Do we have to add TableCollection$sort() method? #99
 //       https://github.com/HighlanderLab/RcppTskit/issues/99
 
-// TODO: Do we need any other method on table collection to produce a valid
-//       ts? #100
-//       https://github.com/HighlanderLab/RcppTskit/issues/100
+// PUBLIC, wrapper for tsk_table_collection_canonicalise
+// @title Canonicalise a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C}: \code{TSK_SUBSET_KEEP_UNREFERENCED}
+//   (1 << 1) keeps the unreferenced individuals, populations, and sites.
+// @param threads number of threads sorting the tables.
+// @details With \code{threads = 1} this function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_canonicalise}.
+//   Otherwise the tables are subset to all nodes by \code{tskit} as well,
+//   but the edges, sites, mutations, and individuals are then sorted with
+//   parallel stable sorts and their columns gathered in the new order on the
+//   worker threads. The result is the same, except that edges with equal
+//   parent time, parent, child, and left keep their order.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_canonicalise(tc_xptr)
+// RcppTskit:::rtsk_table_collection_canonicalise(tc_xptr, threads = 2L)
+// RcppTskit:::rtsk_table_collection_has_index(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_canonicalise(SEXP tc, int options = 0,
+                                        int threads = 1) {
+  const char *caller = "rtsk_table_collection_canonicalise";
+  const tsk_flags_t flags =
+      validate_options(options, TSK_SUBSET_KEEP_UNREFERENCED, caller);
+  const int num_threads = validate_threads(threads, caller);
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_ALL_TABLES);
+  int ret;
+  if (num_threads == 1) {
+    ret = tsk_table_collection_canonicalise(tc_xptr, flags);
+  } else {
+    tsk_table_collection_t *tables = tc_xptr;
+    std::vector<tsk_id_t> nodes(
+        static_cast<std::size_t>(tables->nodes.num_rows));
+    std::iota(nodes.begin(), nodes.end(), 0);
+    ret = tsk_table_collection_subset(tables, nodes.data(),
+                                      tables->nodes.num_rows, flags);
+    if (ret == 0) {
+      worker_status status;
+      ret = canonical_sort(tables, num_threads, status);
+      status.stop_if_failed();
+    }
+  }
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_deduplicate_sites
+// @title Remove sites with duplicate positions from a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_deduplicate_sites}.
+//   The first site at each position is kept and the sites must be sorted.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_deduplicate_sites(tc_xptr)
+// RcppTskit:::rtsk_table_collection_get_num_sites(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_deduplicate_sites(SEXP tc, int options = 0) {
+  const tsk_flags_t flags =
+      validate_options(options, 0, "rtsk_table_collection_deduplicate_sites");
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_SITES | RTSK_MUTATIONS);
+  int ret = tsk_table_collection_deduplicate_sites(tc_xptr, flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_compute_mutation_parents
+// @title Compute the parents of mutations in a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_compute_mutation_parents}.
+//   The tables must be sorted and indexed; the existing parents are
+//   ignored, and kept on error.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_compute_mutation_parents(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_compute_mutation_parents(SEXP tc, int options = 0) {
+  const tsk_flags_t flags = validate_options(
+      options, 0, "rtsk_table_collection_compute_mutation_parents");
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_MUTATIONS);
+  int ret = tsk_table_collection_compute_mutation_parents(tc_xptr, flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_compute_mutation_times
+// @title Compute the times of mutations in a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_compute_mutation_times}.
+//   The tables must be sorted and indexed. Mutations are spread evenly
+//   along the edge above their node, and the mutations are sorted again if
+//   the new times require it.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_compute_mutation_times(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_compute_mutation_times(SEXP tc, int options = 0) {
+  const tsk_flags_t flags = validate_options(
+      options, 0, "rtsk_table_collection_compute_mutation_times");
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_ALL_TABLES);
+  int ret = tsk_table_collection_compute_mutation_times(tc_xptr, NULL, flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_subset
+// @title Subset a table collection to a set of nodes
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param nodes integer vector of node IDs (0-based) to keep, in their new
+//   order.
+// @param options passed to \code{tskit C}:
+//   \code{TSK_SUBSET_NO_CHANGE_POPULATIONS} (1 << 0) keeps the population
+//   table as it is and \code{TSK_SUBSET_KEEP_UNREFERENCED} (1 << 1) keeps
+//   the unreferenced individuals, populations, and sites.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_subset}.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_subset(tc_xptr, nodes = 0:9)
+// RcppTskit:::rtsk_table_collection_get_num_nodes(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_subset(SEXP tc, const Rcpp::IntegerVector &nodes,
+                                  int options = 0) {
+  const tsk_flags_t flags = validate_options(
+      options, TSK_SUBSET_NO_CHANGE_POPULATIONS | TSK_SUBSET_KEEP_UNREFERENCED,
+      "rtsk_table_collection_subset");
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_ALL_TABLES);
+  const std::vector<tsk_id_t> node_ids(nodes.begin(), nodes.end());
+  int ret = tsk_table_collection_subset(
+      tc_xptr, node_ids.data(), static_cast<tsk_size_t>(node_ids.size()),
+      flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, RcppTskit extension
+// @title Union of two table collections
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object, which is extended.
+// @param other an external pointer to the table collection to add from.
+// @param other_node_mapping integer vector with the node ID (0-based) in
+//   \code{tc} of each node in \code{other}, or -1 for nodes to add.
+// @param options the \code{tskit C} \code{TSK_UNION_*} flags:
+//   \code{TSK_UNION_NO_CHECK_SHARED} (1 << 0),
+//   \code{TSK_UNION_NO_ADD_POP} (1 << 1), \code{TSK_UNION_ALL_EDGES}
+//   (1 << 2), and \code{TSK_UNION_ALL_MUTATIONS} (1 << 3).
+// @details This function gives the same result as
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_union},
+//   but each table gets the rows from \code{other} in one bulk append
+//   (\code{tsk_*_table_append_columns()}) rather than row by row. The
+//   result is sorted, indexed, and has its mutation parents computed.
+//   Migrations are not supported.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// other_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// n <- as.integer(RcppTskit:::rtsk_table_collection_get_num_nodes(tc_xptr))
+// RcppTskit:::rtsk_table_collection_union(tc_xptr, other_xptr, rep(-1L, n))
+// RcppTskit:::rtsk_table_collection_get_num_nodes(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_union(SEXP tc, SEXP other,
+                                 const Rcpp::IntegerVector &other_node_mapping,
+                                 int options = 0) {
+  const char *caller = "rtsk_table_collection_union";
+  const tsk_flags_t flags = validate_options(
+      options,
+      TSK_UNION_NO_CHECK_SHARED | TSK_UNION_NO_ADD_POP | TSK_UNION_ALL_EDGES |
+          TSK_UNION_ALL_MUTATIONS,
+      caller);
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_ALL_TABLES);
+  rtsk_table_collection_t other_xptr(other);
+  const tsk_table_collection_t *other_tables = other_xptr;
+  if (static_cast<tsk_size_t>(other_node_mapping.size()) !=
+      other_tables->nodes.num_rows) {
+    Rcpp::stop("%s requires other_node_mapping to have one entry per node "
+               "of other",
+               caller);
+  }
+  const std::vector<tsk_id_t> mapping(other_node_mapping.begin(),
+                                      other_node_mapping.end());
+  int ret = union_tables(tc_xptr, other_tables, mapping.data(), flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// PUBLIC, wrapper for tsk_table_collection_delete_older
+// @title Delete the parts of a table collection older than a time
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param time edges with a parent older than \code{time}, and mutations
+//   and migrations at \code{time} or older, are deleted.
+// @param options passed to \code{tskit C}, currently unused and should be
+//   set to \code{0}.
+// @details This function calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_delete_older}.
+//   The nodes are kept, so IDs do not change.
+// @return No return value; called for side effects.
+// @examples
+// ts_file <- system.file("examples/test.trees", package = "RcppTskit")
+// tc_xptr <- RcppTskit:::rtsk_table_collection_load(ts_file)
+// RcppTskit:::rtsk_table_collection_delete_older(tc_xptr, time = 0.5)
+// RcppTskit:::rtsk_table_collection_get_num_edges(tc_xptr)
+// [[Rcpp::export]]
+void rtsk_table_collection_delete_older(SEXP tc, double time,
+                                        int options = 0) {
+  const tsk_flags_t flags =
+      validate_options(options, 0, "rtsk_table_collection_delete_older");
+  rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_EDGES | RTSK_MIGRATIONS | RTSK_MUTATIONS);
+  int ret = tsk_table_collection_delete_older(tc_xptr, time, flags);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
 
 // PUBLIC, RcppTskit extension
 // @title Summary of properties and number of records in a table collection
@@ -1298,6 +8637,7 @@ int rtsk_individual_table_add_row(
   }
   const tsk_flags_t row_flags = static_cast<tsk_flags_t>(flags);
   rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_INDIVIDUALS);
 
   // Prepare inputs for tskit C tsk_individual_table_add_row() in expected form
   const Rcpp::NumericVector location_vec =
@@ -1398,6 +8738,7 @@ int rtsk_node_table_add_row(
   const tsk_id_t row_individual =
       individual == -1 ? TSK_NULL : static_cast<tsk_id_t>(individual);
   rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_NODES);
 
   const Rcpp::RawVector metadata_vec =
       nullable_to_vector_or_empty<Rcpp::RawVector>(metadata);
@@ -1472,6 +8813,7 @@ int rtsk_edge_table_add_row(
   const tsk_id_t row_parent = static_cast<tsk_id_t>(parent);
   const tsk_id_t row_child = static_cast<tsk_id_t>(child);
   rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_EDGES);
 
   const Rcpp::RawVector metadata_vec =
       nullable_to_vector_or_empty<Rcpp::RawVector>(metadata);
@@ -1544,6 +8886,7 @@ int rtsk_site_table_add_row(
     SEXP tc, double position, const std::string &ancestral_state,
     Rcpp::Nullable<Rcpp::RawVector> metadata = R_NilValue) {
   rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_SITES);
 
   const tsk_size_t ancestral_state_length =
       static_cast<tsk_size_t>(ancestral_state.size());
@@ -1636,6 +8979,7 @@ int rtsk_mutation_table_add_row(
       parent == -1 ? TSK_NULL : static_cast<tsk_id_t>(parent);
   const double row_time = std::isnan(time) ? TSK_UNKNOWN_TIME : time;
   rtsk_table_collection_t tc_xptr(tc);
+  own_tables(tc_xptr, RTSK_MUTATIONS);
 
   const tsk_size_t derived_state_length =
       static_cast<tsk_size_t>(derived_state.size());
@@ -1658,3 +9002,310 @@ int rtsk_mutation_table_add_row(
   }
   return static_cast<int>(row_id);
 }
+
+// PUBLIC, RcppTskit extension
+// @title Initialise a recorder of a forward simulation
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object to start from (copied), or
+//   \code{NULL} to start from empty tables.
+// @param sequence_length sequence length of the empty tables (ignored when
+//   \code{tc} is given).
+// @param simplify_interval number of generations between automatic
+//   simplifications in \code{rtsk_recorder_end_generation()} (0 to simplify
+//   only on request).
+// @details The recorder owns a \code{tsk_table_collection_t} to which nodes
+//   are added directly, while edges are buffered in a contiguous array until
+//   they are needed (at simplification or when dumping the tables). The
+//   buffer is then sorted on its own and merged with the already sorted edge
+//   table in one linear pass (without sorting the whole table), so that
+//   simplification every \code{simplify_interval} generations with
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_simplify}
+//   keeps the tables small over many generations.
+// @return An external pointer to the recorder.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// RcppTskit:::rtsk_recorder_summary(rec_xptr)
+// [[Rcpp::export]]
+SEXP rtsk_recorder_init(SEXP tc = R_NilValue, double sequence_length = 0,
+                        int simplify_interval = 0) {
+  if (simplify_interval < 0) {
+    Rcpp::stop("rtsk_recorder_init: simplify_interval must be non-negative");
+  }
+  const bool has_tc = tc != R_NilValue;
+  if (!has_tc && !(std::isfinite(sequence_length) && sequence_length > 0)) {
+    Rcpp::stop("rtsk_recorder_init: sequence_length must be positive");
+  }
+  tsk_table_collection_t *tc_ptr = NULL;
+  if (has_tc) {
+    rtsk_table_collection_t tc_xptr(tc);
+    tc_ptr = tc_xptr;
+  }
+  rtsk_recorder *rec_ptr = new rtsk_recorder();
+  rec_ptr->simplify_interval = simplify_interval;
+  rec_ptr->generation = 0;
+  int ret;
+  if (has_tc) {
+    ret = tsk_table_collection_copy(tc_ptr, &rec_ptr->tables, 0);
+    if (ret == 0) {
+      ret = tsk_table_collection_check_integrity(&rec_ptr->tables,
+                                                 TSK_CHECK_EDGE_ORDERING);
+      ret = ret < 0 ? ret : 0;
+    }
+  } else {
+    ret = tsk_table_collection_init(&rec_ptr->tables, 0);
+    rec_ptr->tables.sequence_length = sequence_length;
+  }
+  if (ret != 0) {
+    rtsk_recorder_free(rec_ptr);
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  rtsk_recorder_t rec_xptr(rec_ptr, true);
+  return rec_xptr;
+}
+
+// PUBLIC, RcppTskit extension
+// @title Add nodes to a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @param time node times.
+// @param flags node flags (length 1 or the length of \code{time}).
+// @param population population IDs (0-based, -1 for none; length 1 or the
+//   length of \code{time}).
+// @param individual individual IDs (0-based, -1 for none; length 1 or the
+//   length of \code{time}).
+// @details This calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_node_table_add_row}
+//   for each node. Time runs backwards as in \code{tskit}, so a forward
+//   simulation can record generation \code{g} at time \code{-g}.
+// @return The node IDs (0-based) of the added nodes.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// RcppTskit:::rtsk_recorder_add_nodes(rec_xptr, time = c(0, 0, -1),
+//   flags = 0L, population = -1L, individual = -1L)
+// [[Rcpp::export]]
+Rcpp::IntegerVector
+rtsk_recorder_add_nodes(SEXP rec, const Rcpp::NumericVector &time,
+                        const Rcpp::IntegerVector &flags,
+                        const Rcpp::IntegerVector &population,
+                        const Rcpp::IntegerVector &individual) {
+  const char *caller = "rtsk_recorder_add_nodes";
+  const R_xlen_t n = time.size();
+  for (const Rcpp::IntegerVector *x : {&flags, &population, &individual}) {
+    if (x->size() != 1 && x->size() != n) {
+      Rcpp::stop("%s: flags, population, and individual must have length 1 "
+                 "or the length of time",
+                 caller);
+    }
+  }
+  for (R_xlen_t j = 0; j < n; j++) {
+    if (!std::isfinite(time[j])) {
+      Rcpp::stop("%s: time must be finite", caller);
+    }
+    if (flags[flags.size() == 1 ? 0 : j] < 0) {
+      Rcpp::stop("%s: flags must be non-negative", caller);
+    }
+  }
+  rtsk_recorder_t rec_xptr(rec);
+  tsk_node_table_t *nodes = &rec_xptr->tables.nodes;
+  Rcpp::IntegerVector ids(n);
+  for (R_xlen_t j = 0; j < n; j++) {
+    const tsk_id_t id = tsk_node_table_add_row(
+        nodes, static_cast<tsk_flags_t>(flags[flags.size() == 1 ? 0 : j]),
+        time[j], population[population.size() == 1 ? 0 : j],
+        individual[individual.size() == 1 ? 0 : j], NULL, 0);
+    if (id < 0) {
+      Rcpp::stop(tsk_strerror(id));
+    }
+    ids[j] = static_cast<int>(id);
+  }
+  return ids;
+}
+
+// PUBLIC, RcppTskit extension
+// @title Add edges to a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @param left left coordinates of the edges.
+// @param right right coordinates of the edges.
+// @param parent parent node IDs (0-based).
+// @param child child node IDs (0-based).
+// @details The edges are checked and buffered in any order; they are added
+//   to the edge table, sorted, when the recorder is simplified or its tables
+//   are dumped.
+// @return No return value; called for side effects.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// ids <- RcppTskit:::rtsk_recorder_add_nodes(rec_xptr, time = c(1, 1, 0),
+//   flags = 0L, population = -1L, individual = -1L)
+// RcppTskit:::rtsk_recorder_add_edges(rec_xptr, left = c(0, 40),
+//   right = c(40, 100), parent = ids[1:2], child = ids[c(3, 3)])
+// RcppTskit:::rtsk_recorder_summary(rec_xptr)$num_buffered_edges
+// [[Rcpp::export]]
+void rtsk_recorder_add_edges(SEXP rec, const Rcpp::NumericVector &left,
+                             const Rcpp::NumericVector &right,
+                             const Rcpp::IntegerVector &parent,
+                             const Rcpp::IntegerVector &child) {
+  const char *caller = "rtsk_recorder_add_edges";
+  const R_xlen_t n = left.size();
+  if (right.size() != n || parent.size() != n || child.size() != n) {
+    Rcpp::stop("%s: left, right, parent, and child must have the same length",
+               caller);
+  }
+  rtsk_recorder_t rec_xptr(rec);
+  const tsk_table_collection_t &tables = rec_xptr->tables;
+  const double *time = tables.nodes.time;
+  const int num_nodes = static_cast<int>(tables.nodes.num_rows);
+  for (R_xlen_t j = 0; j < n; j++) {
+    if (parent[j] < 0 || parent[j] >= num_nodes || child[j] < 0 ||
+        child[j] >= num_nodes) {
+      Rcpp::stop("%s: parent and child must be node IDs between 0 and the "
+                 "number of nodes - 1",
+                 caller);
+    }
+    if (!(left[j] >= 0 && left[j] < right[j] &&
+          right[j] <= tables.sequence_length)) {
+      Rcpp::stop("%s: edges must have 0 <= left < right <= sequence length",
+                 caller);
+    }
+    if (!(time[parent[j]] > time[child[j]])) {
+      Rcpp::stop("%s: parent must be older than child", caller);
+    }
+  }
+  std::vector<rtsk_recorder_edge> &edges = rec_xptr->edges;
+  edges.reserve(edges.size() + static_cast<std::size_t>(n));
+  for (R_xlen_t j = 0; j < n; j++) {
+    edges.push_back(rtsk_recorder_edge{left[j], right[j], parent[j], child[j]});
+  }
+}
+
+// PUBLIC, RcppTskit extension
+// @title End a generation of a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @param alive node IDs (0-based) of the alive genomes.
+// @details Every \code{simplify_interval} generations (see
+//   \code{rtsk_recorder_init()}) the recorder is simplified with
+//   \code{alive} as samples, which removes the nodes and edges that are not
+//   ancestral to them and renumbers the remaining nodes.
+// @return The node IDs of \code{alive}, renumbered if the recorder was
+//   simplified.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100,
+//   simplify_interval = 1L)
+// ids <- RcppTskit:::rtsk_recorder_add_nodes(rec_xptr, time = c(1, 1, 0),
+//   flags = 0L, population = -1L, individual = -1L)
+// RcppTskit:::rtsk_recorder_add_edges(rec_xptr, left = 0, right = 100,
+//   parent = ids[1], child = ids[3])
+// RcppTskit:::rtsk_recorder_end_generation(rec_xptr, alive = ids[3])
+// RcppTskit:::rtsk_recorder_summary(rec_xptr)
+// [[Rcpp::export]]
+Rcpp::IntegerVector
+rtsk_recorder_end_generation(SEXP rec, const Rcpp::IntegerVector &alive) {
+  rtsk_recorder_t rec_xptr(rec);
+  rec_xptr->generation++;
+  const int interval = rec_xptr->simplify_interval;
+  if (interval == 0 || rec_xptr->generation % interval != 0) {
+    return alive;
+  }
+  const std::vector<tsk_id_t> samples(alive.begin(), alive.end());
+  std::vector<tsk_id_t> node_map;
+  const int ret = recorder_simplify(rec_xptr, samples, node_map);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  Rcpp::IntegerVector ids(alive.size());
+  for (R_xlen_t j = 0; j < alive.size(); j++) {
+    ids[j] = static_cast<int>(node_map[static_cast<std::size_t>(alive[j])]);
+  }
+  return ids;
+}
+
+// PUBLIC, RcppTskit extension
+// @title Simplify the tables of a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @param samples node IDs (0-based) to keep as samples.
+// @details This adds the buffered edges to the edge table and calls
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_simplify}.
+// @return The new node ID of each node before simplification (-1 for
+//   removed nodes).
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// ids <- RcppTskit:::rtsk_recorder_add_nodes(rec_xptr, time = c(1, 1, 0),
+//   flags = 0L, population = -1L, individual = -1L)
+// RcppTskit:::rtsk_recorder_add_edges(rec_xptr, left = 0, right = 100,
+//   parent = ids[1], child = ids[3])
+// RcppTskit:::rtsk_recorder_simplify(rec_xptr, samples = ids[3])
+// [[Rcpp::export]]
+Rcpp::IntegerVector rtsk_recorder_simplify(SEXP rec,
+                                           const Rcpp::IntegerVector &samples) {
+  rtsk_recorder_t rec_xptr(rec);
+  const std::vector<tsk_id_t> sample_ids(samples.begin(), samples.end());
+  std::vector<tsk_id_t> node_map;
+  const int ret = recorder_simplify(rec_xptr, sample_ids, node_map);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  return Rcpp::IntegerVector(node_map.begin(), node_map.end());
+}
+
+// PUBLIC, RcppTskit extension
+// @title Copy the tables of a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @details This adds the buffered edges to the edge table and copies the
+//   tables with
+//   \url{https://tskit.dev/tskit/docs/stable/c-api.html#c.tsk_table_collection_copy}.
+//   The recorder can be used further.
+// @return An external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// ids <- RcppTskit:::rtsk_recorder_add_nodes(rec_xptr, time = c(1, 0),
+//   flags = c(0L, 1L), population = -1L, individual = -1L)
+// RcppTskit:::rtsk_recorder_add_edges(rec_xptr, left = 0, right = 100,
+//   parent = ids[1], child = ids[2])
+// tc_xptr <- RcppTskit:::rtsk_recorder_dump_tables(rec_xptr)
+// RcppTskit:::rtsk_table_collection_get_num_edges(tc_xptr)
+// [[Rcpp::export]]
+SEXP rtsk_recorder_dump_tables(SEXP rec) {
+  rtsk_recorder_t rec_xptr(rec);
+  int ret = recorder_flush(rec_xptr);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  tsk_table_collection_t *tc_ptr = new tsk_table_collection_t();
+  ret = tsk_table_collection_copy(&rec_xptr->tables, tc_ptr, 0);
+  if (ret != 0) {
+    tsk_table_collection_free(tc_ptr);
+    delete tc_ptr;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  rtsk_table_collection_t tc_xptr(tc_ptr, true);
+  return tc_xptr;
+}
+
+// PUBLIC, RcppTskit extension
+// @title Summary of a recorder
+// @param rec an external pointer to a recorder (see
+//   \code{rtsk_recorder_init()}).
+// @return A list with the number of ended generations \code{generation},
+//   \code{simplify_interval}, and the numbers of nodes, edges in the edge
+//   table, and buffered edges as \code{bit64::integer64}.
+// @examples
+// rec_xptr <- RcppTskit:::rtsk_recorder_init(sequence_length = 100)
+// RcppTskit:::rtsk_recorder_summary(rec_xptr)
+// [[Rcpp::export]]
+Rcpp::List rtsk_recorder_summary(SEXP rec) {
+  const char *caller = "rtsk_recorder_summary";
+  rtsk_recorder_t rec_xptr(rec);
+  return Rcpp::List::create(
+      Rcpp::_["generation"] = rec_xptr->generation,
+      Rcpp::_["simplify_interval"] = rec_xptr->simplify_interval,
+      Rcpp::_["num_nodes"] = rtsk_wrap_tsk_size_t_as_integer64(
+          rec_xptr->tables.nodes.num_rows, caller),
+      Rcpp::_["num_edges"] = rtsk_wrap_tsk_size_t_as_integer64(
+          rec_xptr->tables.edges.num_rows, caller),
+      Rcpp::_["num_buffered_edges"] = rtsk_wrap_tsk_size_t_as_integer64(
+          static_cast<tsk_size_t>(rec_xptr->edges.size()), caller));
+}
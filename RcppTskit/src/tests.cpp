@@ -42,9 +42,11 @@ bool tsk_trace_errors_defined() {
 // @title Force tskit-level error path in \code{rtsk_treeseq_copy_tables}
 // @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
 //   object.
+// @param lazy passed to \code{rtsk_treeseq_copy_tables}; the borrowed node
+//   table is then copied (and fails) when a node is added.
 // @return No return value; called for side effects - testing.
 // [[Rcpp::export]]
-SEXP test_rtsk_treeseq_copy_tables_forced_error(SEXP ts) {
+SEXP test_rtsk_treeseq_copy_tables_forced_error(SEXP ts, bool lazy = false) {
   rtsk_treeseq_t ts_xptr(ts);
   tsk_node_table_t &nodes = ts_xptr->tables->nodes;
   tsk_flags_t *saved_flags = nodes.flags;
@@ -52,9 +54,10 @@ SEXP test_rtsk_treeseq_copy_tables_forced_error(SEXP ts) {
   nodes.flags = NULL;
   nodes.time = NULL;
   try {
-    SEXP ret = rtsk_treeseq_copy_tables(ts, 0);
-    // Lines below not hit by tests because rtsk_treeseq_copy_tables() throws
-    // error # nocov start
+    Rcpp::RObject ret = rtsk_treeseq_copy_tables(ts, 0, lazy);
+    (void)rtsk_node_table_add_row(ret);
+    // Lines below not hit by tests because rtsk_treeseq_copy_tables() or
+    // rtsk_node_table_add_row() throws error # nocov start
     nodes.flags = saved_flags;
     nodes.time = saved_time;
     return ret;
@@ -270,3 +273,221 @@ void test_rtsk_mutation_table_add_row_forced_error(SEXP tc) {
     throw;
   }
 }
+
+// ----------------------------------------------------------------------------
+
+// TEST-ONLY
+// @title Compare two table collections with \code{tsk_table_collection_equals}
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param other an external pointer to the table collection to compare with.
+// @param options passed to \code{tsk_table_collection_equals}.
+// @return \code{TRUE} if the table collections are equal.
+// [[Rcpp::export]]
+bool test_tsk_table_collection_equals(SEXP tc, SEXP other, int options = 0) {
+  rtsk_table_collection_t tc_xptr(tc);
+  rtsk_table_collection_t other_xptr(other);
+  return tsk_table_collection_equals(tc_xptr, other_xptr,
+                                     static_cast<tsk_flags_t>(options));
+}
+
+// TEST-ONLY
+// @title Canonicalise a table collection with \code{tskit C}
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tsk_table_collection_canonicalise}.
+// @return No return value; called for side effects - testing against
+//   \code{rtsk_table_collection_canonicalise}.
+// [[Rcpp::export]]
+void test_tsk_table_collection_canonicalise(SEXP tc, int options = 0) {
+  rtsk_table_collection_t tc_xptr(tc);
+  int ret = tsk_table_collection_canonicalise(
+      tc_xptr, static_cast<tsk_flags_t>(options));
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// TEST-ONLY
+// @title Union of two table collections with \code{tskit C}
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object, which is extended.
+// @param other an external pointer to the table collection to add from.
+// @param other_node_mapping integer vector with the node ID (0-based) in
+//   \code{tc} of each node in \code{other}, or -1 for nodes to add.
+// @param options the \code{TSK_UNION_*} flags.
+// @return No return value; called for side effects - testing against
+//   \code{rtsk_table_collection_union}.
+// [[Rcpp::export]]
+void test_tsk_table_collection_union(
+    SEXP tc, SEXP other, const Rcpp::IntegerVector &other_node_mapping,
+    int options = 0) {
+  rtsk_table_collection_t tc_xptr(tc);
+  rtsk_table_collection_t other_xptr(other);
+  const std::vector<tsk_id_t> mapping(other_node_mapping.begin(),
+                                      other_node_mapping.end());
+  int ret = tsk_table_collection_union(tc_xptr, other_xptr, mapping.data(),
+                                       static_cast<tsk_flags_t>(options));
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+}
+
+// TEST-ONLY
+// @title Add a migration to a table collection
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param left,right,node,source,dest,time columns of the migration.
+// @return No return value; called for side effects - testing functions that
+//   do not support migrations.
+// [[Rcpp::export]]
+void test_migration_table_add_row(SEXP tc, double left, double right, int node,
+                                  int source, int dest, double time) {
+  rtsk_table_collection_t tc_xptr(tc);
+  tsk_id_t ret = tsk_migration_table_add_row(&tc_xptr->migrations, left, right,
+                                             node, source, dest, time, NULL, 0);
+  if (ret < 0) {
+    Rcpp::stop(tsk_strerror(ret)); // # nocov
+  }
+}
+
+// TEST-ONLY
+// @title Find IBD segments with \code{tskit C}
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param samples integer vector of sample node IDs (0-based); empty means
+//   all samples when \code{sample_set_sizes} is empty.
+// @param sample_set_sizes integer vector of the sizes of consecutive sample
+//   sets in \code{samples} to find segments between; empty means find
+//   segments within \code{samples}.
+// @param min_span,max_time passed to \code{tsk_table_collection_ibd_within}
+//   or \code{tsk_table_collection_ibd_between}.
+// @return A list with the segments of all pairs in columns \code{a},
+//   \code{b}, \code{left}, \code{right}, and \code{node} - testing against
+//   \code{rtsk_treeseq_ibd_segments}.
+// [[Rcpp::export]]
+Rcpp::List test_tsk_table_collection_ibd(
+    SEXP ts, const Rcpp::IntegerVector &samples,
+    const Rcpp::IntegerVector &sample_set_sizes, double min_span,
+    double max_time) {
+  rtsk_treeseq_t ts_xptr(ts);
+  const std::vector<tsk_id_t> ids(samples.begin(), samples.end());
+  const std::vector<tsk_size_t> sizes(sample_set_sizes.begin(),
+                                      sample_set_sizes.end());
+  tsk_identity_segments_t result;
+  int ret;
+  if (sizes.empty()) {
+    ret = tsk_table_collection_ibd_within(
+        ts_xptr->tables, &result, ids.empty() ? NULL : ids.data(),
+        static_cast<tsk_size_t>(ids.size()), min_span, max_time,
+        TSK_IBD_STORE_SEGMENTS);
+  } else {
+    ret = tsk_table_collection_ibd_between(
+        ts_xptr->tables, &result, static_cast<tsk_size_t>(sizes.size()),
+        sizes.data(), ids.data(), min_span, max_time, TSK_IBD_STORE_SEGMENTS);
+  }
+  if (ret != 0) {
+    tsk_identity_segments_free(&result);
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  const tsk_size_t num_pairs = tsk_identity_segments_get_num_pairs(&result);
+  std::vector<tsk_id_t> pairs(2 * static_cast<std::size_t>(num_pairs));
+  std::vector<tsk_identity_segment_list_t *> lists(
+      static_cast<std::size_t>(num_pairs));
+  ret = tsk_identity_segments_get_items(&result, pairs.data(), lists.data());
+  if (ret != 0) {
+    tsk_identity_segments_free(&result); // # nocov
+    Rcpp::stop(tsk_strerror(ret));       // # nocov
+  }
+  std::vector<int> a, b, node;
+  std::vector<double> left, right;
+  for (std::size_t j = 0; j < lists.size(); j++) {
+    for (const tsk_identity_segment_t *seg = lists[j]->head; seg != NULL;
+         seg = seg->next) {
+      a.push_back(static_cast<int>(pairs[2 * j]));
+      b.push_back(static_cast<int>(pairs[2 * j + 1]));
+      left.push_back(seg->left);
+      right.push_back(seg->right);
+      node.push_back(static_cast<int>(seg->node));
+    }
+  }
+  tsk_identity_segments_free(&result);
+  return Rcpp::List::create(
+      Rcpp::_["a"] = Rcpp::IntegerVector(a.begin(), a.end()),
+      Rcpp::_["b"] = Rcpp::IntegerVector(b.begin(), b.end()),
+      Rcpp::_["left"] = Rcpp::NumericVector(left.begin(), left.end()),
+      Rcpp::_["right"] = Rcpp::NumericVector(right.begin(), right.end()),
+      Rcpp::_["node"] = Rcpp::IntegerVector(node.begin(), node.end()));
+}
+
+// TEST-ONLY
+// @title KC distance between two tree sequences with \code{tskit C}
+// @param ts,other external pointers to tree sequences as
+//   \code{tsk_treeseq_t} objects.
+// @param lambda passed to \code{tsk_treeseq_kc_distance}.
+// @return The KC distance - testing against \code{rtsk_treeseq_kc_distance}.
+// [[Rcpp::export]]
+double test_tsk_treeseq_kc_distance(SEXP ts, SEXP other, double lambda = 0) {
+  rtsk_treeseq_t ts_xptr(ts);
+  rtsk_treeseq_t other_xptr(other);
+  double result = 0;
+  int ret = tsk_treeseq_kc_distance(ts_xptr, other_xptr, lambda, &result);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  return result;
+}
+
+// TEST-ONLY
+// @title Check the integrity of a table collection with \code{tskit C}
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param options passed to \code{tsk_table_collection_check_integrity}.
+// @return The number of trees, 0, or the \code{tskit} error code (no error is
+//   raised) - testing against \code{rtsk_table_collection_check_integrity}.
+// [[Rcpp::export]]
+int test_tsk_table_collection_check_integrity(SEXP tc, int options = 0) {
+  rtsk_table_collection_t tc_xptr(tc);
+  return static_cast<int>(tsk_table_collection_check_integrity(
+      tc_xptr, static_cast<tsk_flags_t>(options)));
+}
+
+// TEST-ONLY
+// @title Extend the haplotypes of a tree sequence with \code{tskit C}
+// @param ts an external pointer to tree sequence as a \code{tsk_treeseq_t}
+//   object.
+// @param max_iter passed to \code{tsk_treeseq_extend_haplotypes}.
+// @return An external pointer to the new tree sequence - testing against
+//   \code{rtsk_treeseq_extend_haplotypes}.
+// [[Rcpp::export]]
+SEXP test_tsk_treeseq_extend_haplotypes(SEXP ts, int max_iter = 10) {
+  rtsk_treeseq_t ts_xptr(ts);
+  tsk_treeseq_t *output = new tsk_treeseq_t();
+  int ret = tsk_treeseq_extend_haplotypes(ts_xptr, max_iter, 0, output);
+  if (ret != 0) {
+    tsk_treeseq_free(output);
+    delete output;
+    Rcpp::stop(tsk_strerror(ret));
+  }
+  rtsk_treeseq_t output_xptr(output, true);
+  return output_xptr;
+}
+
+// TEST-ONLY
+// @title Update an edge in place
+// @param tc an external pointer to table collection as a
+//   \code{tsk_table_collection_t} object.
+// @param row edge ID (0-based).
+// @param left,right,parent,child new columns of the edge.
+// @return No return value; called for side effects - testing indexes that
+//   no longer match the edges.
+// [[Rcpp::export]]
+void test_edge_table_update_row(SEXP tc, int row, double left, double right,
+                                int parent, int child) {
+  rtsk_table_collection_t tc_xptr(tc);
+  int ret = tsk_edge_table_update_row(&tc_xptr->edges, row, left, right,
+                                      parent, child, NULL, 0);
+  if (ret != 0) {
+    Rcpp::stop(tsk_strerror(ret)); // # nocov
+  }
+}